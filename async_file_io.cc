@@ -0,0 +1,209 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#include "private/utils.h"
+
+#include "async_file_io.h"
+#include "utils.h"
+
+using namespace Avalanche;
+
+// blocks are read ahead of libav, its buffer only needs to save it calling us for every few bytes
+constexpr int LEN_AVIO_BUFFER = 64 * 1024;
+
+AsyncFileIo::AsyncFileIo(const std::string &uri) :
+    m_uri(uri) {
+    uint8_t * m_buffer = (unsigned char *)av_malloc(LEN_AVIO_BUFFER);
+    m_avio_context = avio_alloc_context(m_buffer, LEN_AVIO_BUFFER, 0, this, &AsyncFileIo::libavRead, NULL, &AsyncFileIo::libavSeek);
+}
+
+AsyncFileIo::~AsyncFileIo() {
+    // the engine writes into these until they are done
+    dropWindow();
+    for (auto &request: m_abandoned) {
+        m_engine->wait(request.get());
+    }
+    m_abandoned.clear();
+    m_engine = nullptr;
+
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    // we are responsible for this buffer too, though libav internals are allowed
+    // to av_realloc it or even free it
+    av_freep(&m_avio_context->buffer);
+    av_freep(&m_avio_context);
+}
+
+bool AsyncFileIo::open() {
+    m_fd = ::open(m_uri.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        log(LOG_ERROR, "Failed to open %s: %s\n", m_uri.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        log(LOG_ERROR, "Failed to stat %s: %s\n", m_uri.c_str(), strerror(errno));
+        return false;
+    }
+    m_file_size = (int64_t)st.st_size;
+
+    // room for the window plus reads abandoned by seeks that are still in flight, see fillWindow()
+    m_engine = AsyncReadEngine::create(m_fd, QUEUE_DEPTH * 4);
+    return true;
+}
+
+int AsyncFileIo::read(uint8_t *buf, int buf_size) {
+    //log(LOG_INFO, "READ %li %i\n", m_pos, buf_size);
+
+    if (m_pos >= m_file_size) {
+        return AVERROR_EOF;
+    }
+
+    // let go of blocks libav has read past
+    while (!m_window.empty() && m_window.front()->offset + BLOCK_SIZE <= m_pos) {
+        auto request = std::move(m_window.front());
+        m_window.pop_front();
+        freeRequest(std::move(request));
+    }
+
+    if (m_window.empty() || m_pos < m_window.front()->offset) {
+        dropWindow();
+    }
+    if (!fillWindow(m_pos / BLOCK_SIZE * BLOCK_SIZE)) {
+        return AVERROR(EIO);
+    }
+
+    auto &request = m_window.front();
+    m_engine->wait(request.get());
+    if (request->result < 0) {
+        log(LOG_ERROR, "Failed to read %s at %li: %s\n", m_uri.c_str(), request->offset, strerror(-request->result));
+        dropWindow();
+        return AVERROR(-request->result);
+    }
+
+    int64_t available = request->offset + request->result - m_pos;
+    if (available <= 0) {
+        // the engine only stops short at the end of the file, so it got shorter
+        return AVERROR_EOF;
+    }
+    int len = (int)std::min((int64_t)buf_size, available);
+    memcpy(buf, request->data.data() + (m_pos - request->offset), len);
+    m_pos += len;
+
+    return len;
+}
+
+int64_t AsyncFileIo::seek(int64_t offset, int whence) {
+    //log(LOG_INFO, "SEEK %li %i\n", offset, whence);
+
+    int64_t new_pos;
+    switch (whence) {
+    case SEEK_SET:
+        new_pos = offset;
+        break;
+
+    case SEEK_CUR:
+        new_pos = m_pos + offset;
+        break;
+
+    case SEEK_END:
+        new_pos = m_file_size + offset;
+        break;
+
+    case AVSEEK_SIZE:
+        return m_file_size;
+
+    default:
+        log(LOG_ERROR, "Unknown seek whence %i\n", whence);
+        return -1;
+    }
+
+    if (new_pos < 0) {
+        return AVERROR(EINVAL);
+    }
+    // the window is fixed up on the next read, seeks within it cost nothing
+    m_pos = new_pos;
+    return m_pos;
+}
+
+bool AsyncFileIo::fillWindow(int64_t offset) {
+    if ((int)m_abandoned.size() > QUEUE_DEPTH * 2) {
+        // seeking faster than reads finish; let them catch up rather than pile up more
+        for (auto &request: m_abandoned) {
+            m_engine->wait(request.get());
+            m_free.push_back(std::move(request));
+        }
+        m_abandoned.clear();
+    }
+
+    if (!m_window.empty()) {
+        offset = m_window.back()->offset + BLOCK_SIZE;
+    }
+
+    while ((int)m_window.size() < QUEUE_DEPTH && offset < m_file_size) {
+        std::unique_ptr<AsyncReadRequest> request;
+        if (m_free.empty()) {
+            request = std::make_unique<AsyncReadRequest>();
+        } else {
+            request = std::move(m_free.back());
+            m_free.pop_back();
+        }
+        request->offset = offset;
+        request->data.resize((size_t)std::min((int64_t)BLOCK_SIZE, m_file_size - offset));
+
+        if (!m_engine->submit(request.get())) {
+            freeRequest(std::move(request));
+            // whatever is already in flight is still usable
+            return !m_window.empty();
+        }
+        m_window.push_back(std::move(request));
+        offset += BLOCK_SIZE;
+    }
+    return !m_window.empty();
+}
+
+void AsyncFileIo::dropWindow() {
+    for (auto &request: m_window) {
+        freeRequest(std::move(request));
+    }
+    m_window.clear();
+}
+
+void AsyncFileIo::freeRequest(std::unique_ptr<AsyncReadRequest> request) {
+    // collect whatever abandoned requests have finished by now
+    for (auto it = m_abandoned.begin(); it != m_abandoned.end();) {
+        if (m_engine->isDone(it->get())) {
+            if ((int)m_free.size() < QUEUE_DEPTH) {
+                m_free.push_back(std::move(*it));
+            }
+            it = m_abandoned.erase(it);
+        } else {
+            it++;
+        }
+    }
+
+    if (m_engine->isDone(request.get())) {
+        if ((int)m_free.size() < QUEUE_DEPTH) {
+            m_free.push_back(std::move(request));
+        }
+    } else {
+        m_abandoned.push_back(std::move(request));
+    }
+}
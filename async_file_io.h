@@ -0,0 +1,79 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+#include "private/async_read_engine.h"
+
+namespace Avalanche {
+
+// Reads a local file for libav with several block reads in flight ahead of the read position
+// (through io_uring where available, see AsyncReadEngine), so the device queue stays full
+// rather than libav waiting on one synchronous read at a time. A read outside the blocks in
+// flight, i.e. after a seek, drops them and starts a new run of reads where it landed.
+class AsyncFileIo {
+public:
+    static constexpr int BLOCK_SIZE = 256 * 1024;
+    static constexpr int QUEUE_DEPTH = 8;
+
+    AsyncFileIo(const std::string &uri);
+    ~AsyncFileIo();
+
+    bool open();
+
+    AVIOContext * getAvioContext() {
+        return m_avio_context;
+    }
+
+    const std::string & getUri() {
+        return m_uri;
+    }
+
+    static int libavRead(void *this_ptr, uint8_t *buf, int buf_size) {
+        return static_cast<AsyncFileIo *>(this_ptr)->read(buf, buf_size);
+    }
+
+    static int64_t libavSeek(void *this_ptr, int64_t offset, int whence) {
+        return static_cast<AsyncFileIo *>(this_ptr)->seek(offset, whence);
+    }
+
+private:
+    std::string m_uri;
+    AVIOContext *m_avio_context;
+
+    int m_fd = -1;
+    int64_t m_file_size = 0;
+
+    std::unique_ptr<AsyncReadEngine> m_engine;
+
+    int64_t m_pos = 0;
+
+    // consecutive blocks, the first one holding (or about to hold) the read position
+    std::deque<std::unique_ptr<AsyncReadRequest>> m_window;
+    // dropped by a seek while still in flight, freed once done
+    std::vector<std::unique_ptr<AsyncReadRequest>> m_abandoned;
+    // done with, to reuse their buffers
+    std::vector<std::unique_ptr<AsyncReadRequest>> m_free;
+
+    int read(uint8_t *buf, int buf_size);
+    int64_t seek(int64_t offset, int whence);
+
+    // keeps QUEUE_DEPTH blocks in flight (or up to the end of the file) after the window's start
+    bool fillWindow(int64_t offset);
+    void dropWindow();
+    void freeRequest(std::unique_ptr<AsyncReadRequest> request);
+};
+
+}
@@ -0,0 +1,48 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include "async_file_io_group.h"
+
+using namespace Avalanche;
+
+AsyncFileIoGroup::~AsyncFileIoGroup() {
+    for (auto async_file_io: m_async_file_ios) {
+        delete async_file_io;
+    }
+    m_async_file_ios.clear();
+}
+
+AVIOContext * AsyncFileIoGroup::open(const std::string &uri) {
+    if (m_is_aborting) {
+        return NULL;
+    }
+
+    auto async_file_io = new AsyncFileIo(uri);
+    if (!async_file_io->open()) {
+        delete async_file_io;
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_async_file_ios.insert(async_file_io);
+
+    return async_file_io->getAvioContext();
+}
+
+void AsyncFileIoGroup::close(void *opaque) {
+    AsyncFileIo *async_file_io = static_cast<AsyncFileIo *>(opaque);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_async_file_ios.erase(async_file_io);
+    }
+    delete async_file_io;
+}
+
+int AsyncFileIoGroup::interruptCallback() {
+    if (m_is_aborting) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+
+#include "async_file_io.h"
+#include "custom_io_group.h"
+
+namespace Avalanche {
+
+// Reads local files with reads queued ahead of libav, see AsyncFileIo. Output is left to libav.
+class AsyncFileIoGroup : public CustomIoGroup {
+public:
+    virtual ~AsyncFileIoGroup();
+
+    AVIOContext * open(const std::string &uri) override;
+    void close(void *opaque) override;
+
+    int interruptCallback() override;
+
+    // makes libav give up on whatever it is doing
+    void setStopProcessing() {
+        m_is_aborting = true;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::unordered_set<AsyncFileIo *> m_async_file_ios;
+
+    std::atomic<bool> m_is_aborting{false};
+};
+
+}
@@ -2,7 +2,6 @@
  * (c) Chad Walker, Chris Kirmse
  */
 
-import sem from 'semaphore-mutex';
 import log from './log.js';
 import ResourceIo from './resource_io.js';
 import { createRequire } from 'module';
@@ -10,7 +9,6 @@ const require = createRequire(import.meta.url);
 
 // tslint:disable:no-var-requires
 const avalancheNative = require('./Release/avalanche.node');
-const Semaphore = sem.default;
 
 let pendingStr = '';
 
@@ -56,7 +54,6 @@ setDefaultLogFunc();
 
 const activeVideoReaders = new Set<LockedVideoReader>();
 
-type Token = number;
 type Action = {
   input: any[] | null;
   output: any | null;
@@ -85,23 +82,295 @@ type VideoData = {
 
   count_video_packets: number;
   count_key_frames: number;
+
+  // only set when the output was registered with the ResourceIo as inMemory
+  output_buffer?: Buffer;
+};
+type ClipRange = {
+  start_time: number;
+  end_time: number;
+  dest_uri: string;
 };
 type VolumeData = {
   mean_volume: number;
   max_volume: number;
 };
+type IoStats = {
+  count_reads: number;
+  count_seeks: number;
+  // brought into the read cache; what is beyond bytes_read was never used
+  bytes_cached: number;
+  bytes_read: number;
+  // range the adaptive read size went through
+  min_read_size: number;
+  max_read_size: number;
+};
+// avformat_find_stream_info stops at whichever of these it gets to first
+type ProbeTier = {
+  probe_size: number;
+  // in seconds
+  analyze_duration: number;
+};
+type ProbeStats = {
+  // 0 when a probe snapshot was used
+  count_tiers: number;
+  bytes_read: number;
+  // in seconds
+  time: number;
+  is_probe_snapshot_used: boolean;
+  // whether the video and audio codec parameters were all found
+  is_complete: boolean;
+};
 type ProgressFn = (step: number, total: number) => void;
+// interactive actions go ahead of normal ones, which go ahead of batch ones, both waiting for
+// the reader here and waiting for a native thread; a batch action also stops now and then to let
+// waiting interactive and normal work from other readers run
+type Priority = 'interactive' | 'normal' | 'batch';
+type ActionOptions = {
+  // the default is batch for the long running actions (clips, remux, volume data) and normal
+  // for the rest
+  priority?: Priority;
+  // aborting it stops the action, which then rejects with Cancelled; the reader can still be used
+  signal?: AbortSignal;
+  // in seconds, including any time spent waiting for the reader; the action rejects with
+  // DeadlineExceeded once it is up
+  timeout?: number;
+};
+type InitOptions = {
+  // with a local file path, read it natively (memory mapped) rather than through libav's
+  // file protocol
+  use_local_file_io?: boolean;
+  // or read it with several reads queued ahead (io_uring where available), for seek heavy work
+  use_async_file_io?: boolean;
+  // from getProbeSnapshot() after an earlier init of the same input (possibly in another
+  // process); the streams are taken from it instead of probing the input, unless the input
+  // doesn't match it any more
+  probe_snapshot?: Buffer;
+  // tried in turn until the video and audio codec parameters are complete; the default starts
+  // small, which is plenty for inputs with headers, and goes up to 5MB and 60 seconds
+  probe_tiers?: ProbeTier[];
+};
+type OutputOptions = {
+  // fragmented mp4 instead of faststart, so fragments are usable as they are written
+  is_fragmented?: boolean;
+  // minimum fragment length in seconds; fragments still start on key frames
+  fragment_duration?: number;
+  // for a .m3u8 destination, an hls playlist is written with its segments next to it
+  hls_segment_duration?: number;
+  is_hls_mpegts?: boolean;
+};
+
+type ReaderPoolOptions = {
+  // seconds an unused reader is kept; 0 (the default) turns the pool off
+  ttl?: number;
+  // bytes all the kept readers can hold, by their own estimate; the least recently used go first
+  max_memory?: number;
+};
+type ReaderPoolStats = {
+  count_readers: number;
+  memory: number;
+  count_hits: number;
+  count_misses: number;
+};
 
-// we wrap the calls into video read here with our own javascript mutex
-// which is implemented as a "fair" mutex, meaning all the calls get to the
-// native code in the same order as they get here
+// Readers that were destroyed after a successful init are kept for a while, already initialised
+// with their decoders open, and handed to the next init of the same input. That skips probing
+// the input again, which is most of the time a single thumbnail takes. A ResourceIo input only
+// matches the same ResourceIo object, since the reader keeps using the one it was opened with.
+type PooledReader = {
+  key: string;
+  videoReader: any;
+  memory: number;
+  timer: ReturnType<typeof setTimeout>;
+};
+
+const readerPoolOptions = {
+  ttl: 0,
+  max_memory: 256 * 1024 * 1024,
+};
+// least recently used first
+let pooledReaders: PooledReader[] = [];
+let pooledReadersMemory = 0;
+let countPoolHits = 0;
+let countPoolMisses = 0;
+
+const resourceIoIds = new WeakMap<object, number>();
+let nextResourceIoId = 1;
+
+const getReaderPoolKey = (input: string | typeof ResourceIo, initOptions: InitOptions) => {
+  if (typeof input === 'string') {
+    return `${input}|${initOptions.use_local_file_io ? 'local' : initOptions.use_async_file_io ? 'async' : 'libav'}`;
+  }
+  let id = resourceIoIds.get(input);
+  if (!id) {
+    id = nextResourceIoId++;
+    resourceIoIds.set(input, id);
+  }
+  return `${(input as any).getPrimaryUri()}|resource_io ${id}`;
+};
+
+const removePooledReader = (pooledReader: PooledReader) => {
+  pooledReaders = pooledReaders.filter((other) => other !== pooledReader);
+  pooledReadersMemory -= pooledReader.memory;
+  clearTimeout(pooledReader.timer);
+};
+
+const takePooledReader = (key: string) => {
+  // the most recently used one, its caches are the warmest
+  for (let i = pooledReaders.length - 1; i >= 0; i--) {
+    const pooledReader = pooledReaders[i];
+    if (pooledReader.key === key) {
+      removePooledReader(pooledReader);
+      countPoolHits++;
+      return pooledReader.videoReader;
+    }
+  }
+  countPoolMisses++;
+  return null;
+};
+
+// takes over videoReader, which must be initialised and idle
+const poolReader = (key: string, videoReader: any) => {
+  const memory = videoReader.getMemoryUsage();
+  if (readerPoolOptions.ttl <= 0 || memory > readerPoolOptions.max_memory) {
+    videoReader.destroy();
+    return;
+  }
+  const pooledReader: PooledReader = {
+    key,
+    videoReader,
+    memory,
+    timer: setTimeout(() => {
+      removePooledReader(pooledReader);
+      videoReader.destroy();
+    }, readerPoolOptions.ttl * 1000),
+  };
+  // don't keep the process alive for it
+  pooledReader.timer.unref();
+  pooledReaders.push(pooledReader);
+  pooledReadersMemory += memory;
+
+  while (pooledReadersMemory > readerPoolOptions.max_memory) {
+    const oldest = pooledReaders[0];
+    removePooledReader(oldest);
+    oldest.videoReader.destroy();
+  }
+};
+
+const setReaderPoolOptions = (options: ReaderPoolOptions) => {
+  Object.assign(readerPoolOptions, options);
+  // apply the new limits to what is already there
+  for (const pooledReader of [...pooledReaders]) {
+    removePooledReader(pooledReader);
+    poolReader(pooledReader.key, pooledReader.videoReader);
+  }
+};
+
+const getReaderPoolStats = (): ReaderPoolStats => {
+  return {
+    count_readers: pooledReaders.length,
+    memory: pooledReadersMemory,
+    count_hits: countPoolHits,
+    count_misses: countPoolMisses,
+  };
+};
+
+const clearReaderPool = () => {
+  for (const pooledReader of [...pooledReaders]) {
+    removePooledReader(pooledReader);
+    pooledReader.videoReader.destroy();
+  }
+};
+
+// don't hang on to (or print) the whole output file in the latest action
+const summarizeVideoData = (videoData: VideoData) => {
+  const summary: any = { ...videoData };
+  if (summary.output_buffer) {
+    summary.output_buffer = `Buffer length ${summary.output_buffer.length}`;
+  }
+  return summary;
+};
+
+const PRIORITY_LEVELS: Record<Priority, number> = {
+  interactive: 0,
+  normal: 1,
+  batch: 2,
+};
+// a waiting action counts as one priority higher for every this much longer it has waited than
+// another, so lower priority actions are only held back so long
+const AGING_PERIOD_MS = 5000;
+
+type Waiter = {
+  rank: number;
+  resolve: () => void;
+};
+
+// a mutex that lets waiters in by priority, and in the order they arrived within one
+class PriorityLock {
+  private _isLocked = false;
+  private _waiters: Waiter[] = [];
+
+  // rejects with the signal's reason if it is aborted first
+  acquire(priority: Priority, signal?: AbortSignal): Promise<void> {
+    if (signal?.aborted) {
+      return Promise.reject(signal.reason);
+    }
+    if (!this._isLocked) {
+      this._isLocked = true;
+      return Promise.resolve();
+    }
+    const rank = Date.now() + PRIORITY_LEVELS[priority] * AGING_PERIOD_MS;
+    return new Promise((resolve, reject) => {
+      const onAbort = () => {
+        this._waiters = this._waiters.filter((other) => other !== waiter);
+        reject(signal?.reason);
+      };
+      const waiter = {
+        rank,
+        resolve: () => {
+          signal?.removeEventListener('abort', onAbort);
+          resolve();
+        },
+      };
+      // after any that are equal, to keep arrival order
+      let index = this._waiters.findIndex((other) => other.rank > rank);
+      if (index === -1) {
+        index = this._waiters.length;
+      }
+      this._waiters.splice(index, 0, waiter);
+      signal?.addEventListener('abort', onAbort);
+    });
+  }
+
+  release() {
+    const waiter = this._waiters.shift();
+    if (waiter) {
+      // still locked, now by the waiter
+      waiter.resolve();
+    } else {
+      this._isLocked = false;
+    }
+  }
+
+  getBlockedCount() {
+    return this._waiters.length;
+  }
+}
+
+// we wrap the calls into video read here with our own javascript mutex,
+// which lets them get to the native code by priority and otherwise in the
+// same order as they get here
 //
 // Important note: the wrapped_video_reader and c++ VideoReader implementetation
 // only allow one high-level call at a time; that's why some locking/queuing
 // is required.
 class LockedVideoReader {
   private _videoReader;
-  private _lock = new Semaphore(1);
+  private _lock = new PriorityLock();
+  // undoes what _startAction set up for the action's signal and timeout
+  private _cleanupAction: (() => void) | null = null;
+  // set once init succeeds, so destroy can pool the reader
+  private _readerPoolKey: string | null = null;
   private _latestAction: Action = {
     input: null,
     output: null,
@@ -111,61 +380,120 @@ class LockedVideoReader {
     this._videoReader = new avalancheNative.VideoReader();
   }
 
-  async _startAction() {
-    const token = (await this._lock.acquire()) as Token;
+  async _startAction(actionOptions: ActionOptions = {}, defaultPriority: Priority = 'normal') {
+    const priority = actionOptions.priority ?? defaultPriority;
+    const { signal, timeout } = actionOptions;
+    const startTime = Date.now();
+
+    // stops the wait for the reader, either way
+    const waitController = new AbortController();
+    const onWaitAbort = () => waitController.abort(new Error('Cancelled'));
+    signal?.addEventListener('abort', onWaitAbort);
+    if (signal?.aborted) {
+      onWaitAbort();
+    }
+    let timer: ReturnType<typeof setTimeout> | null = null;
+    if (timeout) {
+      timer = setTimeout(() => waitController.abort(new Error('DeadlineExceeded')), timeout * 1000);
+    }
+    try {
+      await this._lock.acquire(priority, waitController.signal);
+    } finally {
+      signal?.removeEventListener('abort', onWaitAbort);
+      if (timer) {
+        clearTimeout(timer);
+      }
+    }
+
+    // from here on the native side stops the action, which leaves the reader usable
+    let remainingTime = 0;
+    if (timeout) {
+      remainingTime = Math.max(timeout - (Date.now() - startTime) / 1000, 0.001);
+    }
+    this._videoReader.setActionOptions(priority, remainingTime);
+    const onAbort = () => this._videoReader.cancelAction();
+    signal?.addEventListener('abort', onAbort);
+    this._cleanupAction = () => signal?.removeEventListener('abort', onAbort);
+
     activeVideoReaders.add(this);
-    return token;
   }
 
-  _endAction(token: Token) {
+  _endAction() {
+    if (this._cleanupAction) {
+      this._cleanupAction();
+      this._cleanupAction = null;
+    }
     activeVideoReaders.delete(this);
-    this._lock.release(token);
+    this._lock.release();
   }
 
-  async init(input: string | typeof ResourceIo) {
-    const token = await this._startAction();
+  async init(input: string | typeof ResourceIo, initOptions: InitOptions = {}, actionOptions: ActionOptions = {}) {
+    await this._startAction(actionOptions);
     this._latestAction = {
-      input: ['init', input],
+      input: ['init', input, initOptions],
       output: '<running>',
     };
     let retval;
     try {
-      retval = await this._videoReader.init(input);
+      const key = getReaderPoolKey(input, initOptions);
+      const pooledVideoReader = readerPoolOptions.ttl > 0 ? takePooledReader(key) : null;
+      if (pooledVideoReader) {
+        // the one it has now is never initialized, so it goes in favour of the pooled one
+        await this._videoReader.destroy();
+        this._videoReader = pooledVideoReader;
+        retval = true;
+      } else {
+        retval = await this._videoReader.init(input, initOptions);
+      }
+      if (retval) {
+        this._readerPoolKey = key;
+      }
       this._latestAction.output = retval;
     } catch (err) {
       this._latestAction.output = 'exception';
       throw err;
     } finally {
-      this._endAction(token);
+      this._endAction();
     }
     return retval;
   }
 
   drain() {
+    // it's no good to anyone after this
+    this._readerPoolKey = null;
     this._videoReader.drain();
   }
 
   async destroy() {
-    const token = await this._startAction();
+    await this._startAction();
+    // one that failed its last action might have something wrong with its input
+    const isReusable = this._readerPoolKey !== null && this._latestAction.output !== 'exception';
     this._latestAction = {
       input: ['destroy'],
       output: '<running>',
     };
     let retval;
     try {
-      retval = await this._videoReader.destroy();
+      if (isReusable) {
+        poolReader(this._readerPoolKey as string, this._videoReader);
+        this._videoReader = new avalancheNative.VideoReader();
+        retval = null;
+      } else {
+        retval = await this._videoReader.destroy();
+      }
+      this._readerPoolKey = null;
       this._latestAction.output = retval;
     } catch (err) {
       this._latestAction.output = 'exception';
       throw err;
     } finally {
-      this._endAction(token);
+      this._endAction();
     }
     return retval;
   }
 
   async verifyHasVideoStream() {
-    const token = await this._startAction();
+    await this._startAction();
     this._latestAction = {
       input: ['init'],
       output: '<running>',
@@ -178,13 +506,13 @@ class LockedVideoReader {
       this._latestAction.output = 'exception';
       throw err;
     } finally {
-      this._endAction(token);
+      this._endAction();
     }
     return retval;
   }
 
   async verifyHasAudioStream() {
-    const token = await this._startAction();
+    await this._startAction();
     this._latestAction = {
       input: ['init'],
       output: '<running>',
@@ -197,13 +525,13 @@ class LockedVideoReader {
       this._latestAction.output = 'exception';
       throw err;
     } finally {
-      this._endAction(token);
+      this._endAction();
     }
     return retval;
   }
 
-  async getMetadata(): Promise<Metadata> {
-    const token = await this._startAction();
+  async getMetadata(actionOptions: ActionOptions = {}): Promise<Metadata> {
+    await this._startAction(actionOptions);
     this._latestAction = {
       input: ['get_metadata'],
       output: '<running>',
@@ -216,13 +544,13 @@ class LockedVideoReader {
       this._latestAction.output = 'exception';
       throw err;
     } finally {
-      this._endAction(token);
+      this._endAction();
     }
     return retval;
   }
 
-  async getImageAtTimestamp(timestamp: number): Promise<ImageData> {
-    const token = await this._startAction();
+  async getImageAtTimestamp(timestamp: number, actionOptions: ActionOptions = {}): Promise<ImageData> {
+    await this._startAction(actionOptions);
     this._latestAction = {
       input: ['get_image_at_timestamp', timestamp],
       output: '<running>',
@@ -238,7 +566,7 @@ class LockedVideoReader {
       this._latestAction.output = 'exception';
       throw err;
     } finally {
-      this._endAction(token);
+      this._endAction();
     }
     return retval;
   }
@@ -248,21 +576,23 @@ class LockedVideoReader {
     startTime: number,
     endTime: number,
     progress: ProgressFn,
+    outputOptions: OutputOptions = {},
+    actionOptions: ActionOptions = {},
   ): Promise<VideoData> {
-    const token = await this._startAction();
+    await this._startAction(actionOptions, 'batch');
     this._latestAction = {
-      input: ['extract_clip_reencode', destUri, startTime, endTime],
+      input: ['extract_clip_reencode', destUri, startTime, endTime, outputOptions],
       output: '<running>',
     };
     let retval;
     try {
-      retval = await this._videoReader.extractClipReencode(destUri, startTime, endTime, progress);
-      this._latestAction.output = retval;
+      retval = await this._videoReader.extractClipReencode(destUri, startTime, endTime, progress, outputOptions);
+      this._latestAction.output = summarizeVideoData(retval);
     } catch (err) {
       this._latestAction.output = 'exception';
       throw err;
     } finally {
-      this._endAction(token);
+      this._endAction();
     }
     return retval;
   }
@@ -272,46 +602,83 @@ class LockedVideoReader {
     startTime: number,
     endTime: number,
     progress: ProgressFn,
+    outputOptions: OutputOptions = {},
+    actionOptions: ActionOptions = {},
   ): Promise<VideoData> {
-    const token = await this._startAction();
+    await this._startAction(actionOptions, 'batch');
     this._latestAction = {
-      input: ['extract_clip_remux', destUri, startTime, endTime],
+      input: ['extract_clip_remux', destUri, startTime, endTime, outputOptions],
       output: '<running>',
     };
     let retval;
     try {
-      retval = await this._videoReader.extractClipRemux(destUri, startTime, endTime, progress);
-      this._latestAction.output = retval;
+      retval = await this._videoReader.extractClipRemux(destUri, startTime, endTime, progress, outputOptions);
+      this._latestAction.output = summarizeVideoData(retval);
     } catch (err) {
       this._latestAction.output = 'exception';
       throw err;
     } finally {
-      this._endAction(token);
+      this._endAction();
     }
     return retval;
   }
 
-  async remux(destUri: string, progress: ProgressFn): Promise<VideoData> {
-    const token = await this._startAction();
+  // extracts all the clips in one forward pass over the input; results are in the same order
+  async extractClipsRemux(
+    clipRanges: ClipRange[],
+    progress: ProgressFn,
+    outputOptions: OutputOptions = {},
+    actionOptions: ActionOptions = {},
+  ): Promise<VideoData[]> {
+    await this._startAction(actionOptions, 'batch');
     this._latestAction = {
-      input: ['remux', destUri],
+      input: ['extract_clips_remux', clipRanges, outputOptions],
       output: '<running>',
     };
     let retval;
     try {
-      retval = await this._videoReader.remux(destUri, progress);
-      this._latestAction.output = retval;
+      retval = await this._videoReader.extractClipsRemux(clipRanges, progress, outputOptions);
+      this._latestAction.output = retval.map(summarizeVideoData);
+    } catch (err) {
+      this._latestAction.output = 'exception';
+      throw err;
+    } finally {
+      this._endAction();
+    }
+    return retval;
+  }
+
+  async remux(
+    destUri: string,
+    progress: ProgressFn,
+    outputOptions: OutputOptions = {},
+    actionOptions: ActionOptions = {},
+  ): Promise<VideoData> {
+    await this._startAction(actionOptions, 'batch');
+    this._latestAction = {
+      input: ['remux', destUri, outputOptions],
+      output: '<running>',
+    };
+    let retval;
+    try {
+      retval = await this._videoReader.remux(destUri, progress, outputOptions);
+      this._latestAction.output = summarizeVideoData(retval);
     } catch (err) {
       this._latestAction.output = 'exception';
       throw err;
     } finally {
-      this._endAction(token);
+      this._endAction();
     }
     return retval;
   }
 
-  async getClipVolumeData(startTime: number, endTime: number, progress: ProgressFn): Promise<VolumeData> {
-    const token = await this._startAction();
+  async getClipVolumeData(
+    startTime: number,
+    endTime: number,
+    progress: ProgressFn,
+    actionOptions: ActionOptions = {},
+  ): Promise<VolumeData> {
+    await this._startAction(actionOptions, 'batch');
     this._latestAction = {
       input: ['get_clip_volume_data', startTime, endTime],
       output: '<running>',
@@ -324,13 +691,13 @@ class LockedVideoReader {
       this._latestAction.output = 'exception';
       throw err;
     } finally {
-      this._endAction(token);
+      this._endAction();
     }
     return retval;
   }
 
-  async getVolumeData(progress: ProgressFn): Promise<VolumeData> {
-    const token = await this._startAction();
+  async getVolumeData(progress: ProgressFn, actionOptions: ActionOptions = {}): Promise<VolumeData> {
+    await this._startAction(actionOptions, 'batch');
     this._latestAction = {
       input: ['get_volume_data'],
       output: '<running>',
@@ -343,11 +710,24 @@ class LockedVideoReader {
       this._latestAction.output = 'exception';
       throw err;
     } finally {
-      this._endAction(token);
+      this._endAction();
     }
     return retval;
   }
 
+  // doesn't wait for the running action, so it can be used to watch one
+  getIoStats(): IoStats | null {
+    return this._videoReader.getIoStats();
+  }
+
+  getProbeSnapshot(): Buffer | null {
+    return this._videoReader.getProbeSnapshot();
+  }
+
+  getProbeStats(): ProbeStats {
+    return this._videoReader.getProbeStats();
+  }
+
   getLatestAction() {
     return this._latestAction;
   }
@@ -361,6 +741,232 @@ const createVideoReader = () => {
   return new LockedVideoReader();
 };
 
+type AssetSessionOptions = {
+  // readers operations can run on at once; more wait for one to be free
+  max_readers?: number;
+};
+type AssetSessionStats = {
+  count_readers: number;
+  count_idle: number;
+  count_waiting: number;
+};
+
+// Runs operations on one input at the same time, each on a reader of its own (with its own
+// demuxer, decoders and packet queue) rather than one after another on a single reader. The
+// input is only probed by the first reader; the rest open it with that one's probe snapshot.
+// They all read it through the same caches: a ResourceIo input is shared by the readers, along
+// with its data sources, and its blocks are in the native shared block cache. Readers are kept
+// for later operations once they are done.
+class AssetSession {
+  _input: string | typeof ResourceIo;
+  _initOptions: InitOptions;
+  _maxReaders: number;
+  _probeSnapshot: Buffer | null = null;
+  // busy ones included
+  _countReaders = 0;
+  _idleReaders: LockedVideoReader[] = [];
+  _waiters: (() => void)[] = [];
+  _isDestroyed = false;
+
+  constructor(input: string | typeof ResourceIo, initOptions: InitOptions = {}, options: AssetSessionOptions = {}) {
+    this._input = input;
+    this._initOptions = initOptions;
+    this._maxReaders = Math.max(options.max_readers ?? 4, 1);
+  }
+
+  // probes the input; false if it can't be opened
+  async init(actionOptions: ActionOptions = {}) {
+    this._countReaders++;
+    let videoReader;
+    try {
+      videoReader = await this._createReader(actionOptions);
+    } catch (err) {
+      this._countReaders--;
+      throw err;
+    }
+    if (!videoReader) {
+      this._countReaders--;
+      return false;
+    }
+    this._probeSnapshot = videoReader.getProbeSnapshot();
+    this._releaseReader(videoReader);
+    return true;
+  }
+
+  // readers that are running an operation are destroyed once it is done
+  async destroy() {
+    this._isDestroyed = true;
+    const idleReaders = this._idleReaders;
+    this._idleReaders = [];
+    this._countReaders -= idleReaders.length;
+    for (const waiter of this._waiters) {
+      waiter();
+    }
+    this._waiters = [];
+    await Promise.all(idleReaders.map((videoReader) => videoReader.destroy()));
+  }
+
+  getStats(): AssetSessionStats {
+    return {
+      count_readers: this._countReaders,
+      count_idle: this._idleReaders.length,
+      count_waiting: this._waiters.length,
+    };
+  }
+
+  async _createReader(actionOptions: ActionOptions) {
+    const videoReader = createVideoReader();
+    const initOptions = { ...this._initOptions };
+    if (this._probeSnapshot) {
+      initOptions.probe_snapshot = this._probeSnapshot;
+    }
+    const success = await videoReader.init(this._input, initOptions, actionOptions);
+    if (!success) {
+      await videoReader.destroy();
+      return null;
+    }
+    return videoReader;
+  }
+
+  async _acquireReader(actionOptions: ActionOptions) {
+    while (true) {
+      if (this._isDestroyed) {
+        throw new Error('Destroyed');
+      }
+      const idleReader = this._idleReaders.pop();
+      if (idleReader) {
+        return idleReader;
+      }
+      if (this._countReaders < this._maxReaders) {
+        this._countReaders++;
+        let videoReader;
+        try {
+          videoReader = await this._createReader(actionOptions);
+        } catch (err) {
+          this._countReaders--;
+          this._wakeWaiter();
+          throw err;
+        }
+        if (!videoReader) {
+          this._countReaders--;
+          this._wakeWaiter();
+          throw new Error('InitFailure');
+        }
+        return videoReader;
+      }
+
+      const { signal } = actionOptions;
+      await new Promise<void>((resolve, reject) => {
+        const onAbort = () => {
+          this._waiters = this._waiters.filter((other) => other !== waiter);
+          reject(new Error('Cancelled'));
+        };
+        const waiter = () => {
+          signal?.removeEventListener('abort', onAbort);
+          resolve();
+        };
+        if (signal?.aborted) {
+          reject(new Error('Cancelled'));
+          return;
+        }
+        signal?.addEventListener('abort', onAbort, { once: true });
+        this._waiters.push(waiter);
+      });
+    }
+  }
+
+  _releaseReader(videoReader: LockedVideoReader) {
+    if (this._isDestroyed) {
+      this._countReaders--;
+      videoReader.destroy();
+      return;
+    }
+    this._idleReaders.push(videoReader);
+    this._wakeWaiter();
+  }
+
+  _wakeWaiter() {
+    const waiter = this._waiters.shift();
+    if (waiter) {
+      waiter();
+    }
+  }
+
+  async _run<T>(actionOptions: ActionOptions, action: (videoReader: LockedVideoReader) => Promise<T>): Promise<T> {
+    const videoReader = await this._acquireReader(actionOptions);
+    try {
+      return await action(videoReader);
+    } finally {
+      this._releaseReader(videoReader);
+    }
+  }
+
+  getMetadata(actionOptions: ActionOptions = {}): Promise<Metadata> {
+    return this._run(actionOptions, (videoReader) => videoReader.getMetadata(actionOptions));
+  }
+
+  getImageAtTimestamp(timestamp: number, actionOptions: ActionOptions = {}): Promise<ImageData> {
+    return this._run(actionOptions, (videoReader) => videoReader.getImageAtTimestamp(timestamp, actionOptions));
+  }
+
+  extractClipReencode(
+    destUri: string,
+    startTime: number,
+    endTime: number,
+    progress: ProgressFn,
+    outputOptions: OutputOptions = {},
+    actionOptions: ActionOptions = {},
+  ): Promise<VideoData> {
+    return this._run(actionOptions, (videoReader) => videoReader.extractClipReencode(destUri, startTime, endTime, progress, outputOptions, actionOptions));
+  }
+
+  extractClipRemux(
+    destUri: string,
+    startTime: number,
+    endTime: number,
+    progress: ProgressFn,
+    outputOptions: OutputOptions = {},
+    actionOptions: ActionOptions = {},
+  ): Promise<VideoData> {
+    return this._run(actionOptions, (videoReader) => videoReader.extractClipRemux(destUri, startTime, endTime, progress, outputOptions, actionOptions));
+  }
+
+  extractClipsRemux(
+    clipRanges: ClipRange[],
+    progress: ProgressFn,
+    outputOptions: OutputOptions = {},
+    actionOptions: ActionOptions = {},
+  ): Promise<VideoData[]> {
+    return this._run(actionOptions, (videoReader) => videoReader.extractClipsRemux(clipRanges, progress, outputOptions, actionOptions));
+  }
+
+  remux(
+    destUri: string,
+    progress: ProgressFn,
+    outputOptions: OutputOptions = {},
+    actionOptions: ActionOptions = {},
+  ): Promise<VideoData> {
+    return this._run(actionOptions, (videoReader) => videoReader.remux(destUri, progress, outputOptions, actionOptions));
+  }
+
+  getClipVolumeData(
+    startTime: number,
+    endTime: number,
+    progress: ProgressFn,
+    actionOptions: ActionOptions = {},
+  ): Promise<VolumeData> {
+    return this._run(actionOptions, (videoReader) => videoReader.getClipVolumeData(startTime, endTime, progress, actionOptions));
+  }
+
+  getVolumeData(progress: ProgressFn, actionOptions: ActionOptions = {}): Promise<VolumeData> {
+    return this._run(actionOptions, (videoReader) => videoReader.getVolumeData(progress, actionOptions));
+  }
+}
+
+const createAssetSession = (input: string | typeof ResourceIo, initOptions: InitOptions = {}, options: AssetSessionOptions = {}) => {
+  return new AssetSession(input, initOptions, options);
+};
+
 const drainActiveVideoReaders = () => {
   for (const videoReader of activeVideoReaders) {
     // log this because it's not very common
@@ -384,4 +990,8 @@ export default {
   defaultLogAvalanche,
   setLogFunc,
   createVideoReader,
+  createAssetSession,
+  setReaderPoolOptions,
+  getReaderPoolStats,
+  clearReaderPool,
 };
@@ -1,18 +1,38 @@
 {
+  # build with io_uring reads for local files (needs liburing) with
+  # node-gyp rebuild -- -Duse_io_uring=1, otherwise they're preads on a thread pool
+  "variables": {
+    "use_io_uring%": "0",
+  },
   "targets": [
     {
       "target_name": "avalanche",
       "sources": [
         "nodejs_wrapper/avalanche_wrapper.cc",
         "nodejs_wrapper/buffer_image.cc",
+        "nodejs_wrapper/disk_block_cache.cc",
+        "nodejs_wrapper/image_buffer_pool.cc",
+        "nodejs_wrapper/log_queue.cc",
+        "nodejs_wrapper/pinned_js_buffer.cc",
+        "nodejs_wrapper/promise_worker.cc",
         "nodejs_wrapper/resource_io_group.cc",
         "nodejs_wrapper/resource_io.cc",
+        "nodejs_wrapper/resource_output_io.cc",
+        "nodejs_wrapper/shared_block_cache.cc",
         "nodejs_wrapper/wrapped_stress_test_resource_io.cc",
+        "nodejs_wrapper/worker_pool.cc",
         "nodejs_wrapper/wrapped_video_reader.cc",
         "utils.cc",
+        "async_file_io.cc",
+        "async_file_io_group.cc",
         "image_interface.cc",
+        "probe_snapshot.cc",
         "video_reader.cc",
         "custom_io_group.cc",
+        "custom_output_io.cc",
+        "local_file_io.cc",
+        "local_file_io_group.cc",
+        "private/async_read_engine.cc",
         "private/custom_io_setup.cc",
         "private/stream_map.cc",
         "private/utils.cc",
@@ -39,6 +59,12 @@
         "-Wno-unknown-pragmas",
         "-DNAPI_DISABLE_CPP_EXCEPTIONS",
       ],
+      "conditions": [
+        ["use_io_uring==1", {
+          "defines": [ "AVALANCHE_USE_IO_URING" ],
+          "libraries": [ "-luring" ],
+        }],
+      ],
     }
   ]
 }
@@ -3,8 +3,18 @@
  */
 
 #include "custom_io_group.h"
+#include "custom_output_io.h"
 
 using namespace Avalanche;
 
 CustomIoGroup::~CustomIoGroup() {
 }
+
+bool CustomIoGroup::openOutput(const std::string &, CustomOutputIo *&output_io) {
+    output_io = nullptr;
+    return true;
+}
+
+void CustomIoGroup::closeOutput(CustomOutputIo *output_io) {
+    delete output_io;
+}
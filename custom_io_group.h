@@ -10,8 +10,12 @@ extern "C" {
 #include <libavformat/avio.h>
 }
 
+#include "operation_control.h"
+
 namespace Avalanche {
 
+class CustomOutputIo;
+
 class CustomIoGroup {
 public:
     virtual ~CustomIoGroup();
@@ -19,7 +23,25 @@ public:
     virtual AVIOContext * open(const std::string &url) = 0;
     virtual void close(void *opaque) = 0;
 
+    // output side. Returns false on error; otherwise output_io is left null if this group
+    // doesn't handle output for url, in which case it is written with avio_open as usual
+    virtual bool openOutput(const std::string &url, CustomOutputIo *&output_io);
+    // output_io has already been finished (or abandoned on error) when this is called
+    virtual void closeOutput(CustomOutputIo *output_io);
+
     virtual int interruptCallback() = 0;
+
+    // the reader's, so libav's interrupt callback stops when its action is cancelled
+    void setOperationControl(OperationControl *operation_control) {
+        m_operation_control = operation_control;
+    }
+
+    bool isOperationStopped() {
+        return m_operation_control && m_operation_control->isStopped();
+    }
+
+private:
+    OperationControl *m_operation_control = nullptr;
 };
 
 }
@@ -0,0 +1,224 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "private/utils.h"
+
+#include "custom_output_io.h"
+#include "utils.h"
+
+using namespace Avalanche;
+
+// libav's own buffer in front of ours, just so it doesn't call us for every few bytes
+constexpr int LEN_AVIO_BUFFER = 64 * 1024;
+
+CustomOutputIo::CustomOutputIo(const std::string &uri, bool is_in_memory, size_t chunk_size) :
+    m_uri(uri),
+    m_is_in_memory(is_in_memory),
+    m_chunk_size(chunk_size),
+    m_chunk(std::make_unique<OutputChunk>()) {
+    if (!m_is_in_memory) {
+        m_chunk->reserve(m_chunk_size);
+    }
+    uint8_t * m_buffer = (unsigned char *)av_malloc(LEN_AVIO_BUFFER);
+    m_avio_context = avio_alloc_context(m_buffer, LEN_AVIO_BUFFER, 1, this, NULL, &CustomOutputIo::libavWrite, &CustomOutputIo::libavSeek);
+}
+
+CustomOutputIo::~CustomOutputIo() {
+    // we are responsible for this buffer too, though libav internals are allowed
+    // to av_realloc it or even free it
+    av_freep(&m_avio_context->buffer);
+    av_freep(&m_avio_context);
+}
+
+bool CustomOutputIo::finish() {
+    avio_flush(m_avio_context);
+
+    if (!m_is_in_memory) {
+        if (!flushChunk()) {
+            return false;
+        }
+    }
+
+    if (m_avio_context->error < 0) {
+        m_is_failed = true;
+    }
+
+    m_is_finished = !m_is_failed;
+    return m_is_finished;
+}
+
+std::shared_ptr<OutputChunk> CustomOutputIo::takeMemoryData() {
+    if (!m_is_in_memory) {
+        return nullptr;
+    }
+    auto data = std::shared_ptr<OutputChunk>(std::move(m_chunk));
+    m_chunk = std::make_unique<OutputChunk>();
+    return data;
+}
+
+int CustomOutputIo::write(uint8_t *buf, int buf_size) {
+    //log(LOG_INFO, "WRITE %li %i\n", m_pos, buf_size);
+
+    if (m_is_failed) {
+        return AVERROR(EIO);
+    }
+
+    if (!m_is_in_memory) {
+        int64_t chunk_end = m_chunk_offset + (int64_t)m_chunk->size();
+        if (m_pos < m_chunk_offset || m_pos > chunk_end) {
+            // not continuing or overwriting the buffered chunk, so it's done
+            if (!flushChunk()) {
+                return AVERROR(EIO);
+            }
+        }
+    }
+
+    size_t start = (size_t)(m_pos - m_chunk_offset);
+    size_t end = start + buf_size;
+    if (end > m_chunk->size()) {
+        m_chunk->resize(end);
+    }
+    memcpy(m_chunk->data() + start, buf, buf_size);
+
+    m_pos += buf_size;
+    m_size = std::max(m_size, m_pos);
+
+    if (!m_is_in_memory && m_chunk->size() >= m_chunk_size) {
+        if (!flushChunk()) {
+            return AVERROR(EIO);
+        }
+    }
+
+    return buf_size;
+}
+
+int64_t CustomOutputIo::seek(int64_t offset, int whence) {
+    //log(LOG_INFO, "OUTPUT SEEK %li %i\n", offset, whence);
+
+    int64_t new_pos;
+    switch (whence) {
+    case SEEK_SET:
+        new_pos = offset;
+        break;
+
+    case SEEK_CUR:
+        new_pos = m_pos + offset;
+        break;
+
+    case SEEK_END:
+        new_pos = m_size + offset;
+        break;
+
+    case AVSEEK_SIZE:
+        return m_size;
+
+    default:
+        log(LOG_ERROR, "Unknown seek whence %i\n", whence);
+        return -1;
+    }
+
+    if (new_pos < 0) {
+        return AVERROR(EINVAL);
+    }
+    m_pos = new_pos;
+    return m_pos;
+}
+
+// hands off the buffered chunk and starts a new one at the current write position
+bool CustomOutputIo::flushChunk() {
+    if (m_is_failed) {
+        return false;
+    }
+
+    if (!m_chunk->empty()) {
+        if (!writeChunk(m_chunk_offset, std::move(m_chunk))) {
+            log(LOG_ERROR, "Error writing output chunk at %li of %s\n", m_chunk_offset, m_uri.c_str());
+            m_is_failed = true;
+            m_chunk = std::make_unique<OutputChunk>();
+            return false;
+        }
+        m_chunk = std::make_unique<OutputChunk>();
+    }
+
+    m_chunk_offset = m_pos;
+    if (m_pos == m_size) {
+        // appending, so this will most likely fill up
+        m_chunk->reserve(m_chunk_size);
+    }
+    return true;
+}
+
+struct ReadBack {
+    // reads go straight to the output's memory, so they see writes made after opening
+    OutputChunk *data;
+    int64_t pos;
+};
+
+static int libavReadBackRead(void *opaque, uint8_t *buf, int buf_size) {
+    auto read_back = static_cast<ReadBack *>(opaque);
+    int64_t size = (int64_t)read_back->data->size();
+    if (read_back->pos >= size) {
+        return AVERROR_EOF;
+    }
+    int len = (int)std::min((int64_t)buf_size, size - read_back->pos);
+    memcpy(buf, read_back->data->data() + read_back->pos, len);
+    read_back->pos += len;
+    return len;
+}
+
+static int64_t libavReadBackSeek(void *opaque, int64_t offset, int whence) {
+    auto read_back = static_cast<ReadBack *>(opaque);
+    int64_t size = (int64_t)read_back->data->size();
+    switch (whence) {
+    case SEEK_SET:
+        read_back->pos = offset;
+        break;
+    case SEEK_CUR:
+        read_back->pos += offset;
+        break;
+    case SEEK_END:
+        read_back->pos = size + offset;
+        break;
+    case AVSEEK_SIZE:
+        return size;
+    default:
+        return -1;
+    }
+    read_back->pos = std::max((int64_t)0, read_back->pos);
+    return read_back->pos;
+}
+
+AVIOContext * CustomOutputIo::openReadBack() {
+    if (!m_is_in_memory) {
+        return NULL;
+    }
+
+    // make sure everything libav has written is actually in memory
+    avio_flush(m_avio_context);
+
+    auto read_back = new ReadBack { m_chunk.get(), 0 };
+    uint8_t * buffer = (unsigned char *)av_malloc(LEN_AVIO_BUFFER);
+    return avio_alloc_context(buffer, LEN_AVIO_BUFFER, 0, read_back, &libavReadBackRead, NULL, &libavReadBackSeek);
+}
+
+void CustomOutputIo::closeReadBack(AVIOContext *avio_context) {
+    delete static_cast<ReadBack *>(avio_context->opaque);
+    av_freep(&avio_context->buffer);
+    av_freep(&avio_context);
+}
+
+bool CustomOutputIo::isReadBack(AVIOContext *avio_context) {
+    return avio_context->read_packet == &libavReadBackRead;
+}
+
+CustomOutputIo * CustomOutputIo::fromAvioContext(AVIOContext *avio_context) {
+    if (avio_context->write_packet != &CustomOutputIo::libavWrite) {
+        return nullptr;
+    }
+    return static_cast<CustomOutputIo *>(avio_context->opaque);
+}
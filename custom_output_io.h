@@ -0,0 +1,107 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+namespace Avalanche {
+
+typedef std::vector<uint8_t> OutputChunk;
+
+// Base for outputs handed out by CustomIoGroup::openOutput. libav writes into a large
+// write-behind buffer, and each time it fills up the buffer is handed off as one chunk through
+// writeChunk(). Seeks within the buffer just move the write position; seeking anywhere else
+// (the mp4 muxer goes back to patch sizes in the header) hands off what is buffered and starts
+// a new chunk at the new offset, so chunks are not necessarily contiguous or in order.
+//
+// In memory mode nothing is handed off; the whole file is kept and can be taken with
+// takeMemoryData() after finish(). Only memory mode can be read back, which the mp4 muxer needs
+// for faststart.
+class CustomOutputIo {
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 8 * 1024 * 1024;
+
+    CustomOutputIo(const std::string &uri, bool is_in_memory, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+    virtual ~CustomOutputIo();
+
+    AVIOContext * getAvioContext() {
+        return m_avio_context;
+    }
+
+    const std::string & getUri() {
+        return m_uri;
+    }
+
+    bool isInMemory() {
+        return m_is_in_memory;
+    }
+
+    // hands off whatever is still buffered; returns false if any write failed
+    virtual bool finish();
+
+    // true once finish() has succeeded, so the output is complete
+    bool isFinished() {
+        return m_is_finished;
+    }
+
+    // only valid in memory mode, after finish()
+    std::shared_ptr<OutputChunk> takeMemoryData();
+
+    // in memory mode, returns a new read only AVIOContext over everything written so far,
+    // free it with closeReadBack()
+    AVIOContext * openReadBack();
+    static void closeReadBack(AVIOContext *avio_context);
+    static bool isReadBack(AVIOContext *avio_context);
+
+    // returns the CustomOutputIo behind avio_context, or null if it isn't one
+    static CustomOutputIo * fromAvioContext(AVIOContext *avio_context);
+
+    static int libavWrite(void *this_ptr, uint8_t *buf, int buf_size) {
+        return static_cast<CustomOutputIo *>(this_ptr)->write(buf, buf_size);
+    }
+
+    static int64_t libavSeek(void *this_ptr, int64_t offset, int whence) {
+        return static_cast<CustomOutputIo *>(this_ptr)->seek(offset, whence);
+    }
+
+protected:
+    // called with each filled chunk, which starts at offset in the output; takes ownership of
+    // the chunk. Return false to fail the output
+    virtual bool writeChunk(int64_t offset, std::unique_ptr<OutputChunk> chunk) = 0;
+
+private:
+    std::string m_uri;
+    bool m_is_in_memory;
+    size_t m_chunk_size;
+
+    AVIOContext *m_avio_context;
+
+    // where libav will write next
+    int64_t m_pos = 0;
+    // end of the furthest write, i.e. the size of the file
+    int64_t m_size = 0;
+
+    // the write-behind buffer covers [m_chunk_offset, m_chunk_offset + m_chunk->size())
+    std::unique_ptr<OutputChunk> m_chunk;
+    int64_t m_chunk_offset = 0;
+
+    bool m_is_failed = false;
+    bool m_is_finished = false;
+
+    int write(uint8_t *buf, int buf_size);
+    int64_t seek(int64_t offset, int whence);
+
+    bool flushChunk();
+};
+
+}
@@ -0,0 +1,189 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#include "private/utils.h"
+
+#include "local_file_io.h"
+#include "utils.h"
+
+using namespace Avalanche;
+
+// the file is already in memory, libav's buffer only needs to save it calling us for every
+// few bytes
+constexpr int LEN_AVIO_BUFFER = 64 * 1024;
+
+// a seek by no more than this still counts as reading sequentially (libav often steps back or
+// skips ahead a little while probing and parsing)
+constexpr int64_t MAX_SEQUENTIAL_STEP = 1024 * 1024;
+// reading this much without a seek means reads are sequential
+constexpr int64_t MIN_SEQUENTIAL_BYTES = 2 * 1024 * 1024;
+// while sequential, ask for this much ahead of the read position to be paged in
+constexpr int64_t WILL_NEED_SIZE = 8 * 1024 * 1024;
+
+LocalFileIo::LocalFileIo(const std::string &uri) :
+    m_uri(uri) {
+    uint8_t * m_buffer = (unsigned char *)av_malloc(LEN_AVIO_BUFFER);
+    m_avio_context = avio_alloc_context(m_buffer, LEN_AVIO_BUFFER, 0, this, &LocalFileIo::libavRead, NULL, &LocalFileIo::libavSeek);
+}
+
+LocalFileIo::~LocalFileIo() {
+    if (m_map) {
+        munmap(m_map, (size_t)m_file_size);
+        m_map = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    // we are responsible for this buffer too, though libav internals are allowed
+    // to av_realloc it or even free it
+    av_freep(&m_avio_context->buffer);
+    av_freep(&m_avio_context);
+}
+
+bool LocalFileIo::open() {
+    m_fd = ::open(m_uri.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        log(LOG_ERROR, "Failed to open %s: %s\n", m_uri.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        log(LOG_ERROR, "Failed to stat %s: %s\n", m_uri.c_str(), strerror(errno));
+        return false;
+    }
+    m_file_size = (int64_t)st.st_size;
+
+    if (S_ISREG(st.st_mode) && m_file_size > 0) {
+        void *map = mmap(NULL, (size_t)m_file_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (map == MAP_FAILED) {
+            log(LOG_INFO, "Failed to mmap %s, reading it instead: %s\n", m_uri.c_str(), strerror(errno));
+        } else {
+            m_map = static_cast<uint8_t *>(map);
+        }
+    }
+
+    return true;
+}
+
+int LocalFileIo::read(uint8_t *buf, int buf_size) {
+    //log(LOG_INFO, "READ %li %i\n", m_pos, buf_size);
+
+    int len;
+    if (m_map) {
+        if (m_pos >= m_file_size) {
+            return AVERROR_EOF;
+        }
+        len = (int)std::min((int64_t)buf_size, m_file_size - m_pos);
+
+        if (m_access_pattern == ACCESS_SEQUENTIAL && m_pos + len > m_will_need_end) {
+            int64_t will_need_start = std::max(m_will_need_end, m_pos);
+            int64_t will_need_end = std::min(m_file_size, m_pos + WILL_NEED_SIZE);
+            // madvise wants a page aligned address
+            int64_t page_size = sysconf(_SC_PAGESIZE);
+            int64_t aligned_start = will_need_start / page_size * page_size;
+            madvise(m_map + aligned_start, (size_t)(will_need_end - aligned_start), MADV_WILLNEED);
+            m_will_need_end = will_need_end;
+        }
+
+        memcpy(buf, m_map + m_pos, len);
+    } else {
+        ssize_t res;
+        do {
+            res = pread(m_fd, buf, buf_size, m_pos);
+        } while (res < 0 && errno == EINTR);
+        if (res < 0) {
+            log(LOG_ERROR, "Failed to read %s at %li: %s\n", m_uri.c_str(), m_pos, strerror(errno));
+            return AVERROR(errno);
+        }
+        if (res == 0) {
+            return AVERROR_EOF;
+        }
+        len = (int)res;
+    }
+
+    m_pos += len;
+    m_sequential_bytes += len;
+    if (m_access_pattern != ACCESS_SEQUENTIAL && m_sequential_bytes >= MIN_SEQUENTIAL_BYTES) {
+        setAccessPattern(ACCESS_SEQUENTIAL);
+    }
+
+    return len;
+}
+
+int64_t LocalFileIo::seek(int64_t offset, int whence) {
+    //log(LOG_INFO, "SEEK %li %i\n", offset, whence);
+
+    int64_t new_pos;
+    switch (whence) {
+    case SEEK_SET:
+        new_pos = offset;
+        break;
+
+    case SEEK_CUR:
+        new_pos = m_pos + offset;
+        break;
+
+    case SEEK_END:
+        new_pos = m_file_size + offset;
+        break;
+
+    case AVSEEK_SIZE:
+        return m_file_size;
+
+    default:
+        log(LOG_ERROR, "Unknown seek whence %i\n", whence);
+        return -1;
+    }
+
+    if (new_pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    if (new_pos != m_pos) {
+        if (std::abs(new_pos - m_pos) > MAX_SEQUENTIAL_STEP) {
+            m_sequential_bytes = 0;
+            setAccessPattern(ACCESS_RANDOM);
+        }
+        m_pos = new_pos;
+    }
+    return m_pos;
+}
+
+void LocalFileIo::setAccessPattern(AccessPattern access_pattern) {
+    if (access_pattern == m_access_pattern) {
+        return;
+    }
+    m_access_pattern = access_pattern;
+
+    if (m_access_pattern == ACCESS_SEQUENTIAL) {
+        m_will_need_end = 0;
+    }
+
+    if (m_map) {
+        int advice = m_access_pattern == ACCESS_SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM;
+        madvise(m_map, (size_t)m_file_size, advice);
+    } else {
+#ifdef POSIX_FADV_SEQUENTIAL
+        int advice = m_access_pattern == ACCESS_SEQUENTIAL ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM;
+        posix_fadvise(m_fd, 0, 0, advice);
+#endif
+    }
+}
@@ -0,0 +1,83 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+namespace Avalanche {
+
+// Reads a local file for libav. The file is mapped into memory when it can be, so reads are a
+// copy out of the page cache with no syscall and no buffering of our own; otherwise (pipes,
+// empty files, mmap failing) it falls back to pread.
+//
+// The kernel is told how the file is being read: after a seek that isn't just a short step
+// back, reads are taken to be random so it doesn't read ahead for nothing, and once reads
+// have been sequential for a while it is told to read ahead aggressively again.
+class LocalFileIo {
+public:
+    LocalFileIo(const std::string &uri);
+    ~LocalFileIo();
+
+    bool open();
+
+    AVIOContext * getAvioContext() {
+        return m_avio_context;
+    }
+
+    const std::string & getUri() {
+        return m_uri;
+    }
+
+    int64_t getFileSize() {
+        return m_file_size;
+    }
+
+    bool isMapped() {
+        return m_map != nullptr;
+    }
+
+    static int libavRead(void *this_ptr, uint8_t *buf, int buf_size) {
+        return static_cast<LocalFileIo *>(this_ptr)->read(buf, buf_size);
+    }
+
+    static int64_t libavSeek(void *this_ptr, int64_t offset, int whence) {
+        return static_cast<LocalFileIo *>(this_ptr)->seek(offset, whence);
+    }
+
+private:
+    enum AccessPattern {
+        ACCESS_NORMAL,
+        ACCESS_SEQUENTIAL,
+        ACCESS_RANDOM,
+    };
+
+    std::string m_uri;
+    AVIOContext *m_avio_context;
+
+    int m_fd = -1;
+    int64_t m_file_size = 0;
+    uint8_t *m_map = nullptr;
+
+    int64_t m_pos = 0;
+
+    AccessPattern m_access_pattern = ACCESS_NORMAL;
+    // bytes read since the last seek
+    int64_t m_sequential_bytes = 0;
+    // everything before this has been asked for with MADV_WILLNEED
+    int64_t m_will_need_end = 0;
+
+    int read(uint8_t *buf, int buf_size);
+    int64_t seek(int64_t offset, int whence);
+
+    void setAccessPattern(AccessPattern access_pattern);
+};
+
+}
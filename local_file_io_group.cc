@@ -0,0 +1,48 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include "local_file_io_group.h"
+
+using namespace Avalanche;
+
+LocalFileIoGroup::~LocalFileIoGroup() {
+    for (auto local_file_io: m_local_file_ios) {
+        delete local_file_io;
+    }
+    m_local_file_ios.clear();
+}
+
+AVIOContext * LocalFileIoGroup::open(const std::string &uri) {
+    if (m_is_aborting) {
+        return NULL;
+    }
+
+    auto local_file_io = new LocalFileIo(uri);
+    if (!local_file_io->open()) {
+        delete local_file_io;
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_local_file_ios.insert(local_file_io);
+
+    return local_file_io->getAvioContext();
+}
+
+void LocalFileIoGroup::close(void *opaque) {
+    LocalFileIo *local_file_io = static_cast<LocalFileIo *>(opaque);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_local_file_ios.erase(local_file_io);
+    }
+    delete local_file_io;
+}
+
+int LocalFileIoGroup::interruptCallback() {
+    if (m_is_aborting) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+
+#include "custom_io_group.h"
+#include "local_file_io.h"
+
+namespace Avalanche {
+
+// Reads local files directly, see LocalFileIo. Output is left to libav.
+class LocalFileIoGroup : public CustomIoGroup {
+public:
+    virtual ~LocalFileIoGroup();
+
+    AVIOContext * open(const std::string &uri) override;
+    void close(void *opaque) override;
+
+    int interruptCallback() override;
+
+    // makes libav give up on whatever it is doing
+    void setStopProcessing() {
+        m_is_aborting = true;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::unordered_set<LocalFileIo *> m_local_file_ios;
+
+    std::atomic<bool> m_is_aborting{false};
+};
+
+}
@@ -8,69 +8,24 @@
 
 #include "../utils.h"
 
+#include "disk_block_cache.h"
+#include "image_buffer_pool.h"
+#include "log_queue.h"
+#include "pinned_js_buffer.h"
 #include "promise_worker.h"
 #include "resource_io_group.h"
+#include "shared_block_cache.h"
 #include "wrapped_stress_test_resource_io.h"
+#include "worker_pool.h"
 #include "wrapped_video_reader.h"
 
-// there can be only one logger at a time, because libav's callbacks to us
-// (to avalancheLogToJs) include no context whatsoever
-
-Napi::ThreadSafeFunction ts_log_func;
-
 using namespace Avalanche;
 
+// there can be only one logger at a time, because libav's callbacks to us
+// (to avalancheLogToJs) include no context whatsoever; lines are queued for a flusher thread to
+// pass on, so whatever thread logs them doesn't wait for javascript
 void avalancheLogToJs(int level, bool is_libav, const char *s) {
-    napi_status status;
-
-    if (!ts_log_func) {
-        return;
-    }
-
-    status = ts_log_func.Acquire();
-    if (status != napi_ok) {
-        printf("failed to acquire %i\n", status);
-        return;
-    }
-
-    char *copy_s = strndup(s, 1000);
-
-    status = ts_log_func.BlockingCall(copy_s, [level, is_libav](const Napi::Env &env, const Napi::Function &js_func, const char *copy_s) {
-        Napi::Value val_level;
-        switch (level) {
-        case LOG_INFO:
-            val_level = Napi::String::New(env, "info");
-            break;
-        case LOG_ERROR:
-            val_level = Napi::String::New(env, "error");
-            break;
-        case LOG_DEBUG:
-            val_level = Napi::String::New(env, "debug");
-            break;
-        default:
-            val_level = Napi::String::New(env, "unknown");
-            break;
-        }
-        Napi::Value val_is_libav = Napi::Boolean::New(env, is_libav);
-        Napi::Value val_s = Napi::String::New(env, copy_s);
-        free((void *)copy_s);
-
-        js_func.Call({val_level, val_is_libav, val_s});
-    });
-
-    if (status != napi_ok) {
-        printf("failed to call js_func for logging\n");
-        free(copy_s);
-        if (status == napi_closing) {
-            return;
-        }
-    }
-
-    status = ts_log_func.Release();
-    if (status != napi_ok) {
-        printf("failed to release %i\n", status);
-        return;
-    }
+    LogQueue::getInstance().push(level, is_libav, s);
 }
 
 Napi::Value wrappedSetLogFunc(const Napi::CallbackInfo &info) {
@@ -87,14 +42,7 @@ Napi::Value wrappedSetLogFunc(const Napi::CallbackInfo &info) {
         return env.Null();
     }
 
-    if (ts_log_func) {
-        ts_log_func.Release();
-    }
-
-    Napi::Function log_func = info[0].As<Napi::Function>();
-
-    auto finalizer = [](const Napi::Env &) {};
-    ts_log_func = Napi::ThreadSafeFunction::New(env, log_func, "avalanche_log", 0, 1, finalizer);
+    LogQueue::getInstance().setJsFunc(env, info[0].As<Napi::Function>());
 
     // if something is crashing, it's handy to get logging to print out without having to go through javascript
     // by running this instead:
@@ -104,18 +52,71 @@ Napi::Value wrappedSetLogFunc(const Napi::CallbackInfo &info) {
     return env.Null();
 }
 
-Napi::Value destroy(const Napi::CallbackInfo &info) {
+// setLogLevel(level): 'debug', 'info' or 'error'; lines below it are dropped natively, before
+// they are formatted or queued
+Napi::Value wrappedSetLogLevel(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
 
-    if (ts_log_func) {
-        ts_log_func.Release();
-        ts_log_func = nullptr;
+    if (info.Length() != 1) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!info[0].IsString()) {
+        Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    std::string level = info[0].As<Napi::String>();
+    if (level == "debug") {
+        setLogLevel(LOG_DEBUG);
+    } else if (level == "info") {
+        setLogLevel(LOG_INFO);
+    } else if (level == "error") {
+        setLogLevel(LOG_ERROR);
+    } else {
+        Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
+        return env.Null();
     }
 
     return env.Null();
 }
 
+Napi::Value wrappedGetLogStats(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 0) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    LogQueueStats stats = LogQueue::getInstance().getStats();
+
+    auto retval = Napi::Object::New(env);
+    retval.Set("count_queued", Napi::Number::New(env, stats.count_queued));
+    retval.Set("count_dropped", Napi::Number::New(env, stats.count_dropped));
+    retval.Set("count_batches", Napi::Number::New(env, stats.count_batches));
+
+    return retval;
+}
+
+// lets interactive work run in the middle of long batch operations
+static void yieldToWorkerPool() {
+    WorkerPool::getInstance().yield();
+}
+
+Napi::Value destroy(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    LogQueue::getInstance().releaseJsFunc();
+
+    return env.Null();
+}
+
 Napi::Value wrappedGetAvFormatVersionString(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
@@ -129,13 +130,192 @@ Napi::Value wrappedGetAvFormatVersionString(const Napi::CallbackInfo &info) {
     return Napi::String::New(env, getAvFormatVersionString());
 }
 
+Napi::Value wrappedSetSharedBlockCacheSize(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 1) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    SharedBlockCache::getInstance().setMaxSize(info[0].As<Napi::Number>().Int64Value());
+
+    return env.Null();
+}
+
+// setDiskBlockCache(dir, maxSize): keeps fetched input blocks in dir, up to maxSize bytes; an
+// empty dir turns it off. Returns false if dir can't be used
+Napi::Value wrappedSetDiskBlockCache(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 2) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!info[0].IsString()) {
+        Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Wrong argument 1").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    std::string dir = info[0].As<Napi::String>();
+    bool success = DiskBlockCache::getInstance().setup(dir, info[1].As<Napi::Number>().Int64Value());
+
+    return Napi::Boolean::New(env, success);
+}
+
+// setImageBufferPoolSize(maxSize): how many bytes of image buffers that javascript is done with
+// are kept to decode later images into, 0 to free them all
+Napi::Value wrappedSetImageBufferPoolSize(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 1) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    ImageBufferPool::getInstance().setMaxSize(info[0].As<Napi::Number>().Int64Value());
+
+    return env.Null();
+}
+
+Napi::Value wrappedGetImageBufferPoolStats(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 0) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    ImageBufferPoolStats stats = ImageBufferPool::getInstance().getStats();
+
+    auto retval = Napi::Object::New(env);
+    retval.Set("count_allocated", Napi::Number::New(env, stats.count_allocated));
+    retval.Set("count_reused", Napi::Number::New(env, stats.count_reused));
+    retval.Set("pooled_size", Napi::Number::New(env, stats.pooled_size));
+
+    return retval;
+}
+
+// setWorkerPoolSize(size): the number of threads that run VideoReader operations, 0 for one per
+// cpu. Returns false once an operation has been started, since the threads are running by then
+Napi::Value wrappedSetWorkerPoolSize(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 1) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    bool success = WorkerPool::getInstance().setSize(info[0].As<Napi::Number>().Int32Value());
+
+    return Napi::Boolean::New(env, success);
+}
+
+// setWorkerPoolFiberMode(is_fiber_mode): whether VideoReader operations run on fibers, so that
+// waiting on javascript for a file suspends them instead of holding up a thread. Returns false
+// once an operation has been started, since the threads are running by then. Only the waits in
+// ResourceIoGroup suspend; waiting for a block another reader is already fetching, and waiting on
+// the AsyncFileIo read engine, still hold up the thread. The stages of extractClipReencode other
+// than muxing run on threads of their own, not on fibers, so its demuxing still holds up a thread
+// while it waits on javascript
+Napi::Value wrappedSetWorkerPoolFiberMode(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 1) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!info[0].IsBoolean()) {
+        Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    bool success = WorkerPool::getInstance().setFiberMode(info[0].As<Napi::Boolean>().Value());
+
+    return Napi::Boolean::New(env, success);
+}
+
+Napi::Value wrappedGetWorkerPoolStats(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 0) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    WorkerPoolStats stats = WorkerPool::getInstance().getStats();
+
+    // the share of the threads' time since the pool started that was spent running something
+    double utilization = 0;
+    if (stats.count_threads > 0 && stats.uptime_ns > 0) {
+        utilization = (double)stats.busy_time_ns / ((double)stats.uptime_ns * stats.count_threads);
+    }
+
+    auto retval = Napi::Object::New(env);
+    retval.Set("count_threads", Napi::Number::New(env, stats.count_threads));
+    retval.Set("count_busy", Napi::Number::New(env, stats.count_busy));
+    retval.Set("queue_depth", Napi::Number::New(env, stats.queue_depth));
+    retval.Set("count_completed", Napi::Number::New(env, stats.count_completed));
+    retval.Set("count_stolen", Napi::Number::New(env, stats.count_stolen));
+    retval.Set("count_yielded", Napi::Number::New(env, stats.count_yielded));
+    retval.Set("count_suspended", Napi::Number::New(env, stats.count_suspended));
+    retval.Set("count_waiting", Napi::Number::New(env, stats.count_waiting));
+    retval.Set("busy_time", Napi::Number::New(env, stats.busy_time_ns / 1e9));
+    retval.Set("utilization", Napi::Number::New(env, utilization));
+
+    return retval;
+}
+
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    initPinnedJsBuffers(env);
+    initPromiseWorkers(env);
+    setYieldFunc(yieldToWorkerPool);
+
     exports.Set(Napi::String::New(env, "setLogFunc"), Napi::Function::New(env, wrappedSetLogFunc));
+    exports.Set(Napi::String::New(env, "setLogLevel"), Napi::Function::New(env, wrappedSetLogLevel));
+    exports.Set(Napi::String::New(env, "getLogStats"), Napi::Function::New(env, wrappedGetLogStats));
     exports.Set(Napi::String::New(env, "destroy"), Napi::Function::New(env, destroy));
 
     exports.Set(Napi::String::New(env, "stressTestResourceIo"), Napi::Function::New(env, wrappedStressTestResourceIo));
 
     exports.Set(Napi::String::New(env, "getAvFormatVersionString"), Napi::Function::New(env, wrappedGetAvFormatVersionString));
+    exports.Set(Napi::String::New(env, "setSharedBlockCacheSize"), Napi::Function::New(env, wrappedSetSharedBlockCacheSize));
+    exports.Set(Napi::String::New(env, "setDiskBlockCache"), Napi::Function::New(env, wrappedSetDiskBlockCache));
+    exports.Set(Napi::String::New(env, "setImageBufferPoolSize"), Napi::Function::New(env, wrappedSetImageBufferPoolSize));
+    exports.Set(Napi::String::New(env, "getImageBufferPoolStats"), Napi::Function::New(env, wrappedGetImageBufferPoolStats));
+    exports.Set(Napi::String::New(env, "setWorkerPoolSize"), Napi::Function::New(env, wrappedSetWorkerPoolSize));
+    exports.Set(Napi::String::New(env, "setWorkerPoolFiberMode"), Napi::Function::New(env, wrappedSetWorkerPoolFiberMode));
+    exports.Set(Napi::String::New(env, "getWorkerPoolStats"), Napi::Function::New(env, wrappedGetWorkerPoolStats));
 
     exports.Set(Napi::String::New(env, "VideoReader"), WrappedVideoReader::GetClass(env));
 
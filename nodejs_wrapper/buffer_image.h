@@ -5,35 +5,26 @@
 #pragma once
 
 #include "napi.h"
-#include "uv.h"
 
 #include "../image_interface.h"
 
+#include "image_buffer_pool.h"
+
+// An image decoded into memory from ImageBufferPool, after a ppm header, which javascript gets
+// as a Buffer pointing straight at it once the operation is done. Nothing here needs the
+// javascript thread until then, so decoding never waits on it.
 class BufferImage : public Avalanche::ImageInterface {
     typedef ImageInterface super;
 public:
-    BufferImage(Napi::Env env);
+    BufferImage();
     ~BufferImage();
 
     virtual bool init(int width, int height) override;
-    void drain();
 
-    Napi::Reference<Napi::Buffer<uint8_t>> & getBufferRef() { return m_buffer_ref; }
+    // from the javascript thread, once; the memory goes back to the pool when the Buffer is
+    // garbage collected
+    Napi::Buffer<uint8_t> takeBuffer(Napi::Env env);
 
 private:
-    Napi::ThreadSafeFunction m_alloc_buffer_func;
-
-    uv_mutex_t m_mutex;
-    uv_cond_t m_cond;
-
-    Napi::Buffer<uint8_t> m_buffer;
-
-    bool m_is_draining;
-
-    // need to reference the buffer to make sure it's not freed before we return it
-    Napi::Reference<Napi::Buffer<uint8_t>> m_buffer_ref;
-
-    // called in js thread and other threads
-    void lock(std::function<void()> func);
-
+    ImageBuffer *m_image_buffer = nullptr;
 };
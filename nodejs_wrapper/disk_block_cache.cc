@@ -0,0 +1,385 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <unordered_set>
+
+#include "../private/utils.h"
+
+#include "../utils.h"
+#include "../uv_mutex_lock.h"
+
+#include "disk_block_cache.h"
+
+using namespace Avalanche;
+
+// at the start of every block file, followed by the key's length, the key, the data's length
+// and the data
+static const char BLOCK_MAGIC[4] = { 'A', 'V', 'B', '1' };
+static const char *BLOCK_SUFFIX = ".blk";
+static const char *TMP_SUFFIX = ".tmp";
+static const char *INDEX_FILE_NAME = "index";
+
+// once idle, the writer waits this long for more before writing out the index
+constexpr uint64_t INDEX_WRITE_DELAY_NSEC = 2000ull * 1000 * 1000;
+
+DiskBlockCache & DiskBlockCache::getInstance() {
+    // never destroyed, the writer thread runs until the process exits
+    static DiskBlockCache *disk_block_cache = new DiskBlockCache();
+    return *disk_block_cache;
+}
+
+DiskBlockCache::DiskBlockCache() {
+    int ret;
+
+    ret = uv_mutex_init(&m_mutex);
+    if (ret != 0) {
+        log(LOG_ERROR, "UvMutexInitFailed %i", ret);
+        return;
+    }
+    ret = uv_cond_init(&m_cond);
+    if (ret != 0) {
+        log(LOG_ERROR, "UvCondInitFailed %i", ret);
+        return;
+    }
+}
+
+// 64 bit FNV-1a, which unlike std::hash is the same in every process
+std::string DiskBlockCache::getFileName(const std::string &key) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c: key) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+    return std::string(name) + BLOCK_SUFFIX;
+}
+
+bool DiskBlockCache::setup(const std::string &dir, int64_t max_size) {
+    if (!dir.empty() && mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        log(LOG_ERROR, "Unable to make disk block cache dir %s: %s\n", dir.c_str(), strerror(errno));
+        return false;
+    }
+
+    std::vector<std::string> evicted_paths;
+    {
+        UvMutexLock lock(m_mutex);
+
+        m_dir = dir;
+        m_max_size = max_size;
+        m_entries.clear();
+        m_lru.clear();
+        m_size = 0;
+        m_pending.clear();
+        m_pending_size = 0;
+        m_is_index_dirty = false;
+
+        if (m_dir.empty()) {
+            return true;
+        }
+
+        loadIndex();
+        evict(evicted_paths);
+
+        if (!m_is_writer_started) {
+            int ret = uv_thread_create(&m_writer_thread, &DiskBlockCache::writerThreadEntry, this);
+            if (ret != 0) {
+                log(LOG_ERROR, "Unable to start disk block cache writer %i\n", ret);
+                m_dir.clear();
+                return false;
+            }
+            m_is_writer_started = true;
+        }
+    }
+    for (auto &path: evicted_paths) {
+        unlink(path.c_str());
+    }
+    return true;
+}
+
+bool DiskBlockCache::isEnabled() {
+    UvMutexLock lock(m_mutex);
+
+    return !m_dir.empty();
+}
+
+bool DiskBlockCache::contains(const std::string &key) {
+    UvMutexLock lock(m_mutex);
+
+    return !m_dir.empty() && m_entries.count(getFileName(key)) != 0;
+}
+
+std::shared_ptr<const BlockData> DiskBlockCache::load(const std::string &key) {
+    std::string file_name = getFileName(key);
+    std::string path;
+    {
+        UvMutexLock lock(m_mutex);
+
+        auto it = m_entries.find(file_name);
+        if (m_dir.empty() || it == m_entries.end()) {
+            return nullptr;
+        }
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru_it);
+        m_is_index_dirty = true;
+        path = m_dir + "/" + file_name;
+    }
+
+    std::shared_ptr<BlockData> data;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file) {
+        char magic[sizeof(BLOCK_MAGIC)];
+        uint32_t key_len = 0;
+        std::string file_key;
+        uint64_t data_len = 0;
+        bool is_valid =
+            fread(magic, sizeof(magic), 1, file) == 1 &&
+            memcmp(magic, BLOCK_MAGIC, sizeof(magic)) == 0 &&
+            fread(&key_len, sizeof(key_len), 1, file) == 1 &&
+            key_len == key.size();
+        if (is_valid) {
+            file_key.resize(key_len);
+            is_valid =
+                fread(&file_key[0], key_len, 1, file) == 1 &&
+                file_key == key &&
+                fread(&data_len, sizeof(data_len), 1, file) == 1 &&
+                data_len > 0 && data_len <= (uint64_t)SharedBlockCache::BLOCK_SIZE;
+        }
+        if (is_valid) {
+            data = std::make_shared<BlockData>((size_t)data_len);
+            is_valid = fread(data->data(), data_len, 1, file) == 1;
+        }
+        fclose(file);
+        if (!is_valid) {
+            // a hash collision, or damaged
+            data = nullptr;
+        }
+    }
+
+    if (!data) {
+        log(LOG_INFO, "Dropping unreadable disk block cache file %s\n", path.c_str());
+        {
+            UvMutexLock lock(m_mutex);
+
+            auto it = m_entries.find(file_name);
+            if (it != m_entries.end()) {
+                m_size -= it->second.size;
+                m_lru.erase(it->second.lru_it);
+                m_entries.erase(it);
+                m_is_index_dirty = true;
+            }
+        }
+        unlink(path.c_str());
+        return nullptr;
+    }
+    return data;
+}
+
+void DiskBlockCache::store(const std::string &key, std::shared_ptr<const BlockData> data) {
+    {
+        UvMutexLock lock(m_mutex);
+
+        if (m_dir.empty() || m_entries.count(getFileName(key)) != 0) {
+            return;
+        }
+        if (m_pending_size + (int64_t)data->size() > MAX_PENDING_SIZE) {
+            // the disk isn't keeping up; this block can just be fetched again next time
+            return;
+        }
+        m_pending.push_back(std::make_pair(key, data));
+        m_pending_size += (int64_t)data->size();
+    }
+    uv_cond_signal(&m_cond);
+}
+
+// called with m_mutex held
+void DiskBlockCache::loadIndex() {
+    std::unordered_set<std::string> block_names;
+    DIR *dir = opendir(m_dir.c_str());
+    if (!dir) {
+        log(LOG_ERROR, "Unable to read disk block cache dir %s: %s\n", m_dir.c_str(), strerror(errno));
+        return;
+    }
+    while (struct dirent *dirent = readdir(dir)) {
+        std::string name = dirent->d_name;
+        if (stringEndsWith(name, TMP_SUFFIX)) {
+            // left over from a crash
+            unlink((m_dir + "/" + name).c_str());
+        } else if (stringEndsWith(name, BLOCK_SUFFIX)) {
+            block_names.insert(name);
+        }
+    }
+    closedir(dir);
+
+    auto add_entry = [this](const std::string &name) {
+        struct stat st;
+        if (stat((m_dir + "/" + name).c_str(), &st) != 0) {
+            return;
+        }
+        m_lru.push_back(name);
+        Entry &entry = m_entries[name];
+        entry.size = (int64_t)st.st_size;
+        entry.lru_it = std::prev(m_lru.end());
+        m_size += entry.size;
+    };
+
+    // the blocks in the index first, in its order
+    FILE *file = fopen((m_dir + "/" + INDEX_FILE_NAME).c_str(), "r");
+    if (file) {
+        char line[256];
+        while (fgets(line, sizeof(line), file)) {
+            std::string name = line;
+            while (!name.empty() && (name.back() == '\n' || name.back() == '\r')) {
+                name.pop_back();
+            }
+            if (block_names.erase(name) != 0) {
+                add_entry(name);
+            }
+        }
+        fclose(file);
+    }
+
+    // then any written after the index last was, as the oldest
+    for (auto &name: block_names) {
+        add_entry(name);
+    }
+    m_is_index_dirty = true;
+}
+
+// called with m_mutex held
+void DiskBlockCache::evict(std::vector<std::string> &evicted_paths) {
+    while (m_size > m_max_size && !m_lru.empty()) {
+        auto it = m_entries.find(m_lru.back());
+        m_size -= it->second.size;
+        evicted_paths.push_back(m_dir + "/" + it->first);
+        m_entries.erase(it);
+        m_lru.pop_back();
+        m_is_index_dirty = true;
+    }
+}
+
+void DiskBlockCache::writerThreadEntry(void *arg) {
+    static_cast<DiskBlockCache *>(arg)->runWriter();
+}
+
+void DiskBlockCache::runWriter() {
+    while (true) {
+        std::string dir;
+        std::string key;
+        std::shared_ptr<const BlockData> data;
+        std::vector<std::string> index;
+        {
+            UvMutexLock lock(m_mutex);
+
+            if (m_pending.empty()) {
+                if (m_is_index_dirty) {
+                    uv_cond_timedwait(&m_cond, &m_mutex, INDEX_WRITE_DELAY_NSEC);
+                } else {
+                    uv_cond_wait(&m_cond, &m_mutex);
+                }
+            }
+            dir = m_dir;
+            if (!m_pending.empty()) {
+                key = m_pending.front().first;
+                data = m_pending.front().second;
+                m_pending.pop_front();
+                m_pending_size -= (int64_t)data->size();
+            } else if (m_is_index_dirty && !m_dir.empty()) {
+                index.assign(m_lru.begin(), m_lru.end());
+                m_is_index_dirty = false;
+            }
+        }
+
+        if (data) {
+            std::string file_name = getFileName(key);
+            if (!writeBlock(dir + "/" + file_name, key, *data)) {
+                continue;
+            }
+
+            std::vector<std::string> evicted_paths;
+            {
+                UvMutexLock lock(m_mutex);
+
+                if (m_dir != dir || m_entries.count(file_name) != 0) {
+                    // turned off or moved meanwhile
+                    continue;
+                }
+                m_lru.push_front(file_name);
+                Entry &entry = m_entries[file_name];
+                entry.size = (int64_t)(sizeof(BLOCK_MAGIC) + sizeof(uint32_t) + key.size() + sizeof(uint64_t) + data->size());
+                entry.lru_it = m_lru.begin();
+                m_size += entry.size;
+                m_is_index_dirty = true;
+                evict(evicted_paths);
+            }
+            for (auto &path: evicted_paths) {
+                unlink(path.c_str());
+            }
+        } else if (!index.empty()) {
+            writeIndex(dir, index);
+        }
+    }
+}
+
+bool DiskBlockCache::writeBlock(const std::string &path, const std::string &key, const BlockData &data) {
+    std::string tmp_path = path + TMP_SUFFIX;
+    FILE *file = fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        log(LOG_ERROR, "Unable to write disk block cache file %s: %s\n", tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    uint32_t key_len = (uint32_t)key.size();
+    uint64_t data_len = (uint64_t)data.size();
+    bool is_written =
+        fwrite(BLOCK_MAGIC, sizeof(BLOCK_MAGIC), 1, file) == 1 &&
+        fwrite(&key_len, sizeof(key_len), 1, file) == 1 &&
+        fwrite(key.data(), key.size(), 1, file) == 1 &&
+        fwrite(&data_len, sizeof(data_len), 1, file) == 1 &&
+        fwrite(data.data(), data.size(), 1, file) == 1 &&
+        fflush(file) == 0 &&
+        fsync(fileno(file)) == 0;
+    fclose(file);
+
+    // only a complete block ever gets its real name
+    if (!is_written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        log(LOG_ERROR, "Unable to write disk block cache file %s: %s\n", path.c_str(), strerror(errno));
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool DiskBlockCache::writeIndex(const std::string &dir, const std::vector<std::string> &index) {
+    std::string path = dir + "/" + INDEX_FILE_NAME;
+    std::string tmp_path = path + TMP_SUFFIX;
+    FILE *file = fopen(tmp_path.c_str(), "w");
+    if (!file) {
+        log(LOG_ERROR, "Unable to write disk block cache index %s: %s\n", tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    bool is_written = true;
+    for (auto &name: index) {
+        if (fprintf(file, "%s\n", name.c_str()) < 0) {
+            is_written = false;
+            break;
+        }
+    }
+    is_written = is_written && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    fclose(file);
+
+    if (!is_written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        log(LOG_ERROR, "Unable to write disk block cache index %s: %s\n", path.c_str(), strerror(errno));
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "uv.h"
+
+#include "./shared_block_cache.h"
+
+// Optional process wide cache of input blocks on local disk, under SharedBlockCache, so an
+// asset that is read again later (by this process or the next one) comes from disk instead of
+// from javascript. Blocks have the same keys as in SharedBlockCache, which include the
+// resource's etag when javascript gives one, so a resource that changed is fetched again.
+//
+// Each block is a file named by a hash of its key. It is written under a temporary name and
+// renamed into place, so a crash never leaves a partial block behind, and it starts with its
+// key, which is checked when it is loaded. The index file lists the blocks most recently used
+// first, for eviction; it is replaced the same way, and on startup it is reconciled with the
+// block files that are actually there. Blocks are written by a background thread, so storing
+// one never waits on the disk.
+class DiskBlockCache {
+public:
+    // blocks waiting to be written beyond this are dropped rather than queued
+    static constexpr int64_t MAX_PENDING_SIZE = 64 * 1024 * 1024;
+
+    static DiskBlockCache & getInstance();
+
+    // turns the cache on in dir (made if needed), picking up whatever an earlier process left
+    // there, or off if dir is empty
+    bool setup(const std::string &dir, int64_t max_size);
+
+    bool isEnabled();
+
+    bool contains(const std::string &key);
+
+    // null if the block isn't there or can't be read
+    std::shared_ptr<const BlockData> load(const std::string &key);
+
+    // queues the block to be written
+    void store(const std::string &key, std::shared_ptr<const BlockData> data);
+
+private:
+    DiskBlockCache();
+
+    struct Entry {
+        int64_t size;
+        std::list<std::string>::iterator lru_it;
+    };
+
+    uv_mutex_t m_mutex;
+    // signalled when there is something for the writer thread
+    uv_cond_t m_cond;
+    uv_thread_t m_writer_thread;
+    bool m_is_writer_started = false;
+
+    std::string m_dir;
+    int64_t m_max_size = 0;
+    int64_t m_size = 0;
+
+    // by file name
+    std::unordered_map<std::string, Entry> m_entries;
+    // file names, most recently used first
+    std::list<std::string> m_lru;
+    bool m_is_index_dirty = false;
+
+    std::deque<std::pair<std::string, std::shared_ptr<const BlockData>>> m_pending;
+    int64_t m_pending_size = 0;
+
+    static std::string getFileName(const std::string &key);
+
+    // called with m_mutex held
+    void loadIndex();
+    void evict(std::vector<std::string> &evicted_paths);
+
+    static void writerThreadEntry(void *arg);
+    void runWriter();
+    bool writeBlock(const std::string &path, const std::string &key, const BlockData &data);
+    bool writeIndex(const std::string &dir, const std::vector<std::string> &index);
+};
@@ -0,0 +1,103 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <stdlib.h>
+
+#include "../utils.h"
+#include "../uv_mutex_lock.h"
+
+#include "../private/utils.h"
+
+#include "image_buffer_pool.h"
+
+using namespace Avalanche;
+
+static void freeImageBuffer(ImageBuffer *image_buffer) {
+    free(image_buffer->data);
+    delete image_buffer;
+}
+
+ImageBufferPool & ImageBufferPool::getInstance() {
+    // never destroyed, javascript can hold on to buffers from it until the process exits
+    static ImageBufferPool *image_buffer_pool = new ImageBufferPool();
+    return *image_buffer_pool;
+}
+
+ImageBufferPool::ImageBufferPool() {
+    int ret = uv_mutex_init(&m_mutex);
+    if (ret != 0) {
+        log(LOG_ERROR, "UvMutexInitFailed %i", ret);
+        return;
+    }
+}
+
+void ImageBufferPool::setMaxSize(int64_t max_size) {
+    UvMutexLock lock(m_mutex);
+
+    m_max_size = max_size;
+    trim();
+}
+
+ImageBuffer * ImageBufferPool::acquire(size_t size) {
+    {
+        UvMutexLock lock(m_mutex);
+
+        auto it = m_free.find(size);
+        if (it != m_free.end() && !it->second.empty()) {
+            ImageBuffer *image_buffer = it->second.back();
+            it->second.pop_back();
+            m_pooled_size -= size;
+            m_count_reused++;
+            return image_buffer;
+        }
+        m_count_allocated++;
+    }
+
+    uint8_t *data = static_cast<uint8_t *>(malloc(size));
+    if (!data) {
+        log(LOG_ERROR, "Unable to allocate image buffer of %zu bytes\n", size);
+        return nullptr;
+    }
+    return new ImageBuffer({ data, size });
+}
+
+void ImageBufferPool::release(ImageBuffer *image_buffer) {
+    {
+        UvMutexLock lock(m_mutex);
+
+        if (m_pooled_size + (int64_t)image_buffer->size <= m_max_size) {
+            m_free[image_buffer->size].push_back(image_buffer);
+            m_pooled_size += image_buffer->size;
+            return;
+        }
+    }
+
+    freeImageBuffer(image_buffer);
+}
+
+ImageBufferPoolStats ImageBufferPool::getStats() {
+    UvMutexLock lock(m_mutex);
+
+    ImageBufferPoolStats stats;
+    stats.count_allocated = m_count_allocated;
+    stats.count_reused = m_count_reused;
+    stats.pooled_size = m_pooled_size;
+    return stats;
+}
+
+void ImageBufferPool::trim() {
+    for (auto it = m_free.begin(); it != m_free.end() && m_pooled_size > m_max_size; ) {
+        auto &image_buffers = it->second;
+        while (!image_buffers.empty() && m_pooled_size > m_max_size) {
+            m_pooled_size -= image_buffers.front()->size;
+            freeImageBuffer(image_buffers.front());
+            image_buffers.erase(image_buffers.begin());
+        }
+        if (image_buffers.empty()) {
+            it = m_free.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
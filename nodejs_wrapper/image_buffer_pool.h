@@ -0,0 +1,60 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "uv.h"
+
+struct ImageBuffer {
+    uint8_t *data;
+    size_t size;
+};
+
+struct ImageBufferPoolStats {
+    int64_t count_allocated = 0;
+    int64_t count_reused = 0;
+    // free, waiting to be reused
+    int64_t pooled_size = 0;
+};
+
+// Process wide pool of the memory images are decoded into, which javascript then gets as
+// Buffers that point at it (see BufferImage). When javascript is done with one, its memory comes
+// back here for the next image of the same size (images from one video are all the same size),
+// up to a byte budget; beyond that it is freed.
+class ImageBufferPool {
+public:
+    static constexpr int64_t DEFAULT_MAX_SIZE = 64 * 1024 * 1024;
+
+    static ImageBufferPool & getInstance();
+
+    void setMaxSize(int64_t max_size);
+
+    // from any thread; null if it can't be allocated
+    ImageBuffer * acquire(size_t size);
+    // from any thread
+    void release(ImageBuffer *image_buffer);
+
+    ImageBufferPoolStats getStats();
+
+private:
+    ImageBufferPool();
+
+    uv_mutex_t m_mutex;
+
+    int64_t m_max_size = DEFAULT_MAX_SIZE;
+    int64_t m_pooled_size = 0;
+    // free buffers by size, the most recently released last
+    std::unordered_map<size_t, std::vector<ImageBuffer *>> m_free;
+
+    int64_t m_count_allocated = 0;
+    int64_t m_count_reused = 0;
+
+    // called with m_mutex held
+    void trim();
+};
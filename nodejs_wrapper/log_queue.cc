@@ -0,0 +1,197 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+#include "../utils.h"
+#include "../uv_mutex_lock.h"
+
+#include "log_queue.h"
+
+using namespace Avalanche;
+
+static_assert((LogQueue::COUNT_SLOTS & (LogQueue::COUNT_SLOTS - 1)) == 0, "COUNT_SLOTS must be a power of two");
+
+LogQueue & LogQueue::getInstance() {
+    // never destroyed, the flusher thread runs until the process exits
+    static LogQueue *log_queue = new LogQueue();
+    return *log_queue;
+}
+
+LogQueue::LogQueue() : m_slots(new Slot[COUNT_SLOTS]) {
+    for (size_t i = 0; i < COUNT_SLOTS; i++) {
+        m_slots[i].sequence = i;
+    }
+
+    // nowhere to log these to, this is where logging goes
+    int ret = uv_mutex_init(&m_consumer_mutex);
+    if (ret != 0) {
+        printf("UvMutexInitFailed %i\n", ret);
+        return;
+    }
+    ret = uv_mutex_init(&m_mutex);
+    if (ret != 0) {
+        printf("UvMutexInitFailed %i\n", ret);
+        return;
+    }
+}
+
+void LogQueue::setJsFunc(Napi::Env env, Napi::Function js_func) {
+    // so nothing already queued goes to the old one, or gets lost
+    releaseJsFunc();
+
+    UvMutexLock lock(m_mutex);
+
+    auto finalizer = [](const Napi::Env &) {};
+    m_ts_js_func = Napi::ThreadSafeFunction::New(env, js_func, "avalanche_log", 0, 1, finalizer);
+
+    if (!m_is_flusher_started) {
+        int ret = uv_thread_create(&m_flusher_thread, &LogQueue::flusherThreadEntry, this);
+        if (ret != 0) {
+            printf("Unable to start log flusher thread %i\n", ret);
+            return;
+        }
+        m_is_flusher_started = true;
+    }
+}
+
+void LogQueue::releaseJsFunc() {
+    flush();
+
+    UvMutexLock lock(m_mutex);
+
+    if (m_ts_js_func) {
+        m_ts_js_func.Release();
+        m_ts_js_func = nullptr;
+    }
+}
+
+void LogQueue::push(int level, bool is_libav, const char *s) {
+    uint64_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+        slot = &m_slots[pos & (COUNT_SLOTS - 1)];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)sequence - (int64_t)pos;
+        if (diff == 0) {
+            // on failure, pos is reloaded with where the others have got to
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the consumer hasn't emptied this slot since the last lap, so the queue is full
+            m_count_dropped++;
+            m_count_unreported_dropped++;
+            return;
+        } else {
+            // another producer claimed it first
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->is_libav = is_libav;
+    strncpy(slot->s, s, MAX_LINE_SIZE - 1);
+    slot->s[MAX_LINE_SIZE - 1] = 0;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    m_count_queued++;
+}
+
+LogQueueStats LogQueue::getStats() {
+    LogQueueStats stats;
+    stats.count_queued = m_count_queued;
+    stats.count_dropped = m_count_dropped;
+
+    UvMutexLock lock(m_consumer_mutex);
+    stats.count_batches = m_count_batches;
+    return stats;
+}
+
+void LogQueue::pop(std::vector<LogMessage> &messages) {
+    while (true) {
+        Slot *slot = &m_slots[m_dequeue_pos & (COUNT_SLOTS - 1)];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence != m_dequeue_pos + 1) {
+            // empty, or the producer that claimed it is still filling it in
+            return;
+        }
+        messages.push_back({ slot->level, slot->is_libav, slot->s });
+        slot->sequence.store(m_dequeue_pos + COUNT_SLOTS, std::memory_order_release);
+        m_dequeue_pos++;
+    }
+}
+
+void LogQueue::flush() {
+    UvMutexLock consumer_lock(m_consumer_mutex);
+    UvMutexLock lock(m_mutex);
+
+    if (!m_ts_js_func) {
+        // kept until there is somewhere to send them
+        return;
+    }
+
+    auto messages = new std::vector<LogMessage>();
+    int64_t count_dropped = m_count_unreported_dropped.exchange(0);
+    if (count_dropped > 0) {
+        char buf[100];
+        snprintf(buf, sizeof(buf), "%li log lines were dropped because too many were logged at once\n", count_dropped);
+        messages->push_back({ LOG_ERROR, false, buf });
+    }
+    pop(*messages);
+    if (messages->empty()) {
+        delete messages;
+        return;
+    }
+
+    napi_status status = m_ts_js_func.NonBlockingCall(messages, [](Napi::Env env, Napi::Function js_func, std::vector<LogMessage> *messages) {
+        // no env when the process is exiting with batches still waiting
+        if (env == nullptr) {
+            delete messages;
+            return;
+        }
+        for (auto &message: *messages) {
+            Napi::Value val_level;
+            switch (message.level) {
+            case LOG_INFO:
+                val_level = Napi::String::New(env, "info");
+                break;
+            case LOG_ERROR:
+                val_level = Napi::String::New(env, "error");
+                break;
+            case LOG_DEBUG:
+                val_level = Napi::String::New(env, "debug");
+                break;
+            default:
+                val_level = Napi::String::New(env, "unknown");
+                break;
+            }
+            Napi::Value val_is_libav = Napi::Boolean::New(env, message.is_libav);
+            Napi::Value val_s = Napi::String::New(env, message.s);
+
+            js_func.Call({val_level, val_is_libav, val_s});
+        }
+        delete messages;
+    });
+    if (status != napi_ok) {
+        printf("failed to call js_func for logging %i\n", status);
+        delete messages;
+        return;
+    }
+    m_count_batches++;
+}
+
+void LogQueue::flusherThreadEntry(void *arg) {
+    static_cast<LogQueue *>(arg)->runFlusher();
+}
+
+void LogQueue::runFlusher() {
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+        flush();
+    }
+}
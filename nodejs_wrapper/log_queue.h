@@ -0,0 +1,98 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <napi.h>
+
+#include "uv.h"
+
+struct LogMessage {
+    int level;
+    bool is_libav;
+    std::string s;
+};
+
+struct LogQueueStats {
+    int64_t count_queued = 0;
+    // because the queue was full
+    int64_t count_dropped = 0;
+    int64_t count_batches = 0;
+};
+
+// Process wide queue the native log lines (ours and libav's) go through on their way to the
+// javascript log function, so the thread logging never waits for the javascript thread, or for
+// a lock: a decoder that logs a line per frame would otherwise stall on the event loop for each.
+//
+// The queue is a fixed ring of slots that any thread can claim one of with a compare and swap;
+// when they are all full, the line is dropped and counted instead. A flusher thread empties it
+// every FLUSH_INTERVAL_MS and hands what it found to javascript in one call. The count of lines
+// dropped since the last batch is logged in front of the next one.
+class LogQueue {
+public:
+    // a power of two
+    static constexpr size_t COUNT_SLOTS = 1024;
+    // longer lines are cut short
+    static constexpr size_t MAX_LINE_SIZE = 1024;
+    static constexpr int FLUSH_INTERVAL_MS = 20;
+
+    static LogQueue & getInstance();
+
+    // from the javascript thread; lines are delivered to js_func from now on
+    void setJsFunc(Napi::Env env, Napi::Function js_func);
+    // from the javascript thread; hands the js func whatever is still queued, then lets go of
+    // it, after which lines are queued until there is a new one
+    void releaseJsFunc();
+
+    // from any thread, never blocks
+    void push(int level, bool is_libav, const char *s);
+
+    LogQueueStats getStats();
+
+private:
+    LogQueue();
+
+    struct Slot {
+        // tells whose turn the slot is: the producer at position n finds n, and leaves n + 1 for
+        // the consumer, who leaves n + COUNT_SLOTS for the producer on the next lap
+        std::atomic<uint64_t> sequence;
+        int level;
+        bool is_libav;
+        char s[MAX_LINE_SIZE];
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<uint64_t> m_enqueue_pos{0};
+
+    std::atomic<int64_t> m_count_queued{0};
+    std::atomic<int64_t> m_count_dropped{0};
+    // dropped, but not yet reported
+    std::atomic<int64_t> m_count_unreported_dropped{0};
+
+    // for the consumer side, which is the flusher thread or releaseJsFunc
+    uv_mutex_t m_consumer_mutex;
+    uint64_t m_dequeue_pos = 0;
+    int64_t m_count_batches = 0;
+
+    // guards m_ts_js_func, which the flusher thread uses
+    uv_mutex_t m_mutex;
+    Napi::ThreadSafeFunction m_ts_js_func;
+    bool m_is_flusher_started = false;
+    uv_thread_t m_flusher_thread;
+
+    // called with m_consumer_mutex held
+    void pop(std::vector<LogMessage> &messages);
+    // hands whatever is queued to the js func, if there is one
+    void flush();
+
+    static void flusherThreadEntry(void *arg);
+    void runFlusher();
+};
@@ -0,0 +1,47 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <thread>
+
+#include "pinned_js_buffer.h"
+
+typedef Napi::Reference<Napi::Buffer<uint8_t>> BufferReference;
+
+// references can only be deleted in the js thread, so ones let go of elsewhere are sent there
+static Napi::ThreadSafeFunction ts_release_func;
+static std::thread::id js_thread_id;
+
+void initPinnedJsBuffers(Napi::Env env) {
+    js_thread_id = std::this_thread::get_id();
+
+    auto noop_func = Napi::Function::New(env, [](const Napi::CallbackInfo &info) {
+        return info.Env().Undefined();
+    });
+    auto finalizer = [](const Napi::Env &) {};
+    ts_release_func = Napi::ThreadSafeFunction::New(env, noop_func, "release_pinned_js_buffer", 0, 1, finalizer);
+    // don't keep the js loop alive for this
+    ts_release_func.Unref(env);
+}
+
+std::shared_ptr<void> pinJsBuffer(const Napi::Buffer<uint8_t> &buffer) {
+    auto buffer_reference = new BufferReference(Napi::Persistent(buffer));
+
+    return std::shared_ptr<void>(buffer_reference, [](void *ptr) {
+        auto buffer_reference = static_cast<BufferReference *>(ptr);
+        if (std::this_thread::get_id() == js_thread_id) {
+            delete buffer_reference;
+            return;
+        }
+
+        napi_status status = ts_release_func.NonBlockingCall(buffer_reference, [](Napi::Env, Napi::Function, BufferReference *buffer_reference) {
+            // this code is run in the main js thread
+            delete buffer_reference;
+        });
+        if (status != napi_ok) {
+            // javascript is shutting down, so the buffer is going away regardless; touching the
+            // reference from this thread isn't allowed, so it is leaked
+            printf("failed to release pinned js buffer %i\n", status);
+        }
+    });
+}
@@ -0,0 +1,17 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "napi.h"
+
+// call once, in the js thread, before pinning anything
+void initPinnedJsBuffers(Napi::Env env);
+
+// called in js thread. Keeps buffer alive until the returned owner goes away, so its memory can
+// be used from other threads without copying it. The owner can go away in any thread; the
+// buffer is let go of in the js thread.
+std::shared_ptr<void> pinJsBuffer(const Napi::Buffer<uint8_t> &buffer);
@@ -0,0 +1,61 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <stdio.h>
+
+#include "promise_worker.h"
+
+// brings finished workers back to the js thread; it only keeps the js loop alive while there
+// are workers that haven't finished
+static Napi::ThreadSafeFunction ts_complete_func;
+static int count_outstanding = 0;
+
+void initPromiseWorkers(Napi::Env env) {
+    auto noop_func = Napi::Function::New(env, [](const Napi::CallbackInfo &info) {
+        return info.Env().Undefined();
+    });
+    auto finalizer = [](const Napi::Env &) {};
+    ts_complete_func = Napi::ThreadSafeFunction::New(env, noop_func, "complete_promise_worker", 0, 1, finalizer);
+    ts_complete_func.Unref(env);
+}
+
+void PromiseWorker::Queue(WorkerPool::Priority priority) {
+    Napi::Env env = m_deferred.Env();
+
+    if (count_outstanding++ == 0) {
+        ts_complete_func.Ref(env);
+    }
+
+    bool is_queued = WorkerPool::getInstance().queue([this]() {
+        Execute();
+
+        napi_status status = ts_complete_func.BlockingCall(this, [](Napi::Env env, Napi::Function, PromiseWorker *worker) {
+            // this code is run in the main js thread
+            worker->complete(env);
+        });
+        if (status != napi_ok) {
+            // javascript is shutting down, nothing is waiting on the promise any more; the
+            // worker can only be touched from the js thread, so it is leaked
+            printf("failed to complete promise worker %i\n", status);
+        }
+    }, priority);
+    if (!is_queued) {
+        SetError("WorkerPoolFailure");
+        complete(env);
+    }
+}
+
+void PromiseWorker::complete(Napi::Env env) {
+    if (m_has_error) {
+        m_deferred.Reject(Napi::Error::New(env, m_error).Value());
+    } else {
+        Resolve(m_deferred);
+    }
+
+    if (--count_outstanding == 0) {
+        ts_complete_func.Unref(env);
+    }
+
+    delete this;
+}
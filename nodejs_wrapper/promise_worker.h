@@ -4,36 +4,40 @@
 
 #pragma once
 
+#include <string>
+
 #include "napi.h"
 
-// from NAPI team
+#include "worker_pool.h"
+
+// Runs Execute() on a thread of the WorkerPool, then Resolve() (or rejects, if SetError() was
+// called) on the js thread, like a Napi::AsyncWorker but without using libuv's threadpool
+void initPromiseWorkers(Napi::Env env);
 
-class PromiseWorker : public Napi::AsyncWorker {
+class PromiseWorker {
 public:
-    PromiseWorker(Napi::Promise::Deferred const &d) : AsyncWorker(get_fake_callback(d.Env()).Value()), deferred(d) {}
+    PromiseWorker(Napi::Promise::Deferred const &deferred) : m_deferred(deferred) {}
 
-    virtual void Resolve(Napi::Promise::Deferred const &deferred) = 0;
+    virtual ~PromiseWorker() {}
 
-    void OnOK() override {
-        Resolve(deferred);
-    }
+    // This code will be executed on the worker thread; not allowed to call any napi
+    virtual void Execute() = 0;
 
-    void OnError(Napi::Error const &error) override {
-        deferred.Reject(error.Value());
-    }
+    virtual void Resolve(Napi::Promise::Deferred const &deferred) = 0;
 
-private:
-    static Napi::Value noop(Napi::CallbackInfo const &info) {
-        return info.Env().Undefined();
+    // from Execute(), to reject the promise with this message instead of resolving it
+    void SetError(const std::string &error) {
+        m_has_error = true;
+        m_error = error;
     }
 
-    Napi::Reference<Napi::Function> const &get_fake_callback(Napi::Env const &env) {
-        static Napi::Reference<Napi::Function> fake_callback
-                = Napi::Reference<Napi::Function>::New(Napi::Function::New(env, noop), 1);
-        fake_callback.SuppressDestruct();
+    // the worker deletes itself once the promise is settled
+    void Queue(WorkerPool::Priority priority = WorkerPool::PRIORITY_NORMAL);
 
-        return fake_callback;
-    }
+private:
+    Napi::Promise::Deferred m_deferred;
+    bool m_has_error = false;
+    std::string m_error;
 
-    Napi::Promise::Deferred deferred;
+    void complete(Napi::Env env);
 };
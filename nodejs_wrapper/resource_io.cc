@@ -2,21 +2,45 @@
  * (c) Chad Walker, Chris Kirmse
  */
 
+#include <string.h>
+
+#include <algorithm>
+
 #include "resource_io.h"
 
 #include "resource_io_group.h"
 
 using namespace Avalanche;
 
-ResourceIo::ResourceIo(ResourceIoGroup *resource_io_group, const std::string &uri, int64_t file_size) :
+// bounds of the adaptive read size. A miss fetches the read size, more is fetched once less
+// than it is cached ahead of the read position, enough to have READ_AHEAD_FACTOR times it ahead
+constexpr int MIN_READ_SIZE = 64 * 1024;
+constexpr int MAX_READ_SIZE = 4 * 1024 * 1024;
+constexpr int INITIAL_READ_SIZE = 1024 * 1024;
+constexpr int READ_AHEAD_FACTOR = 3;
+// a sequential run this many read sizes long doubles the read size
+constexpr int GROW_RUN_FACTOR = 4;
+// kept behind the read position, for the small backwards seeks libav does (variable frame
+// rate analysis in particular)
+constexpr int64_t BACK_BUFFER_SIZE = 1000000;
+
+ResourceIo::ResourceIo(ResourceIoGroup *resource_io_group, const std::string &uri, int64_t file_size, const std::string &etag) :
     m_resource_io_group(resource_io_group),
     m_uri(uri),
-    m_file_size(file_size) {
-    int m_len_buffer = 4 * 1024 * 1024;
+    m_file_size(file_size),
+    m_etag(etag) {
+    // big enough for the largest read size; reads are cut down to the read size, so what is
+    // beyond it is never touched
+    int m_len_buffer = MAX_READ_SIZE;
+    m_read_size = INITIAL_READ_SIZE;
     if (stringEndsWith(uri, ".m3u8")) {
         // do not need a large buffer for an m3u8
         m_len_buffer = 32 * 1024;
+        m_read_size = MIN_READ_SIZE;
+        m_is_playlist = true;
     }
+    m_stats.min_read_size = m_read_size;
+    m_stats.max_read_size = m_read_size;
     uint8_t * m_buffer = (unsigned char *)av_malloc(m_len_buffer);
     m_avio_context = avio_alloc_context(m_buffer, m_len_buffer, 0, this, &ResourceIo::libavRead, NULL, &ResourceIo::libavSeek);
 }
@@ -35,11 +59,18 @@ int ResourceIo::read(uint8_t *buf, int buf_size) {
         return AVERROR_EOF;
     }
 
-    int res = m_resource_io_group->read(m_uri, m_avio_context->pos, buf, buf_size);
+    // only written in this thread, so fine to look at without the lock
+    buf_size = std::min(buf_size, m_read_size);
+
+    int res = m_resource_io_group->read(this, m_avio_context->pos, buf, buf_size);
     if (res <= 0) {
         return AVERROR_EOF;
     }
 
+    if (m_is_playlist && m_avio_context->pos == (int64_t)m_playlist_data.size()) {
+        m_playlist_data.append((const char *)buf, res);
+    }
+
     return res;
 }
 
@@ -80,3 +111,127 @@ int64_t ResourceIo::seek(int64_t offset, int whence) {
     }
     return read_offset;
 }
+
+int ResourceIo::copyFromCache(int64_t read_offset, uint8_t *buf, int buf_size) {
+    if (read_offset < m_cache_offset || read_offset >= m_cache_end) {
+        return 0;
+    }
+
+    int bytes_copied = 0;
+    for (auto &block: m_blocks) {
+        int64_t block_end = block.offset + (int64_t)block.data->size();
+        if (block_end <= read_offset) {
+            continue;
+        }
+        size_t start = (size_t)(read_offset - block.offset);
+        int len_copy = (int)std::min((int64_t)(buf_size - bytes_copied), block_end - read_offset);
+        memcpy(buf + bytes_copied, block.data->data() + start, len_copy);
+        bytes_copied += len_copy;
+        read_offset += len_copy;
+        if (bytes_copied == buf_size) {
+            break;
+        }
+    }
+    return bytes_copied;
+}
+
+bool ResourceIo::isFetching(int64_t read_offset) {
+    return m_is_fetching && read_offset >= m_cache_end && read_offset < m_fetch_end;
+}
+
+void ResourceIo::resetCache(int64_t offset) {
+    m_blocks.clear();
+    m_cache_offset = offset;
+    m_cache_end = offset;
+    m_fetch_generation++;
+    m_is_fetching = false;
+    m_is_at_end = false;
+}
+
+int ResourceIo::startFetch(int count) {
+    m_is_fetching = true;
+    m_fetch_end = m_cache_end + count;
+    count_pending_fetches++;
+    return m_fetch_generation;
+}
+
+void ResourceIo::addFetchResult(int generation, bool is_success, std::vector<ReadAheadBlock> &blocks) {
+    count_pending_fetches--;
+    if (generation != m_fetch_generation) {
+        // we have moved on from where this was going
+        return;
+    }
+    m_is_fetching = false;
+
+    if (!is_success) {
+        m_is_fetch_failed = true;
+        return;
+    }
+    if (blocks.empty()) {
+        // the file is shorter than we were told, nothing more to read
+        m_is_at_end = true;
+        return;
+    }
+    for (auto &block: blocks) {
+        addCachedBlock(generation, block);
+    }
+}
+
+void ResourceIo::addCachedBlock(int generation, const ReadAheadBlock &block) {
+    if (generation != m_fetch_generation || block.offset != m_cache_end) {
+        return;
+    }
+    m_cache_end = block.offset + (int64_t)block.data->size();
+    m_blocks.push_back(block);
+    m_stats.bytes_cached += (int64_t)block.data->size();
+}
+
+int ResourceIo::trimAndGetPrefetchCount(int64_t read_end) {
+    while (!m_blocks.empty()) {
+        auto &block = m_blocks.front();
+        int64_t block_end = block.offset + (int64_t)block.data->size();
+        if (block_end >= read_end - BACK_BUFFER_SIZE) {
+            break;
+        }
+        m_cache_offset = block_end;
+        m_blocks.pop_front();
+    }
+
+    if (m_is_fetching || m_is_at_end || m_cache_end >= m_file_size) {
+        return 0;
+    }
+    int64_t cached_ahead = m_cache_end - read_end;
+    if (cached_ahead >= m_read_size) {
+        return 0;
+    }
+    return (int)std::min((int64_t)m_read_size * READ_AHEAD_FACTOR - cached_ahead, m_file_size - m_cache_end);
+}
+
+void ResourceIo::trackRead(int64_t read_offset) {
+    if (read_offset == m_run_end) {
+        return;
+    }
+
+    m_stats.count_seeks++;
+    if (m_run_end - m_run_start < m_read_size) {
+        // most of what was fetched for that run was never used
+        setReadSize(m_read_size / 2);
+    }
+    m_run_start = read_offset;
+    m_run_end = read_offset;
+}
+
+void ResourceIo::addBytesRead(int len) {
+    m_stats.count_reads++;
+    m_stats.bytes_read += len;
+    m_run_end += len;
+    if (m_run_end - m_run_start >= (int64_t)m_read_size * GROW_RUN_FACTOR) {
+        setReadSize(m_read_size * 2);
+    }
+}
+
+void ResourceIo::setReadSize(int read_size) {
+    m_read_size = std::max(MIN_READ_SIZE, std::min(MAX_READ_SIZE, read_size));
+    m_stats.min_read_size = std::min(m_stats.min_read_size, m_read_size);
+    m_stats.max_read_size = std::max(m_stats.max_read_size, m_read_size);
+}
@@ -4,7 +4,11 @@
 
 #pragma once
 
+#include <algorithm>
+#include <deque>
+#include <memory>
 #include <unordered_set>
+#include <vector>
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -15,12 +19,57 @@ extern "C" {
 #include "../private/utils.h"
 
 #include "../utils.h"
+#include "../uv_mutex_lock.h"
+
+#include "./shared_block_cache.h"
 
 class ResourceIoGroup;
 
+struct ReadAheadBlock {
+    int64_t offset;
+    // possibly shared with SharedBlockCache, so never modified
+    std::shared_ptr<const BlockData> data;
+};
+
+// what a ResourceIo (or all of a ResourceIoGroup's) did, see WrappedVideoReader::getIoStats
+struct ResourceIoStats {
+    void add(const ResourceIoStats &other) {
+        count_reads += other.count_reads;
+        count_seeks += other.count_seeks;
+        bytes_cached += other.bytes_cached;
+        bytes_read += other.bytes_read;
+        if (other.min_read_size > 0 && (min_read_size == 0 || other.min_read_size < min_read_size)) {
+            min_read_size = other.min_read_size;
+        }
+        max_read_size = std::max(max_read_size, other.max_read_size);
+    }
+
+    int64_t count_reads = 0;
+    // reads that didn't continue from where the last one ended
+    int64_t count_seeks = 0;
+    // brought into the read cache, whether fetched or found in SharedBlockCache; what is
+    // beyond bytes_read was never used
+    int64_t bytes_cached = 0;
+    // handed to libav
+    int64_t bytes_read = 0;
+    // range the adaptive read size went through
+    int min_read_size = 0;
+    int max_read_size = 0;
+};
+
+// libav reads are served from a native cache of blocks fetched from javascript. Ahead of the
+// read position the cache is kept filled by asynchronous fetches, so most reads never wait on
+// the js thread; a little behind it is kept too, since libav often steps back a short way.
+// Blocks are looked for in SharedBlockCache before being fetched, and fetched ones go into it.
+//
+// How much is fetched at a time, kept ahead, and handed to libav per read adapts to how the
+// file is being read: it shrinks when libav seeks away before using what was fetched (thumbnails)
+// and grows over long sequential runs (remuxing), between MIN_READ_SIZE and MAX_READ_SIZE.
+//
+// Everything about the cache is guarded by the ResourceIoGroup mutex.
 class ResourceIo {
 public:
-    ResourceIo(ResourceIoGroup *resource_io_group, const std::string &uri, int64_t file_size);
+    ResourceIo(ResourceIoGroup *resource_io_group, const std::string &uri, int64_t file_size, const std::string &etag);
     ~ResourceIo();
 
     AVIOContext * getAvioContext() {
@@ -31,6 +80,24 @@ public:
         return m_uri;
     }
 
+    int64_t getFileSize() {
+        return m_file_size;
+    }
+
+    // empty if javascript didn't give one
+    const std::string & getEtag() {
+        return m_etag;
+    }
+
+    // for an hls playlist, everything read from it so far; see ResourceIoGroup::parseHlsPlaylist
+    const std::string & getPlaylistData() {
+        return m_playlist_data;
+    }
+
+    bool isPlaylist() {
+        return m_is_playlist;
+    }
+
     static int libavRead(void *this_ptr, uint8_t *buf, int buf_size) {
         return static_cast<ResourceIo *>(this_ptr)->read(buf, buf_size);
     }
@@ -39,13 +106,95 @@ public:
         return static_cast<ResourceIo *>(this_ptr)->seek(offset, whence);
     }
 
+    int64_t getCacheEnd() {
+        return m_cache_end;
+    }
+
+    int64_t getCacheSize() {
+        return m_cache_end - m_cache_offset;
+    }
+
+    // copies whatever is cached starting at read_offset, returns 0 if read_offset isn't cached
+    int copyFromCache(int64_t read_offset, uint8_t *buf, int buf_size);
+    // true if the fetch in flight will bring in read_offset
+    bool isFetching(int64_t read_offset);
+    // throws away the cache (and the results of any fetch in flight) to start again at offset
+    void resetCache(int64_t offset);
+    int getFetchGeneration() {
+        return m_fetch_generation;
+    }
+    // starts a fetch of count bytes at the end of the cache; returns the generation to pass to
+    // addFetchResult
+    int startFetch(int count);
+    // adds the result of a fetch, in order
+    void addFetchResult(int generation, bool is_success, std::vector<ReadAheadBlock> &blocks);
+    // adds a block that didn't need fetching, at the end of the cache
+    void addCachedBlock(int generation, const ReadAheadBlock &block);
+    // drops what is too far behind read_end, and returns how much to read ahead, if anything
+    int trimAndGetPrefetchCount(int64_t read_end);
+
+    bool isFetchFailed() {
+        return m_is_fetch_failed;
+    }
+
+    // true if javascript had nothing more to give at read_offset
+    bool isAtEnd(int64_t read_offset) {
+        return m_is_at_end && read_offset >= m_cache_end;
+    }
+
+    // called before serving a read at read_offset, and with what was served
+    void trackRead(int64_t read_offset);
+    void addBytesRead(int len);
+    int getReadSize() {
+        return m_read_size;
+    }
+
+    const ResourceIoStats & getStats() {
+        return m_stats;
+    }
+
+    // signalled when a fetch comes back
+    uv_cond_t * getCond() {
+        return m_cond.get();
+    }
+
+    // fetches of this or any earlier generation still waiting on javascript
+    int count_pending_fetches = 0;
+
 private:
     ResourceIoGroup *m_resource_io_group;
     std::string m_uri;
     int64_t m_file_size;
+    std::string m_etag;
 
     AVIOContext *m_avio_context;
 
+    bool m_is_playlist = false;
+    std::string m_playlist_data;
+
+    // contiguous, covering [m_cache_offset, m_cache_end)
+    std::deque<ReadAheadBlock> m_blocks;
+    int64_t m_cache_offset = 0;
+    int64_t m_cache_end = 0;
+
+    // bumped on every reset, so fetches for a range we moved away from are ignored
+    int m_fetch_generation = 0;
+    bool m_is_fetching = false;
+    int64_t m_fetch_end = 0;
+    bool m_is_fetch_failed = false;
+    bool m_is_at_end = false;
+
+    int m_read_size;
+    // the sequential run libav is reading, since its last seek
+    int64_t m_run_start = 0;
+    int64_t m_run_end = 0;
+
+    ResourceIoStats m_stats;
+
+    UvCond m_cond;
+
+    void setReadSize(int read_size);
+
     int read(uint8_t *buf, int buf_size);
     int64_t seek(int64_t offset, int whence);
 };
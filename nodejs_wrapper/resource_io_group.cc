@@ -4,40 +4,182 @@
 
 #include "../uv_mutex_lock.h"
 
+#include "disk_block_cache.h"
+#include "pinned_js_buffer.h"
 #include "resource_io_group.h"
+#include "worker_pool.h"
 
 using namespace Avalanche;
 
+// shared by the waiting thread and javascript, either of which may be done with it first
 struct OpenFileContext {
-    OpenFileContext(ResourceIoGroup *resource_io_group) :
+    OpenFileContext(std::shared_ptr<ResourceIoGroup> resource_io_group) :
         resource_io_group(resource_io_group) {
     }
-    ResourceIoGroup *resource_io_group = nullptr;
+    std::shared_ptr<ResourceIoGroup> resource_io_group;
+    UvCond cond;
     bool is_done = false;
     bool success = false;
     int64_t file_size = 0;
+    std::string etag;
 };
 
-typedef std::vector<std::pair<uint8_t *, int>> BufferVector;
+struct FetchContext;
 
-struct ReadFileContext {
-    ReadFileContext(ResourceIoGroup *resource_io_group) :
+// one range of a fetch; each is asked of javascript separately so they come in in parallel
+struct FetchPart {
+    FetchPart(FetchContext *fetch_context, int64_t offset, int count) :
+        fetch_context(fetch_context),
+        offset(offset),
+        count(count) {
+    }
+    FetchContext *fetch_context = nullptr;
+    int64_t offset;
+    int count;
+    // SharedBlockCache claims on the blocks of this part, in order from offset
+    std::vector<std::pair<std::string, uint64_t>> claims;
+    bool is_success = false;
+    std::vector<ReadAheadBlock> blocks;
+};
+
+struct FetchContext {
+    FetchContext(std::shared_ptr<ResourceIoGroup> resource_io_group, ResourceIo *resource_io, const std::string &uri, int64_t file_size, int generation) :
+        resource_io_group(resource_io_group),
+        resource_io(resource_io),
+        uri(uri),
+        file_size(file_size),
+        generation(generation) {
+    }
+
+    // splits count bytes at offset into parts, one per claimed block; takes over the claims
+    void addParts(int64_t offset, int count, std::vector<std::pair<std::string, uint64_t>> &claims) {
+        int64_t end = offset + count;
+        parts.reserve(claims.size() + 1);
+        for (auto &claim: claims) {
+            int64_t part_end = std::min(end, offset + SharedBlockCache::BLOCK_SIZE);
+            parts.emplace_back(this, offset, (int)(part_end - offset));
+            parts.back().claims.push_back(claim);
+            offset = part_end;
+        }
+        claims.clear();
+        if (offset < end) {
+            parts.emplace_back(this, offset, (int)(end - offset));
+        }
+    }
+
+    // keeps resource_io around too, see ResourceIoGroup
+    std::shared_ptr<ResourceIoGroup> resource_io_group;
+    // null for an hls prefetch, which only fills SharedBlockCache
+    ResourceIo *resource_io = nullptr;
+    std::string uri;
+    int64_t file_size;
+    int generation;
+    // in order and contiguous; never added to once handed to javascript
+    std::vector<FetchPart> parts;
+    size_t count_parts_done = 0;
+};
+
+// shared by the waiting thread and javascript, like OpenFileContext
+struct OpenOutputFileContext {
+    OpenOutputFileContext(std::shared_ptr<ResourceIoGroup> resource_io_group) :
         resource_io_group(resource_io_group) {
     }
-    ResourceIoGroup *resource_io_group = nullptr;
+    std::shared_ptr<ResourceIoGroup> resource_io_group;
+    UvCond cond;
     bool is_done = false;
     bool success = false;
-    BufferVector buffer_vector;
+    // "file", "stream" or "memory"
+    std::string mode;
+};
+
+// shared by the waiting thread and javascript, like OpenFileContext
+struct CloseFileContext {
+    CloseFileContext(std::shared_ptr<ResourceIoGroup> resource_io_group) :
+        resource_io_group(resource_io_group) {
+    }
+    std::shared_ptr<ResourceIoGroup> resource_io_group;
+    UvCond cond;
+    bool is_done = false;
+};
+
+struct WriteFileContext {
+    WriteFileContext(std::shared_ptr<ResourceIoGroup> resource_io_group, ResourceOutputIo *resource_output_io) :
+        resource_io_group(resource_io_group),
+        resource_output_io(resource_output_io) {
+    }
+    // keeps resource_output_io around too, see ResourceIoGroup
+    std::shared_ptr<ResourceIoGroup> resource_io_group;
+    ResourceOutputIo *resource_output_io = nullptr;
+};
+
+// chunks handed to javascript that haven't been written yet; beyond this writers wait
+constexpr int MAX_PENDING_OUTPUT_WRITES = 2;
+
+// fetched blocks at least this big point into the javascript buffer they came in rather than
+// being copied out of it
+constexpr int64_t MIN_PIN_SIZE = 64 * 1024;
+
+// hls segments opened and fetched ahead of the one libav is reading, unless the resource io
+// object sets hlsPrefetchSegments / hlsPrefetchBytes
+constexpr int DEFAULT_HLS_PREFETCH_SEGMENTS = 3;
+constexpr int64_t DEFAULT_HLS_PREFETCH_BYTES = 64 * 1024 * 1024;
+
+struct PrefetchOpenFileContext {
+    PrefetchOpenFileContext(std::shared_ptr<ResourceIoGroup> resource_io_group, const std::string &uri, int open_id) :
+        resource_io_group(resource_io_group),
+        uri(uri),
+        open_id(open_id) {
+    }
+    std::shared_ptr<ResourceIoGroup> resource_io_group;
+    std::string uri;
+    // of the HlsPrefetch it was made for
+    int open_id;
 };
 
+// openFile() resolves to the file size, or to { size, etag } when there is an etag (or
+// anything else that changes when the file does), or null if the file can't be opened
+static bool getOpenFileResult(const Napi::Value &value, int64_t &file_size, std::string &etag) {
+    if (value.IsNumber()) {
+        file_size = value.As<Napi::Number>().Int64Value();
+        return file_size >= 0;
+    }
+    if (!value.IsObject()) {
+        return false;
+    }
+    Napi::Object obj = value.As<Napi::Object>();
+    if (!obj.Get("size").IsNumber()) {
+        return false;
+    }
+    file_size = obj.Get("size").As<Napi::Number>().Int64Value();
+    if (obj.Get("etag").IsString()) {
+        etag = obj.Get("etag").As<Napi::String>();
+    }
+    return file_size >= 0;
+}
+
 ResourceIoGroup::ResourceIoGroup(const Napi::Object &resource_io_obj):
     m_resource_io_obj_ref(Napi::Persistent(resource_io_obj)) {
 
     auto env = resource_io_obj.Env();
 
+    if (resource_io_obj.Has("uriPrefix") && resource_io_obj.Get("uriPrefix").IsString()) {
+        m_uri_prefix = resource_io_obj.Get("uriPrefix").As<Napi::String>();
+    }
+
+    m_hls_prefetch_segments = DEFAULT_HLS_PREFETCH_SEGMENTS;
+    if (resource_io_obj.Has("hlsPrefetchSegments") && resource_io_obj.Get("hlsPrefetchSegments").IsNumber()) {
+        m_hls_prefetch_segments = resource_io_obj.Get("hlsPrefetchSegments").As<Napi::Number>().Int32Value();
+    }
+    m_hls_prefetch_bytes = DEFAULT_HLS_PREFETCH_BYTES;
+    if (resource_io_obj.Has("hlsPrefetchBytes") && resource_io_obj.Get("hlsPrefetchBytes").IsNumber()) {
+        m_hls_prefetch_bytes = resource_io_obj.Get("hlsPrefetchBytes").As<Napi::Number>().Int64Value();
+    }
+
     Napi::Function open_file_func = resource_io_obj.Get("openFile").As<Napi::Function>();
     Napi::Function close_file_func = resource_io_obj.Get("closeFile").As<Napi::Function>();
     Napi::Function read_file_func = resource_io_obj.Get("readFile").As<Napi::Function>();
+    // optional, otherwise ranges are asked for one readFile() at a time
+    m_has_read_file_ranges = resource_io_obj.Has("readFileRanges") && resource_io_obj.Get("readFileRanges").IsFunction();
 
     // we unref all these functions immediately so they don't prevent the main js loop from exiting
 
@@ -53,6 +195,26 @@ ResourceIoGroup::ResourceIoGroup(const Napi::Object &resource_io_obj):
     m_read_file_func = Napi::ThreadSafeFunction::New(env, read_file_func, "read_file_func", 0, 1, finalizer_read_file);
     m_read_file_func.Unref(env);
 
+    if (resource_io_obj.Has("openOutputFile")) {
+        m_has_output = true;
+
+        Napi::Function open_output_file_func = resource_io_obj.Get("openOutputFile").As<Napi::Function>();
+        Napi::Function write_file_func = resource_io_obj.Get("writeFile").As<Napi::Function>();
+        Napi::Function close_output_file_func = resource_io_obj.Get("closeOutputFile").As<Napi::Function>();
+
+        auto finalizer_open_output_file = [](const Napi::Env &) {};
+        m_open_output_file_func = Napi::ThreadSafeFunction::New(env, open_output_file_func, "open_output_file_func", 0, 1, finalizer_open_output_file);
+        m_open_output_file_func.Unref(env);
+
+        auto finalizer_write_file = [](const Napi::Env &) {};
+        m_write_file_func = Napi::ThreadSafeFunction::New(env, write_file_func, "write_file_func", 0, 1, finalizer_write_file);
+        m_write_file_func.Unref(env);
+
+        auto finalizer_close_output_file = [](const Napi::Env &) {};
+        m_close_output_file_func = Napi::ThreadSafeFunction::New(env, close_output_file_func, "close_output_file_func", 0, 1, finalizer_close_output_file);
+        m_close_output_file_func.Unref(env);
+    }
+
     int ret;
 
     ret = uv_mutex_init(&m_mutex);
@@ -60,23 +222,30 @@ ResourceIoGroup::ResourceIoGroup(const Napi::Object &resource_io_obj):
         log(LOG_ERROR, "UvMutexInitFailed %i", ret);
         return;
     }
-    ret = uv_cond_init(&m_cond);
-    if (ret != 0) {
-        log(LOG_ERROR, "UvCondInitFailed %i", ret);
-        return;
-    }
 }
 
 ResourceIoGroup::~ResourceIoGroup() {
     //printf("ResourceIoGroup::~ResourceIoGroup\n");
 
+    // every prefetch open has been answered by now, since each holds a reference to us
+    for (auto &entry: m_hls_prefetches) {
+        if (entry.second.file_size >= 0) {
+            closePrefetchedFileInJs(entry.first);
+        }
+    }
+    m_hls_prefetches.clear();
+
     for (auto resource_io: m_resource_ios) {
         delete resource_io;
     }
     m_resource_ios.clear();
 
+    for (auto resource_output_io: m_resource_output_ios) {
+        delete resource_output_io;
+    }
+    m_resource_output_ios.clear();
+
     uv_mutex_destroy(&m_mutex);
-    uv_cond_destroy(&m_cond);
 
     m_resource_io_obj_ref.Unref();
 }
@@ -84,41 +253,64 @@ ResourceIoGroup::~ResourceIoGroup() {
 void ResourceIoGroup::setStopProcessing() {
     //printf("ResourceIoGroup::setStopProcessing\n");
 
-    m_allow_processing = false;
-    uv_cond_signal(&m_cond);
+    lock([this]() {
+        m_allow_processing = false;
+        for (auto cond: m_waiting_conds) {
+            uv_cond_signal(cond);
+        }
+        for (auto &waiting_fiber: m_waiting_fibers) {
+            waiting_fiber.second();
+        }
+        m_waiting_fibers.clear();
+    });
+
+    // our fetches may never come back, so let other readers waiting on them fetch for themselves
+    std::vector<std::pair<std::string, uint64_t>> claims;
+    lock([this, &claims]() {
+        for (auto fetch_context: m_fetch_contexts) {
+            for (auto &fetch_part: fetch_context->parts) {
+                claims.insert(claims.end(), fetch_part.claims.begin(), fetch_part.claims.end());
+                fetch_part.claims.clear();
+            }
+        }
+    });
+    for (auto &claim: claims) {
+        SharedBlockCache::getInstance().complete(claim.first, claim.second, nullptr);
+    }
 }
 
 Napi::Value ResourceIoGroup::wrappedOpenFileResolveHandler(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
 
+    // the waiting thread may have given up on it already, so this holds its own reference
+    auto data = (std::shared_ptr<OpenFileContext> *)info.Data();
+    std::shared_ptr<OpenFileContext> open_file_context = *data;
+    delete data;
+
     if (info.Length() != 1) {
         std::string err = "Wrong number of arguments " + info.Length();
         Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
         return env.Null();
     }
 
-    if (!info[0].IsNull() && !info[0].IsNumber()) {
+    if (!info[0].IsNull() && !info[0].IsNumber() && !info[0].IsObject()) {
         Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
         return env.Null();
     }
 
-    Napi::Value val_resolve = info[0];
-
-    auto open_file_context = (OpenFileContext *)info.Data();
+    int64_t file_size = 0;
+    std::string etag;
+    bool success = getOpenFileResult(info[0], file_size, etag);
 
-    open_file_context->resource_io_group->lock([open_file_context, &val_resolve] {
-        if (val_resolve.IsNull()) {
-            open_file_context->success = false;
-            open_file_context->file_size = 0;
-        } else {
-            open_file_context->success = true;
-            open_file_context->file_size = val_resolve.As<Napi::Number>().Int64Value();
-        }
+    open_file_context->resource_io_group->lock([open_file_context, success, file_size, &etag] {
+        open_file_context->success = success;
+        open_file_context->file_size = success ? file_size : 0;
+        open_file_context->etag = etag;
 
         open_file_context->is_done = true;
+        open_file_context->resource_io_group->signalLocked(open_file_context->cond.get());
     });
-    uv_cond_signal(&open_file_context->resource_io_group->m_cond);
 
     return env.Null();
 }
@@ -129,6 +321,31 @@ AVIOContext * ResourceIoGroup::open(const std::string &uri) {
     }
     //printf("ResourceIoGroup::open %s\n", uri.c_str());
 
+    // an hls segment javascript has already opened for us. One it is still opening is opened
+    // again here, and the prefetch open closes itself when it finds its entry gone
+    int64_t prefetched_file_size = -1;
+    std::string prefetched_etag;
+    lock([this, &uri, &prefetched_file_size, &prefetched_etag]() {
+        auto it = m_hls_prefetches.find(uri);
+        if (it == m_hls_prefetches.end()) {
+            return;
+        }
+        prefetched_file_size = it->second.file_size;
+        prefetched_etag = it->second.etag;
+        if (it->second.is_fetch_started) {
+            m_hls_prefetched_bytes -= it->second.file_size;
+        }
+        m_hls_prefetches.erase(it);
+    });
+    if (prefetched_file_size >= 0) {
+        auto resource_io = new ResourceIo(this, uri, prefetched_file_size, prefetched_etag);
+        lock([this, resource_io]() {
+            m_resource_ios.insert(resource_io);
+        });
+        startHlsPrefetch(uri);
+        return resource_io->getAvioContext();
+    }
+
     napi_status status;
 
     status = m_open_file_func.Acquire();
@@ -137,9 +354,9 @@ AVIOContext * ResourceIoGroup::open(const std::string &uri) {
         return NULL;
     }
 
-    auto open_file_context = OpenFileContext(this);
+    auto open_file_context = std::make_shared<OpenFileContext>(shared_from_this());
 
-    status = m_open_file_func.BlockingCall([this, uri, &open_file_context](const Napi::Env &env, const Napi::Function &js_func) {
+    status = m_open_file_func.BlockingCall([this, uri, open_file_context](const Napi::Env &env, const Napi::Function &js_func) {
         // this code is run in the main js thread
         Napi::HandleScope scope(env);
 
@@ -149,7 +366,7 @@ AVIOContext * ResourceIoGroup::open(const std::string &uri) {
         // connect a callback to the promise resolve
         Napi::Promise promise = result.As<Napi::Promise>();
         Napi::Function then_func = promise.Get("then").As<Napi::Function>();
-        auto data = (void *)&open_file_context;
+        auto data = new std::shared_ptr<OpenFileContext>(open_file_context);
         Napi::Function resolve_handler_func = Napi::Function::New(env, ResourceIoGroup::wrappedOpenFileResolveHandler, "openFileResolve", data);
         then_func.Call(promise, {resolve_handler_func});
     });
@@ -167,23 +384,27 @@ AVIOContext * ResourceIoGroup::open(const std::string &uri) {
         return NULL;
     }
 
-    lock([this, uri, &open_file_context]() {
-        while (!open_file_context.is_done && m_allow_processing) {
-            uv_cond_wait(&m_cond, &m_mutex);
-        }
+    lock([this, open_file_context]() {
+        waitLocked(open_file_context->cond.get(), [open_file_context]() {
+            return open_file_context->is_done;
+        });
     });
 
     if (!m_allow_processing) {
         return NULL;
     }
 
-    if (!open_file_context.success) {
+    if (!open_file_context->success) {
         m_allow_processing = false;
         return NULL;
     }
 
-    auto resource_io = new ResourceIo(this, uri, open_file_context.file_size);
-    m_resource_ios.insert(resource_io);
+    auto resource_io = new ResourceIo(this, uri, open_file_context->file_size, open_file_context->etag);
+    lock([this, resource_io]() {
+        m_resource_ios.insert(resource_io);
+    });
+
+    startHlsPrefetch(uri);
 
     //printf("ResourceIoGroup::open %s returning\n", uri.c_str());
 
@@ -202,12 +423,28 @@ void ResourceIoGroup::close(void *opaque) {
 
     //printf("ResourceIoGroup::close of uri %s\n", uri.c_str());
 
-    m_resource_ios.erase(resource_io);
-    delete resource_io;
+    // read-ahead still in flight will come back to this resource io
+    lock([this, resource_io]() {
+        waitLocked(resource_io->getCond(), [resource_io]() {
+            return resource_io->count_pending_fetches == 0;
+        });
+    });
+    if (!m_allow_processing) {
+        // fetches may never finish now, so leave it for the destructor, which isn't run until
+        // javascript has answered them
+        return;
+    }
+
+    if (resource_io->isPlaylist() && (int64_t)resource_io->getPlaylistData().size() == resource_io->getFileSize()) {
+        parseHlsPlaylist(uri, resource_io->getPlaylistData());
+    }
 
-    lock([this, &uri]() {
+    lock([this, resource_io, &uri]() {
+        m_closed_stats.add(resource_io->getStats());
+        m_resource_ios.erase(resource_io);
         m_file_sizes.erase(uri);
     });
+    delete resource_io;
 
     // tell javascript to close the file
 
@@ -219,10 +456,10 @@ void ResourceIoGroup::close(void *opaque) {
         return;
     }
 
-    bool is_done = false;
+    auto close_file_context = std::make_shared<CloseFileContext>(shared_from_this());
 
     //printf("acquired close file func, going to start call into js thread\n");
-    status = m_close_file_func.BlockingCall([this, uri, &is_done](const Napi::Env &env, const Napi::Function &js_func) {
+    status = m_close_file_func.BlockingCall([this, uri, close_file_context](const Napi::Env &env, const Napi::Function &js_func) {
         // this code is run in the main js thread
         //printf("ResourceIoGroup::close js thread of uri %s\n", uri.c_str());
         Napi::HandleScope scope(env);
@@ -231,11 +468,10 @@ void ResourceIoGroup::close(void *opaque) {
 
         js_func.Call(m_resource_io_obj_ref.Value(), {val_uri});
 
-        lock([&is_done]() {
-            is_done = true;
+        lock([this, close_file_context]() {
+            close_file_context->is_done = true;
+            signalLocked(close_file_context->cond.get());
         });
-
-        uv_cond_signal(&m_cond);
     });
 
     if (status != napi_ok) {
@@ -251,15 +487,36 @@ void ResourceIoGroup::close(void *opaque) {
         return;
     }
 
-    lock([this, &is_done]() {
-        while (!is_done && m_allow_processing) {
-            uv_cond_wait(&m_cond, &m_mutex);
-        }
+    lock([this, close_file_context]() {
+        waitLocked(close_file_context->cond.get(), [close_file_context]() {
+            return close_file_context->is_done;
+        });
     });
 
     //printf("ResourceIoGroup::close %s returning\n", uri.c_str());
 };
 
+ResourceIoStats ResourceIoGroup::getStats() {
+    ResourceIoStats stats;
+    lock([this, &stats]() {
+        stats = m_closed_stats;
+        for (auto resource_io: m_resource_ios) {
+            stats.add(resource_io->getStats());
+        }
+    });
+    return stats;
+}
+
+int64_t ResourceIoGroup::getCacheSize() {
+    int64_t cache_size = 0;
+    lock([this, &cache_size]() {
+        for (auto resource_io: m_resource_ios) {
+            cache_size += resource_io->getCacheSize();
+        }
+    });
+    return cache_size;
+}
+
 int ResourceIoGroup::interruptCallback() {
     if (!m_allow_processing) {
         printf("ResourceIoGroup::interruptCallback returning 1\n");
@@ -272,119 +529,1006 @@ Napi::Value ResourceIoGroup::wrappedReadFileResolveHandler(const Napi::CallbackI
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
 
+    auto fetch_part = (FetchPart *)info.Data();
+    auto fetch_context = fetch_part->fetch_context;
+
+    // null, or the error of a rejected promise, means the read failed
+    bool is_success = info.Length() == 1 && info[0].IsArray();
+    std::vector<ReadAheadBlock> blocks;
+    if (is_success) {
+        auto buffer_arr(info[0].As<Napi::Array>());
+        std::vector<Napi::Buffer<uint8_t>> buffers;
+        int64_t len = 0;
+        for (uint32_t i = 0; i < buffer_arr.Length(); i++) {
+            buffers.push_back(buffer_arr.Get(i).As<Napi::Buffer<uint8_t>>());
+            len += buffers.back().Length();
+        }
+
+        // cut into blocks along SharedBlockCache block boundaries. A block that lies within one
+        // of the javascript buffers just points into it, keeping the buffer alive, instead of
+        // being copied; only small blocks and ones spanning buffers get their own copy
+        std::vector<std::shared_ptr<const BlockData>> block_datas;
+        std::vector<std::shared_ptr<void>> buffer_owners(buffers.size());
+        size_t buffer_index = 0;
+        // offset of the start of buffers[buffer_index] in the file
+        int64_t buffer_offset = fetch_part->offset;
+        int64_t offset = fetch_part->offset;
+        int64_t end = offset + len;
+        while (offset < end) {
+            int64_t block_end = std::min(end, (offset / SharedBlockCache::BLOCK_SIZE + 1) * SharedBlockCache::BLOCK_SIZE);
+            while (buffer_offset + (int64_t)buffers[buffer_index].Length() <= offset) {
+                buffer_offset += (int64_t)buffers[buffer_index].Length();
+                buffer_index++;
+            }
+
+            auto &buffer = buffers[buffer_index];
+            if (block_end <= buffer_offset + (int64_t)buffer.Length() && block_end - offset >= MIN_PIN_SIZE) {
+                auto &owner = buffer_owners[buffer_index];
+                if (!owner) {
+                    owner = pinJsBuffer(buffer);
+                }
+                block_datas.push_back(std::make_shared<BlockData>(owner, buffer.Length(), buffer.Data() + (offset - buffer_offset), (size_t)(block_end - offset)));
+                offset = block_end;
+                continue;
+            }
+
+            auto data = std::make_shared<BlockData>((size_t)(block_end - offset));
+            size_t block_pos = 0;
+            while (offset < block_end) {
+                auto &buffer = buffers[buffer_index];
+                int64_t buffer_end = buffer_offset + (int64_t)buffer.Length();
+                size_t len_copy = (size_t)(std::min(block_end, buffer_end) - offset);
+                memcpy(data->data() + block_pos, buffer.Data() + (offset - buffer_offset), len_copy);
+                block_pos += len_copy;
+                offset += (int64_t)len_copy;
+                if (offset == buffer_end && offset < end) {
+                    buffer_offset = buffer_end;
+                    buffer_index++;
+                }
+            }
+            block_datas.push_back(data);
+        }
+
+        offset = fetch_part->offset;
+        for (auto &data: block_datas) {
+            blocks.push_back(ReadAheadBlock { offset, data });
+            offset += (int64_t)data->size();
+        }
+    }
+
+    auto resource_io_group = fetch_context->resource_io_group.get();
+    std::vector<std::pair<std::string, uint64_t>> claims;
+    bool is_fetch_done = false;
+    resource_io_group->lock([resource_io_group, fetch_part, fetch_context, is_success, &blocks, &claims, &is_fetch_done] {
+        claims.swap(fetch_part->claims);
+        fetch_part->is_success = is_success;
+        fetch_part->blocks = blocks;
+        fetch_context->count_parts_done++;
+        if (fetch_context->count_parts_done < fetch_context->parts.size()) {
+            return;
+        }
+
+        is_fetch_done = true;
+        resource_io_group->m_fetch_contexts.erase(fetch_context);
+        auto resource_io = fetch_context->resource_io;
+        if (!resource_io) {
+            return;
+        }
+        // put the parts back together; after a failed or short part there is a gap, so the
+        // rest is dropped, and only fails the fetch if there is nothing before it
+        bool is_fetch_success = true;
+        std::vector<ReadAheadBlock> fetch_blocks;
+        for (auto &part: fetch_context->parts) {
+            if (!part.is_success) {
+                is_fetch_success = !fetch_blocks.empty();
+                break;
+            }
+            fetch_blocks.insert(fetch_blocks.end(), part.blocks.begin(), part.blocks.end());
+            if (fetch_blocks.empty() || fetch_blocks.back().offset + (int64_t)fetch_blocks.back().data->size() != part.offset + part.count) {
+                break;
+            }
+        }
+        resource_io->addFetchResult(fetch_context->generation, is_fetch_success, fetch_blocks);
+        resource_io_group->signalLocked(resource_io->getCond());
+    });
+
+    // only whole blocks (or the end of the file) are shared; anything else is given back for
+    // the next reader to fetch
+    int64_t file_size = fetch_context->file_size;
+    for (size_t i = 0; i < claims.size(); i++) {
+        std::shared_ptr<const BlockData> data;
+        if (i < blocks.size()) {
+            auto &block = blocks[i];
+            int64_t block_end = block.offset + (int64_t)block.data->size();
+            if ((int64_t)block.data->size() == SharedBlockCache::BLOCK_SIZE || block_end == file_size) {
+                data = block.data;
+            }
+        }
+        SharedBlockCache::getInstance().complete(claims[i].first, claims[i].second, data);
+        if (data) {
+            DiskBlockCache::getInstance().store(claims[i].first, data);
+        }
+    }
+
+    if (is_fetch_done) {
+        delete fetch_context;
+    }
+
+    return env.Null();
+}
+
+void ResourceIoGroup::failFetch(FetchContext *fetch_context) {
+    std::vector<ReadAheadBlock> no_blocks;
+    lock([this, fetch_context, &no_blocks]() {
+        if (fetch_context->resource_io) {
+            fetch_context->resource_io->addFetchResult(fetch_context->generation, false, no_blocks);
+            signalLocked(fetch_context->resource_io->getCond());
+        }
+    });
+    for (auto &fetch_part: fetch_context->parts) {
+        for (auto &claim: fetch_part.claims) {
+            SharedBlockCache::getInstance().complete(claim.first, claim.second, nullptr);
+        }
+    }
+    delete fetch_context;
+}
+
+bool ResourceIoGroup::fetch(ResourceIo *resource_io, const std::string &uri, int64_t file_size, int generation, int64_t offset, int count, std::vector<std::pair<std::string, uint64_t>> &claims) {
+    auto fetch_context = new FetchContext(shared_from_this(), resource_io, uri, file_size, generation);
+    fetch_context->addParts(offset, count, claims);
+    std::vector<FetchContext *> fetch_contexts { fetch_context };
+    return fetchBatch(fetch_contexts);
+}
+
+bool ResourceIoGroup::fetchBatch(std::vector<FetchContext *> &fetch_contexts) {
+    //printf("ResourceIoGroup::fetchBatch %zu\n", fetch_contexts.size());
+
+    if (fetch_contexts.empty()) {
+        return true;
+    }
+
+    napi_status status;
+
+    status = m_read_file_func.Acquire();
+    if (status != napi_ok) {
+        printf("failed to acquire request data %i\n", status);
+        for (auto fetch_context: fetch_contexts) {
+            failFetch(fetch_context);
+        }
+        return false;
+    }
+
+    lock([this, &fetch_contexts]() {
+        m_fetch_contexts.insert(fetch_contexts.begin(), fetch_contexts.end());
+    });
+
+    status = m_read_file_func.BlockingCall([this, fetch_contexts](const Napi::Env &env, const Napi::Function &js_func) {
+        // this code is run in the main js thread
+        Napi::HandleScope scope(env);
+
+        std::vector<FetchPart *> fetch_parts;
+        for (auto fetch_context: fetch_contexts) {
+            for (auto &fetch_part: fetch_context->parts) {
+                fetch_parts.push_back(&fetch_part);
+            }
+        }
+
+        Napi::Object resource_io_obj = m_resource_io_obj_ref.Value();
+        // a promise for each part, unless javascript misbehaves
+        std::vector<Napi::Value> results;
+        if (m_has_read_file_ranges) {
+            // all of them in one call, for javascript to fetch at the same time
+            Napi::Array ranges = Napi::Array::New(env, fetch_parts.size());
+            for (size_t i = 0; i < fetch_parts.size(); i++) {
+                Napi::Array range = Napi::Array::New(env, 3);
+                range.Set((uint32_t)0, Napi::String::New(env, fetch_parts[i]->fetch_context->uri));
+                range.Set((uint32_t)1, Napi::Number::New(env, fetch_parts[i]->offset));
+                range.Set((uint32_t)2, Napi::Number::New(env, fetch_parts[i]->count));
+                ranges.Set((uint32_t)i, range);
+            }
+            Napi::Function read_file_ranges_func = resource_io_obj.Get("readFileRanges").As<Napi::Function>();
+            Napi::Value result = read_file_ranges_func.Call(resource_io_obj, {ranges});
+            if (env.IsExceptionPending()) {
+                log(LOG_ERROR, "readFileRanges threw %s\n", env.GetAndClearPendingException().Message().c_str());
+            }
+            if (result.IsArray()) {
+                Napi::Array result_arr = result.As<Napi::Array>();
+                for (uint32_t i = 0; i < result_arr.Length() && i < fetch_parts.size(); i++) {
+                    results.push_back(result_arr.Get(i));
+                }
+            }
+        } else {
+            for (auto fetch_part: fetch_parts) {
+                Napi::Value val_uri = Napi::String::New(env, fetch_part->fetch_context->uri);
+                Napi::Value val_offset = Napi::Number::New(env, fetch_part->offset);
+                Napi::Value val_count = Napi::Number::New(env, fetch_part->count);
+                results.push_back(js_func.Call(resource_io_obj, {val_uri, val_offset, val_count}));
+                if (env.IsExceptionPending()) {
+                    log(LOG_ERROR, "readFile threw %s\n", env.GetAndClearPendingException().Message().c_str());
+                }
+            }
+        }
+
+        for (size_t i = 0; i < fetch_parts.size(); i++) {
+            Napi::Function resolve_handler_func = Napi::Function::New(env, ResourceIoGroup::wrappedReadFileResolveHandler, "readFileResolve", fetch_parts[i]);
+            if (i >= results.size() || !results[i].IsPromise()) {
+                // it threw, or didn't give a promise for this part, which fails it the same as a
+                // rejected promise would. A fetch is only deleted once its last part is done, so
+                // the parts after this one are still there
+                resolve_handler_func.Call({env.Null()});
+                continue;
+            }
+
+            // connect a callback to the promise resolve, and reject, which is a failed read, so
+            // count_pending_fetches always comes back down
+            Napi::Promise promise = results[i].As<Napi::Promise>();
+            Napi::Function then_func = promise.Get("then").As<Napi::Function>();
+            then_func.Call(promise, {resolve_handler_func, resolve_handler_func});
+        }
+    });
+
+    if (status != napi_ok) {
+        printf("failed to call js_func to request data\n");
+        // never going to run, so finish them as failed here
+        lock([this, &fetch_contexts]() {
+            for (auto fetch_context: fetch_contexts) {
+                m_fetch_contexts.erase(fetch_context);
+            }
+        });
+        for (auto fetch_context: fetch_contexts) {
+            failFetch(fetch_context);
+        }
+        m_read_file_func.Release();
+        return false;
+    }
+
+    status = m_read_file_func.Release();
+    if (status != napi_ok) {
+        printf("failed to release request data %i\n", status);
+        return false;
+    }
+
+    return true;
+}
+
+void ResourceIoGroup::loadBlocks(ResourceIo *resource_io, int generation, int64_t offset, int64_t count, bool is_needed_now) {
+    auto &shared_block_cache = SharedBlockCache::getInstance();
+
+    int64_t file_size = resource_io->getFileSize();
+    // fetch whole blocks, they are what gets shared
+    int64_t end = std::min(file_size, (offset + count + SharedBlockCache::BLOCK_SIZE - 1) / SharedBlockCache::BLOCK_SIZE * SharedBlockCache::BLOCK_SIZE);
+    std::string cache_uri = getCacheUri(resource_io->getUri(), resource_io->getEtag());
+    auto &disk_block_cache = DiskBlockCache::getInstance();
+
+    std::vector<std::pair<std::string, uint64_t>> claims;
+    if (offset % SharedBlockCache::BLOCK_SIZE != 0) {
+        // a short read left the cache off the block boundaries, so this can't be shared
+        end = std::min(file_size, offset + count);
+    } else {
+        while (offset < end && m_allow_processing) {
+            int64_t block_index = offset / SharedBlockCache::BLOCK_SIZE;
+            std::string key = SharedBlockCache::getKey(cache_uri, file_size, block_index);
+            std::shared_ptr<const BlockData> data;
+            uint64_t claim_id;
+            auto lookup_result = shared_block_cache.lookupOrClaim(key, data, claim_id);
+
+            if (lookup_result == SharedBlockCache::BLOCK_LOADING) {
+                if (!is_needed_now) {
+                    // don't hold up the reader for read-ahead, try again on a later read
+                    return;
+                }
+                data = shared_block_cache.waitFor(key, [this]() {
+                    return !m_allow_processing;
+                });
+                if (!data) {
+                    // whoever was fetching it gave up; go around and claim it
+                    continue;
+                }
+                lookup_result = SharedBlockCache::BLOCK_READY;
+            }
+
+            if (lookup_result == SharedBlockCache::BLOCK_CLAIMED) {
+                // fetched by an earlier reader, maybe in an earlier process
+                data = disk_block_cache.load(key);
+                if (data) {
+                    shared_block_cache.complete(key, claim_id, data);
+                    lookup_result = SharedBlockCache::BLOCK_READY;
+                }
+            }
+
+            if (lookup_result == SharedBlockCache::BLOCK_READY) {
+                lock([resource_io, generation, offset, &data]() {
+                    resource_io->addCachedBlock(generation, ReadAheadBlock { offset, data });
+                });
+                offset += (int64_t)data->size();
+                // the block is there now, anything else is read-ahead
+                is_needed_now = false;
+                continue;
+            }
+
+            // claimed, so fetch it along with as many of the blocks after it as we can claim too
+            claims.push_back(std::make_pair(key, claim_id));
+            for (int64_t next_offset = offset + SharedBlockCache::BLOCK_SIZE; next_offset < end; next_offset += SharedBlockCache::BLOCK_SIZE) {
+                std::string next_key = SharedBlockCache::getKey(cache_uri, file_size, next_offset / SharedBlockCache::BLOCK_SIZE);
+                std::shared_ptr<const BlockData> next_data;
+                if (shared_block_cache.lookupOrClaim(next_key, next_data, claim_id) != SharedBlockCache::BLOCK_CLAIMED) {
+                    end = next_offset;
+                    break;
+                }
+                if (disk_block_cache.contains(next_key)) {
+                    // load it from disk when we get to it instead
+                    shared_block_cache.complete(next_key, claim_id, nullptr);
+                    end = next_offset;
+                    break;
+                }
+                claims.push_back(std::make_pair(next_key, claim_id));
+            }
+            break;
+        }
+    }
+
+    if (offset >= end || !m_allow_processing) {
+        for (auto &claim: claims) {
+            shared_block_cache.complete(claim.first, claim.second, nullptr);
+        }
+        return;
+    }
+
+    int fetch_count = (int)(end - offset);
+    lock([resource_io, fetch_count]() {
+        resource_io->startFetch(fetch_count);
+    });
+    // a failure is recorded on resource_io, and shows up when something waits on it
+    fetch(resource_io, resource_io->getUri(), file_size, generation, offset, fetch_count, claims);
+}
+
+std::string ResourceIoGroup::getCacheUri(const std::string &uri, const std::string &etag) {
+    std::string cache_uri = m_uri_prefix + uri;
+    if (!etag.empty()) {
+        cache_uri += "@" + etag;
+    }
+    return cache_uri;
+}
+
+void ResourceIoGroup::parseHlsPlaylist(const std::string &playlist_uri, const std::string &data) {
+    std::string dir = playlist_uri.substr(0, playlist_uri.rfind('/') + 1);
+
+    std::vector<std::string> segment_uris;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t end = data.find('\n', pos);
+        if (end == std::string::npos) {
+            end = data.size();
+        }
+        std::string line = data.substr(pos, end - pos);
+        pos = end + 1;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        // tags, and variant playlists in a master playlist, which libav opens itself
+        if (line.empty() || line[0] == '#' || stringEndsWith(line, ".m3u8")) {
+            continue;
+        }
+        if (line.find("://") != std::string::npos) {
+            // libav opens those with their full url, which isn't what we'd be asked for
+            continue;
+        }
+        segment_uris.push_back(line[0] == '/' ? line : dir + line);
+    }
+
+    //printf("ResourceIoGroup::parseHlsPlaylist %s has %zu segments\n", playlist_uri.c_str(), segment_uris.size());
+
+    lock([this, &playlist_uri, &segment_uris]() {
+        for (size_t i = 0; i < segment_uris.size(); i++) {
+            m_hls_segment_indexes[segment_uris[i]] = std::make_pair(playlist_uri, i);
+        }
+        m_hls_playlists[playlist_uri] = std::move(segment_uris);
+    });
+}
+
+Napi::Value ResourceIoGroup::wrappedPrefetchOpenFileResolveHandler(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    auto prefetch_open_file_context = (PrefetchOpenFileContext *)info.Data();
+
+    // null, or the error of a rejected promise, means the open failed
+    int64_t file_size = -1;
+    std::string etag;
+    if (info.Length() != 1 || !getOpenFileResult(info[0], file_size, etag)) {
+        file_size = -1;
+    }
+
+    auto resource_io_group = prefetch_open_file_context->resource_io_group.get();
+    bool is_unused = false;
+    resource_io_group->lock([resource_io_group, prefetch_open_file_context, file_size, &etag, &is_unused] {
+        auto it = resource_io_group->m_hls_prefetches.find(prefetch_open_file_context->uri);
+        if (it == resource_io_group->m_hls_prefetches.end() || it->second.open_id != prefetch_open_file_context->open_id) {
+            // libav got to it first, or moved on
+            is_unused = true;
+            return;
+        }
+        if (file_size < 0) {
+            // leave it to libav to open it, and fail, itself
+            resource_io_group->m_hls_prefetches.erase(it);
+            return;
+        }
+        it->second.file_size = file_size;
+        it->second.etag = etag;
+    });
+
+    if (is_unused && file_size >= 0) {
+        resource_io_group->closePrefetchedFileInJs(prefetch_open_file_context->uri);
+    }
+
+    // may be the last reference to the group
+    delete prefetch_open_file_context;
+
+    return env.Null();
+}
+
+void ResourceIoGroup::startHlsPrefetch(const std::string &segment_uri) {
+    if (m_hls_prefetch_segments <= 0) {
+        return;
+    }
+
+    std::vector<std::pair<std::string, int>> uris_to_open;
+    std::vector<std::string> uris_to_close;
+    lock([this, &segment_uri, &uris_to_open, &uris_to_close]() {
+        auto index_it = m_hls_segment_indexes.find(segment_uri);
+        if (index_it == m_hls_segment_indexes.end()) {
+            return;
+        }
+        const std::string &playlist_uri = index_it->second.first;
+        size_t index = index_it->second.second;
+        const std::vector<std::string> &segment_uris = m_hls_playlists[playlist_uri];
+
+        // forget prefetches of this playlist that are no longer just ahead, after a seek
+        for (auto it = m_hls_prefetches.begin(); it != m_hls_prefetches.end();) {
+            auto prefetch_index_it = m_hls_segment_indexes.find(it->first);
+            bool is_ahead = prefetch_index_it != m_hls_segment_indexes.end() &&
+                prefetch_index_it->second.second > index &&
+                prefetch_index_it->second.second <= index + m_hls_prefetch_segments;
+            if (it->second.playlist_uri == playlist_uri && !is_ahead) {
+                if (it->second.is_fetch_started) {
+                    m_hls_prefetched_bytes -= it->second.file_size;
+                }
+                // ones still being opened are closed when their open comes back
+                if (it->second.file_size >= 0) {
+                    uris_to_close.push_back(it->first);
+                }
+                it = m_hls_prefetches.erase(it);
+            } else {
+                it++;
+            }
+        }
+
+        for (size_t i = index + 1; i <= index + m_hls_prefetch_segments && i < segment_uris.size(); i++) {
+            if (m_hls_prefetches.count(segment_uris[i]) != 0) {
+                continue;
+            }
+            HlsPrefetch &hls_prefetch = m_hls_prefetches[segment_uris[i]];
+            hls_prefetch.playlist_uri = playlist_uri;
+            hls_prefetch.open_id = ++m_last_hls_prefetch_open_id;
+            uris_to_open.push_back(std::make_pair(segment_uris[i], hls_prefetch.open_id));
+        }
+    });
+
+    for (auto &uri: uris_to_close) {
+        closePrefetchedFile(uri);
+    }
+
+    // open them in javascript without waiting; fetchHlsPrefetches() picks them up from there
+    for (auto &uri_to_open: uris_to_open) {
+        const std::string &uri = uri_to_open.first;
+        int open_id = uri_to_open.second;
+        napi_status status;
+
+        status = m_open_file_func.Acquire();
+        if (status != napi_ok) {
+            printf("failed to acquire prefetch open %i\n", status);
+            return;
+        }
+
+        auto prefetch_open_file_context = new PrefetchOpenFileContext(shared_from_this(), uri, open_id);
+
+        status = m_open_file_func.BlockingCall([this, uri, prefetch_open_file_context](const Napi::Env &env, const Napi::Function &js_func) {
+            // this code is run in the main js thread
+            Napi::HandleScope scope(env);
+
+            Napi::Value val_uri = Napi::String::New(env, uri);
+            Napi::Value result = js_func.Call(m_resource_io_obj_ref.Value(), {val_uri});
+
+            // connect a callback to the promise resolve, and reject, which is a failed open
+            Napi::Promise promise = result.As<Napi::Promise>();
+            Napi::Function then_func = promise.Get("then").As<Napi::Function>();
+            Napi::Function resolve_handler_func = Napi::Function::New(env, ResourceIoGroup::wrappedPrefetchOpenFileResolveHandler, "prefetchOpenFileResolve", prefetch_open_file_context);
+            then_func.Call(promise, {resolve_handler_func, resolve_handler_func});
+        });
+
+        if (status != napi_ok) {
+            printf("failed to call js_func to prefetch open file\n");
+            delete prefetch_open_file_context;
+            lock([this, &uri, open_id]() {
+                auto it = m_hls_prefetches.find(uri);
+                if (it != m_hls_prefetches.end() && it->second.open_id == open_id) {
+                    m_hls_prefetches.erase(it);
+                }
+            });
+        }
+
+        status = m_open_file_func.Release();
+        if (status != napi_ok) {
+            printf("failed to release prefetch open %i\n", status);
+            return;
+        }
+    }
+}
+
+void ResourceIoGroup::closePrefetchedFile(const std::string &uri) {
+    napi_status status;
+
+    status = m_close_file_func.Acquire();
+    if (status != napi_ok) {
+        printf("failed to acquire prefetch close %i\n", status);
+        return;
+    }
+
+    // holds a reference so we are still here when the javascript thread gets to it
+    auto resource_io_group = shared_from_this();
+    status = m_close_file_func.BlockingCall([resource_io_group, uri](const Napi::Env &env, const Napi::Function &js_func) {
+        // this code is run in the main js thread
+        Napi::HandleScope scope(env);
+
+        Napi::Value val_uri = Napi::String::New(env, uri);
+        js_func.Call(resource_io_group->m_resource_io_obj_ref.Value(), {val_uri});
+    });
+
+    if (status != napi_ok) {
+        printf("failed to call js_func to prefetch close file\n");
+    }
+
+    status = m_close_file_func.Release();
+    if (status != napi_ok) {
+        printf("failed to release prefetch close %i\n", status);
+    }
+}
+
+void ResourceIoGroup::closePrefetchedFileInJs(const std::string &uri) {
+    Napi::Env env = m_resource_io_obj_ref.Env();
+    Napi::HandleScope scope(env);
+
+    Napi::Object resource_io_obj = m_resource_io_obj_ref.Value();
+    Napi::Value close_file_func = resource_io_obj.Get("closeFile");
+    if (!close_file_func.IsFunction()) {
+        return;
+    }
+    close_file_func.As<Napi::Function>().Call(resource_io_obj, {Napi::String::New(env, uri)});
+}
+
+void ResourceIoGroup::fetchHlsPrefetches() {
+    std::vector<std::pair<std::string, HlsPrefetch>> segments_to_fetch;
+    lock([this, &segments_to_fetch]() {
+        for (auto &entry: m_hls_prefetches) {
+            HlsPrefetch &hls_prefetch = entry.second;
+            if (hls_prefetch.file_size < 0 || hls_prefetch.is_fetch_started) {
+                continue;
+            }
+            if (m_hls_prefetched_bytes + hls_prefetch.file_size > m_hls_prefetch_bytes) {
+                continue;
+            }
+            hls_prefetch.is_fetch_started = true;
+            m_hls_prefetched_bytes += hls_prefetch.file_size;
+            segments_to_fetch.push_back(std::make_pair(entry.first, hls_prefetch));
+        }
+    });
+
+    auto &shared_block_cache = SharedBlockCache::getInstance();
+    auto &disk_block_cache = DiskBlockCache::getInstance();
+    std::vector<FetchContext *> fetch_contexts;
+    for (auto &segment: segments_to_fetch) {
+        const std::string &uri = segment.first;
+        int64_t file_size = segment.second.file_size;
+        std::string cache_uri = getCacheUri(uri, segment.second.etag);
+
+        // fetch each run of blocks nobody else has or is fetching, leaving ones on disk to be
+        // loaded from there when they are read
+        std::vector<std::pair<std::string, uint64_t>> claims;
+        int64_t run_offset = 0;
+        for (int64_t offset = 0; offset < file_size + SharedBlockCache::BLOCK_SIZE; offset += SharedBlockCache::BLOCK_SIZE) {
+            bool is_claimed = false;
+            std::string key;
+            if (offset < file_size) {
+                key = SharedBlockCache::getKey(cache_uri, file_size, offset / SharedBlockCache::BLOCK_SIZE);
+                std::shared_ptr<const BlockData> data;
+                uint64_t claim_id;
+                auto lookup_result = shared_block_cache.lookupOrClaim(key, data, claim_id);
+                if (lookup_result == SharedBlockCache::BLOCK_CLAIMED && disk_block_cache.contains(key)) {
+                    shared_block_cache.complete(key, claim_id, nullptr);
+                } else if (lookup_result == SharedBlockCache::BLOCK_CLAIMED) {
+                    if (claims.empty()) {
+                        run_offset = offset;
+                    }
+                    claims.push_back(std::make_pair(key, claim_id));
+                    is_claimed = true;
+                }
+            }
+            if (!is_claimed && !claims.empty()) {
+                int count = (int)(std::min(offset, file_size) - run_offset);
+                auto fetch_context = new FetchContext(shared_from_this(), nullptr, uri, file_size, 0);
+                fetch_context->addParts(run_offset, count, claims);
+                fetch_contexts.push_back(fetch_context);
+            }
+        }
+    }
+
+    // one trip to javascript for all of them
+    fetchBatch(fetch_contexts);
+}
+
+int ResourceIoGroup::read(ResourceIo *resource_io, int64_t read_offset, uint8_t *buf, int buf_size) {
+    if (!m_allow_processing) {
+        return -1;
+    }
+    //printf("ResourceIoGroup::read %s %li %i\n", resource_io->getUri().c_str(), read_offset, buf_size);
+
+    fetchHlsPrefetches();
+
+    int bytes_read = 0;
+    bool is_failed = false;
+    bool is_at_end = false;
+    bool is_first_try = true;
+    while (bytes_read == 0 && !is_failed && !is_at_end) {
+        int fetch_generation = 0;
+        int64_t fetch_offset = 0;
+        int64_t fetch_count = 0;
+
+        lock([&]() {
+            if (is_first_try) {
+                resource_io->trackRead(read_offset);
+                is_first_try = false;
+            }
+            waitLocked(resource_io->getCond(), [resource_io, read_offset]() {
+                return !resource_io->isFetching(read_offset);
+            });
+            if (!m_allow_processing || resource_io->isFetchFailed()) {
+                is_failed = true;
+                return;
+            }
+
+            bytes_read = resource_io->copyFromCache(read_offset, buf, buf_size);
+            if (bytes_read == 0) {
+                if (resource_io->isAtEnd(read_offset)) {
+                    is_at_end = true;
+                    return;
+                }
+                // nothing cached here or on its way, so start over at the block holding
+                // read_offset. Unless reads have become smaller than a block, then fetching
+                // the whole block would mostly be wasted, so just fetch from read_offset
+                // (which can't be shared)
+                int64_t cache_offset = read_offset;
+                if (resource_io->getReadSize() >= SharedBlockCache::BLOCK_SIZE) {
+                    cache_offset = read_offset / SharedBlockCache::BLOCK_SIZE * SharedBlockCache::BLOCK_SIZE;
+                }
+                resource_io->resetCache(cache_offset);
+                fetch_count = resource_io->getReadSize() + (read_offset - cache_offset);
+            } else {
+                resource_io->addBytesRead(bytes_read);
+                fetch_count = resource_io->trimAndGetPrefetchCount(read_offset + bytes_read);
+            }
+            fetch_generation = resource_io->getFetchGeneration();
+            fetch_offset = resource_io->getCacheEnd();
+        });
+
+        if (fetch_count > 0) {
+            loadBlocks(resource_io, fetch_generation, fetch_offset, fetch_count, bytes_read == 0);
+        }
+    }
+
+    if (is_failed) {
+        m_allow_processing = false;
+        return -1;
+    }
+
+    //printf("ResourceIoGroup::read processed %i bytes\n", bytes_read);
+
+    return bytes_read;
+}
+
+Napi::Value ResourceIoGroup::wrappedOpenOutputFileResolveHandler(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    // the waiting thread may have given up on it already, so this holds its own reference
+    auto data = (std::shared_ptr<OpenOutputFileContext> *)info.Data();
+    std::shared_ptr<OpenOutputFileContext> open_output_file_context = *data;
+    delete data;
+
     if (info.Length() != 1) {
         std::string err = "Wrong number of arguments " + info.Length();
         Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
         return env.Null();
     }
 
-    if (!info[0].IsNull() && !info[0].IsArray()) {
+    if (!info[0].IsNull() && !info[0].IsString()) {
         Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
         return env.Null();
     }
 
     Napi::Value val_resolve = info[0];
 
-    auto read_file_context = (ReadFileContext *)info.Data();
-
-    read_file_context->resource_io_group->lock([read_file_context, &val_resolve] {
+    open_output_file_context->resource_io_group->lock([open_output_file_context, &val_resolve] {
         if (val_resolve.IsNull()) {
-            read_file_context->success = false;
+            open_output_file_context->success = false;
         } else {
-            read_file_context->success = true;
-            auto buffer_arr(val_resolve.As<Napi::Array>());
-
-            int len = 0;
-            for (uint32_t i = 0; i < buffer_arr.Length(); i++) {
-                Napi::Buffer<uint8_t> buffer = buffer_arr.Get(i).As<Napi::Buffer<uint8_t>>();
-                read_file_context->buffer_vector.push_back(std::make_pair(buffer.Data(), buffer.Length()));
-                len += buffer.Length();
-            }
+            open_output_file_context->success = true;
+            open_output_file_context->mode = val_resolve.As<Napi::String>();
         }
-        read_file_context->is_done = true;
+
+        open_output_file_context->is_done = true;
+        open_output_file_context->resource_io_group->signalLocked(open_output_file_context->cond.get());
     });
-    uv_cond_signal(&read_file_context->resource_io_group->m_cond);
 
     return env.Null();
 }
 
-int ResourceIoGroup::read(const std::string &uri, int64_t read_offset, uint8_t *buf, int buf_size) {
+bool ResourceIoGroup::openOutput(const std::string &uri, CustomOutputIo *&output_io) {
+    output_io = nullptr;
+
+    if (!m_has_output) {
+        // output goes to the local filesystem
+        return true;
+    }
     if (!m_allow_processing) {
-        return -1;
+        return false;
     }
-    //printf("ResourceIoGroup::read %s %li %i\n", uri.c_str(), read_offset, buf_size);
+    //printf("ResourceIoGroup::openOutput %s\n", uri.c_str());
 
     napi_status status;
 
-    status = m_read_file_func.Acquire();
+    status = m_open_output_file_func.Acquire();
     if (status != napi_ok) {
-        printf("failed to acquire request data %i\n", status);
-        return -1;
+        printf("failed to acquire open output %i\n", status);
+        return false;
     }
 
-    auto read_file_context = ReadFileContext(this);
+    auto open_output_file_context = std::make_shared<OpenOutputFileContext>(shared_from_this());
 
-    //printf("acquired read file func, going to start call into js thread\n");
-    status = m_read_file_func.BlockingCall([this, uri, read_offset, buf_size, &read_file_context](const Napi::Env &env, const Napi::Function &js_func) {
+    status = m_open_output_file_func.BlockingCall([this, uri, open_output_file_context](const Napi::Env &env, const Napi::Function &js_func) {
         // this code is run in the main js thread
         Napi::HandleScope scope(env);
 
         Napi::Value val_uri = Napi::String::New(env, uri);
-        Napi::Value val_read_offset = Napi::Number::New(env, read_offset);
-        Napi::Value val_buf_size = Napi::Number::New(env, buf_size);
-
-        Napi::Value result = js_func.Call(m_resource_io_obj_ref.Value(), {val_uri, val_read_offset, val_buf_size});
+        Napi::Value result = js_func.Call(m_resource_io_obj_ref.Value(), {val_uri});
 
         // connect a callback to the promise resolve
         Napi::Promise promise = result.As<Napi::Promise>();
         Napi::Function then_func = promise.Get("then").As<Napi::Function>();
-        auto data = (void *)&read_file_context;
-        Napi::Function resolve_handler_func = Napi::Function::New(env, ResourceIoGroup::wrappedReadFileResolveHandler, "readFileResolve", data);
+        auto data = new std::shared_ptr<OpenOutputFileContext>(open_output_file_context);
+        Napi::Function resolve_handler_func = Napi::Function::New(env, ResourceIoGroup::wrappedOpenOutputFileResolveHandler, "openOutputFileResolve", data);
         then_func.Call(promise, {resolve_handler_func});
     });
 
     if (status != napi_ok) {
-        printf("failed to call js_func to request data\n");
+        printf("failed to call js_func to open output file\n");
         if (status == napi_closing) {
-            return -1;
+            return false;
         }
     }
 
-    status = m_read_file_func.Release();
+    status = m_open_output_file_func.Release();
     if (status != napi_ok) {
-        printf("failed to release request data %i\n", status);
-        return -1;
+        printf("failed to release open output %i\n", status);
+        return false;
+    }
+
+    lock([this, open_output_file_context]() {
+        waitLocked(open_output_file_context->cond.get(), [open_output_file_context]() {
+            return open_output_file_context->is_done;
+        });
+    });
+
+    if (!m_allow_processing || !open_output_file_context->success) {
+        return false;
+    }
+
+    if (open_output_file_context->mode == "file") {
+        // javascript doesn't want this one
+        return true;
+    }
+    if (open_output_file_context->mode != "stream" && open_output_file_context->mode != "memory") {
+        log(LOG_ERROR, "Unknown output mode %s for %s\n", open_output_file_context->mode.c_str(), uri.c_str());
+        return false;
+    }
+
+    auto resource_output_io = new ResourceOutputIo(this, uri, open_output_file_context->mode == "memory");
+    lock([this, resource_output_io]() {
+        m_resource_output_ios.insert(resource_output_io);
+    });
+
+    output_io = resource_output_io;
+    return true;
+}
+
+void ResourceIoGroup::closeOutput(CustomOutputIo *output_io) {
+    //printf("ResourceIoGroup::closeOutput\n");
+
+    ResourceOutputIo *resource_output_io = static_cast<ResourceOutputIo *>(output_io);
+    const std::string uri = resource_output_io->getUri();
+
+    // an output abandoned on error may still have writes in flight that point at it
+    waitForWrites(resource_output_io);
+    bool is_complete = resource_output_io->isComplete();
+
+    if (!m_allow_processing) {
+        // writes may never finish now, so leave it for the destructor, which isn't run until
+        // javascript has answered them
+        return;
+    }
+
+    lock([this, resource_output_io]() {
+        m_resource_output_ios.erase(resource_output_io);
+    });
+    delete resource_output_io;
+
+    // tell javascript to close the file
+
+    napi_status status;
+
+    status = m_close_output_file_func.Acquire();
+    if (status != napi_ok) {
+        printf("failed to acquire close output %i\n", status);
+        return;
     }
 
-    lock([this, uri, &read_file_context]() {
-        while (!read_file_context.is_done && m_allow_processing) {
-            uv_cond_wait(&m_cond, &m_mutex);
+    auto close_file_context = std::make_shared<CloseFileContext>(shared_from_this());
+
+    status = m_close_output_file_func.BlockingCall([this, uri, is_complete, close_file_context](const Napi::Env &env, const Napi::Function &js_func) {
+        // this code is run in the main js thread
+        Napi::HandleScope scope(env);
+
+        Napi::Value val_uri = Napi::String::New(env, uri);
+        Napi::Value val_is_complete = Napi::Boolean::New(env, is_complete);
+
+        js_func.Call(m_resource_io_obj_ref.Value(), {val_uri, val_is_complete});
+
+        lock([this, close_file_context]() {
+            close_file_context->is_done = true;
+            signalLocked(close_file_context->cond.get());
+        });
+    });
+
+    if (status != napi_ok) {
+        printf("failed to call js_func to close output file\n");
+        if (status == napi_closing) {
+            return;
         }
+    }
+
+    status = m_close_output_file_func.Release();
+    if (status != napi_ok) {
+        printf("failed to release close output %i\n", status);
+        return;
+    }
+
+    lock([this, close_file_context]() {
+        waitLocked(close_file_context->cond.get(), [close_file_context]() {
+            return close_file_context->is_done;
+        });
+    });
+}
+
+Napi::Value ResourceIoGroup::wrappedWriteFileResolveHandler(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    auto write_file_context = (WriteFileContext *)info.Data();
+
+    bool success = info.Length() == 1 && info[0].IsBoolean() && info[0].As<Napi::Boolean>().Value();
+
+    auto resource_io_group = write_file_context->resource_io_group.get();
+    resource_io_group->lock([resource_io_group, write_file_context, success] {
+        auto resource_output_io = write_file_context->resource_output_io;
+        resource_output_io->count_pending_writes--;
+        if (!success) {
+            resource_output_io->is_write_failed = true;
+        }
+        resource_io_group->signalLocked(resource_output_io->getCond());
     });
 
+    delete write_file_context;
+
+    return env.Null();
+}
+
+bool ResourceIoGroup::write(ResourceOutputIo *resource_output_io, int64_t offset, std::unique_ptr<OutputChunk> chunk) {
     if (!m_allow_processing) {
-        return -1;
+        return false;
     }
+    //printf("ResourceIoGroup::write %s %li %zu\n", resource_output_io->getUri().c_str(), offset, chunk->size());
 
-    if (!read_file_context.success) {
-        m_allow_processing = false;
-        return -1;
+    bool is_write_failed = false;
+    lock([this, resource_output_io, &is_write_failed]() {
+        // write-behind, but don't let javascript fall too far behind
+        waitLocked(resource_output_io->getCond(), [resource_output_io]() {
+            return resource_output_io->count_pending_writes < MAX_PENDING_OUTPUT_WRITES;
+        });
+        is_write_failed = resource_output_io->is_write_failed;
+        if (!is_write_failed) {
+            resource_output_io->count_pending_writes++;
+        }
+    });
+
+    if (!m_allow_processing || is_write_failed) {
+        return false;
     }
 
-    uint8_t *result_buf;
-    int len_result_buf;
+    napi_status status;
 
-    int bytes_written = 0;
-    for (auto buf_entry: read_file_context.buffer_vector) {
-        std::tie(result_buf, len_result_buf) = buf_entry;
-        int len_copy = std::min(buf_size - bytes_written, len_result_buf);
-        memcpy(buf + bytes_written, result_buf, len_copy);
-        bytes_written += len_copy;
+    status = m_write_file_func.Acquire();
+    if (status != napi_ok) {
+        printf("failed to acquire write %i\n", status);
+        return false;
     }
 
-    //printf("ResourceIoGroup::read processed %i bytes from js\n", bytes_written);
+    // handed to javascript as the backing store of a Buffer, freed when that is garbage collected
+    OutputChunk *chunk_raw = chunk.release();
+    auto write_file_context = new WriteFileContext(shared_from_this(), resource_output_io);
+
+    std::string uri = resource_output_io->getUri();
+    status = m_write_file_func.BlockingCall([this, uri, offset, chunk_raw, write_file_context](const Napi::Env &env, const Napi::Function &js_func) {
+        // this code is run in the main js thread
+        Napi::HandleScope scope(env);
+
+        Napi::Value val_uri = Napi::String::New(env, uri);
+        Napi::Value val_offset = Napi::Number::New(env, offset);
+        auto finalizer = [](Napi::Env, uint8_t *, OutputChunk *chunk) {
+            delete chunk;
+        };
+        Napi::Value val_buffer = Napi::Buffer<uint8_t>::New(env, chunk_raw->data(), chunk_raw->size(), finalizer, chunk_raw);
+
+        Napi::Value result = js_func.Call(m_resource_io_obj_ref.Value(), {val_uri, val_offset, val_buffer});
 
-    return bytes_written;
+        // connect a callback to the promise resolve, and reject, which is a failed write
+        Napi::Promise promise = result.As<Napi::Promise>();
+        Napi::Function then_func = promise.Get("then").As<Napi::Function>();
+        Napi::Function resolve_handler_func = Napi::Function::New(env, ResourceIoGroup::wrappedWriteFileResolveHandler, "writeFileResolve", write_file_context);
+        then_func.Call(promise, {resolve_handler_func, resolve_handler_func});
+    });
+
+    if (status != napi_ok) {
+        printf("failed to call js_func to write\n");
+        // never going to run, so clean up what it would have
+        delete chunk_raw;
+        delete write_file_context;
+        lock([resource_output_io]() {
+            resource_output_io->count_pending_writes--;
+            resource_output_io->is_write_failed = true;
+        });
+        m_write_file_func.Release();
+        return false;
+    }
+
+    status = m_write_file_func.Release();
+    if (status != napi_ok) {
+        printf("failed to release write %i\n", status);
+        return false;
+    }
+
+    return true;
+}
+
+bool ResourceIoGroup::waitForWrites(ResourceOutputIo *resource_output_io) {
+    bool is_write_failed = false;
+    lock([this, resource_output_io, &is_write_failed]() {
+        waitLocked(resource_output_io->getCond(), [resource_output_io]() {
+            return resource_output_io->count_pending_writes == 0;
+        });
+        is_write_failed = resource_output_io->is_write_failed;
+    });
+
+    return m_allow_processing && !is_write_failed;
 }
 
 void ResourceIoGroup::lock(std::function<void()> func) {
@@ -392,3 +1536,41 @@ void ResourceIoGroup::lock(std::function<void()> func) {
 
     func();
 }
+
+void ResourceIoGroup::waitLocked(uv_cond_t *cond, std::function<bool()> is_done) {
+    WorkerPool &worker_pool = WorkerPool::getInstance();
+    if (worker_pool.isOnFiber()) {
+        // the thread goes on to other tasks, which may want the mutex, so it is let go of while
+        // suspended, as uv_cond_wait() would
+        while (!is_done() && m_allow_processing) {
+            uv_mutex_unlock(&m_mutex);
+            worker_pool.suspend([this, cond, &is_done](WorkerPool::ResumeFunc resume) {
+                UvMutexLock lock(m_mutex);
+                // it may have been signalled between letting go of the mutex and now
+                if (is_done() || !m_allow_processing) {
+                    resume();
+                    return;
+                }
+                m_waiting_fibers.insert({ cond, std::move(resume) });
+            });
+            uv_mutex_lock(&m_mutex);
+        }
+        return;
+    }
+
+    m_waiting_conds.insert(cond);
+    while (!is_done() && m_allow_processing) {
+        uv_cond_wait(cond, &m_mutex);
+    }
+    m_waiting_conds.erase(m_waiting_conds.find(cond));
+}
+
+void ResourceIoGroup::signalLocked(uv_cond_t *cond) {
+    uv_cond_signal(cond);
+
+    auto range = m_waiting_fibers.equal_range(cond);
+    for (auto it = range.first; it != range.second; it++) {
+        it->second();
+    }
+    m_waiting_fibers.erase(range.first, range.second);
+}
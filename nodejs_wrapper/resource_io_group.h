@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -20,8 +21,16 @@ extern "C" {
 #include "../utils.h"
 
 #include "./resource_io.h"
+#include "./resource_output_io.h"
+#include "./shared_block_cache.h"
+#include "./worker_pool.h"
 
-class ResourceIoGroup : public Avalanche::CustomIoGroup {
+struct FetchContext;
+
+// Made with std::make_shared: whatever javascript is still to answer (a write, a fetch) holds a
+// reference, so the group and the ResourceIos and ResourceOutputIos it points at stay around until
+// it has been answered, even if the reader has been destroyed by then.
+class ResourceIoGroup : public Avalanche::CustomIoGroup, public std::enable_shared_from_this<ResourceIoGroup> {
 public:
 
     // called in js thread
@@ -30,6 +39,11 @@ public:
 
     void setStopProcessing();
 
+    // called in any thread; totals over every input opened so far
+    ResourceIoStats getStats();
+    // called in any thread; bytes held in the read caches of the open inputs
+    int64_t getCacheSize();
+
     // called in other threads, directly from libav
     AVIOContext * open(const std::string &uri) override;
     void close(void *opaque) override;
@@ -38,27 +52,123 @@ public:
     int interruptCallback() override;
 
     // called in other threads, from ResourceIo
-    int read(const std::string &uri, int64_t read_offset, uint8_t *buf, int buf_size);
+    // serves the read from the ResourceIo's cache, waiting on javascript only for data that
+    // hasn't been fetched yet
+    int read(ResourceIo *resource_io, int64_t read_offset, uint8_t *buf, int buf_size);
+
+    // called in other threads, directly from libav
+    bool openOutput(const std::string &uri, Avalanche::CustomOutputIo *&output_io) override;
+    void closeOutput(Avalanche::CustomOutputIo *output_io) override;
+
+    // called in other threads, from ResourceOutputIo
+    // hands the chunk to javascript without waiting for it to be written, unless too many
+    // writes are already pending
+    bool write(ResourceOutputIo *resource_output_io, int64_t offset, std::unique_ptr<Avalanche::OutputChunk> chunk);
+    // waits until every write handed to javascript is done; false if any failed
+    bool waitForWrites(ResourceOutputIo *resource_output_io);
 
 private:
     Napi::ObjectReference m_resource_io_obj_ref;
     Napi::ThreadSafeFunction m_open_file_func;
     Napi::ThreadSafeFunction m_close_file_func;
     Napi::ThreadSafeFunction m_read_file_func;
+    bool m_has_read_file_ranges = false;
+
+    // only set up if the resource io object has an output side
+    bool m_has_output = false;
+    Napi::ThreadSafeFunction m_open_output_file_func;
+    Napi::ThreadSafeFunction m_write_file_func;
+    Napi::ThreadSafeFunction m_close_output_file_func;
 
+    // guards everything here and in the ResourceIos and ResourceOutputIos. Each thing a thread
+    // waits for (a reply from javascript, a ResourceIo's fetches, a ResourceOutputIo's writes)
+    // has its own cond, so only its waiter is woken when it is done
     uv_mutex_t m_mutex;
-    uv_cond_t m_cond;
+    // the conds being waited on, woken when processing is stopped
+    std::unordered_multiset<uv_cond_t *> m_waiting_conds;
+    // tasks on WorkerPool fibers suspended until a cond is signalled, by cond
+    std::unordered_multimap<uv_cond_t *, WorkerPool::ResumeFunc> m_waiting_fibers;
 
     bool m_allow_processing = true;
 
+    // prepended to uris to key SharedBlockCache, see resource_io.js
+    std::string m_uri_prefix;
+
     std::unordered_set<ResourceIo *> m_resource_ios;
+    // of the ones that have been closed
+    ResourceIoStats m_closed_stats;
+    // fetches handed to javascript that haven't come back
+    std::unordered_set<FetchContext *> m_fetch_contexts;
     std::unordered_map<std::string, int64_t> m_file_sizes;
 
+    std::unordered_set<ResourceOutputIo *> m_resource_output_ios;
+
+    // hls segment prefetch: once a playlist has been read, opening one of its segments starts
+    // opening the next m_hls_prefetch_segments, and fetching them into SharedBlockCache while
+    // the not yet opened ones fit in m_hls_prefetch_bytes
+    struct HlsPrefetch {
+        std::string playlist_uri;
+        // -1 until javascript has opened it
+        int64_t file_size = -1;
+        std::string etag;
+        bool is_fetch_started = false;
+        // tells the javascript open that was made for this entry from one made for an earlier
+        // one of the same uri, which has since been dropped
+        int open_id = 0;
+    };
+    int m_hls_prefetch_segments;
+    int64_t m_hls_prefetch_bytes;
+    // segment uris of each playlist read, in order
+    std::unordered_map<std::string, std::vector<std::string>> m_hls_playlists;
+    // from segment uri to its playlist and index in it
+    std::unordered_map<std::string, std::pair<std::string, size_t>> m_hls_segment_indexes;
+    std::unordered_map<std::string, HlsPrefetch> m_hls_prefetches;
+    // size of the prefetched segments that haven't been opened yet
+    int64_t m_hls_prefetched_bytes = 0;
+    int m_last_hls_prefetch_open_id = 0;
+
     // called in js thread and other threads
     void lock(std::function<void()> func);
+    // called with the mutex held; waits on cond until is_done() or processing is stopped. Whoever
+    // makes is_done() true signals cond with signalLocked(), also with the mutex held, since the
+    // cond can go away as soon as its waiter returns. On a WorkerPool fiber, the task is
+    // suspended instead of its thread waiting, and the mutex is let go of until it is resumed
+    void waitLocked(uv_cond_t *cond, std::function<bool()> is_done);
+    // called with the mutex held; wakes whatever is waiting on cond, thread or fiber
+    void signalLocked(uv_cond_t *cond);
+
+    // called in other threads; what SharedBlockCache and DiskBlockCache keys start with
+    std::string getCacheUri(const std::string &uri, const std::string &etag);
+
+    // called in other threads
+    void parseHlsPlaylist(const std::string &playlist_uri, const std::string &data);
+    void startHlsPrefetch(const std::string &segment_uri);
+    void fetchHlsPrefetches();
+    // called in other threads; closes a prefetched segment that javascript opened but libav
+    // never will, without waiting
+    void closePrefetchedFile(const std::string &uri);
+    // called in js thread; the same, from there
+    void closePrefetchedFileInJs(const std::string &uri);
+
+    // called in other threads; gets the blocks covering count bytes at offset into resource_io,
+    // from SharedBlockCache where it can and otherwise from javascript. Only waits if
+    // is_needed_now and another reader is already fetching the first block
+    void loadBlocks(ResourceIo *resource_io, int generation, int64_t offset, int64_t count, bool is_needed_now);
+    // called in other threads; asks javascript for count bytes without waiting for them.
+    // Takes over the SharedBlockCache claims for the blocks they cover. resource_io is null
+    // when only the cache is being filled
+    bool fetch(ResourceIo *resource_io, const std::string &uri, int64_t file_size, int generation, int64_t offset, int count, std::vector<std::pair<std::string, uint64_t>> &claims);
+    // called in other threads; hands all the fetches to javascript in one call (readFileRanges),
+    // without waiting for them. Takes ownership of the contexts
+    bool fetchBatch(std::vector<FetchContext *> &fetch_contexts);
+    // called in other threads; finishes a fetch that never got to javascript
+    void failFetch(FetchContext *fetch_context);
 
     // called in js thread
     static Napi::Value wrappedOpenFileResolveHandler(const Napi::CallbackInfo &info);
     static Napi::Value wrappedReadFileResolveHandler(const Napi::CallbackInfo &info);
+    static Napi::Value wrappedPrefetchOpenFileResolveHandler(const Napi::CallbackInfo &info);
+    static Napi::Value wrappedOpenOutputFileResolveHandler(const Napi::CallbackInfo &info);
+    static Napi::Value wrappedWriteFileResolveHandler(const Napi::CallbackInfo &info);
 
 };
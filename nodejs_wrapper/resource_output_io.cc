@@ -0,0 +1,30 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include "resource_output_io.h"
+
+#include "resource_io_group.h"
+
+using namespace Avalanche;
+
+ResourceOutputIo::ResourceOutputIo(ResourceIoGroup *resource_io_group, const std::string &uri, bool is_in_memory) :
+    CustomOutputIo(uri, is_in_memory),
+    m_resource_io_group(resource_io_group) {
+}
+
+ResourceOutputIo::~ResourceOutputIo() {
+}
+
+bool ResourceOutputIo::finish() {
+    bool success = CustomOutputIo::finish();
+    if (!m_resource_io_group->waitForWrites(this)) {
+        success = false;
+    }
+    m_is_complete = success;
+    return success;
+}
+
+bool ResourceOutputIo::writeChunk(int64_t offset, std::unique_ptr<OutputChunk> chunk) {
+    return m_resource_io_group->write(this, offset, std::move(chunk));
+}
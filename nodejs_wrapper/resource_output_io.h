@@ -0,0 +1,42 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include "../custom_output_io.h"
+#include "../uv_mutex_lock.h"
+
+class ResourceIoGroup;
+
+class ResourceOutputIo : public Avalanche::CustomOutputIo {
+public:
+    ResourceOutputIo(ResourceIoGroup *resource_io_group, const std::string &uri, bool is_in_memory);
+    virtual ~ResourceOutputIo();
+
+    // also waits for every chunk handed to javascript to be written
+    bool finish() override;
+
+    bool isComplete() {
+        return m_is_complete;
+    }
+
+    // signalled when a write comes back
+    uv_cond_t * getCond() {
+        return m_cond.get();
+    }
+
+    // guarded by the ResourceIoGroup mutex
+    int count_pending_writes = 0;
+    bool is_write_failed = false;
+
+protected:
+    bool writeChunk(int64_t offset, std::unique_ptr<Avalanche::OutputChunk> chunk) override;
+
+private:
+    ResourceIoGroup *m_resource_io_group;
+
+    bool m_is_complete = false;
+
+    UvCond m_cond;
+};
@@ -0,0 +1,152 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include "../private/utils.h"
+
+#include "../utils.h"
+#include "../uv_mutex_lock.h"
+
+#include "shared_block_cache.h"
+
+using namespace Avalanche;
+
+// how often a waiter checks whether it has been cancelled
+constexpr uint64_t WAIT_CHECK_NSEC = 100 * 1000 * 1000;
+
+SharedBlockCache & SharedBlockCache::getInstance() {
+    static SharedBlockCache shared_block_cache;
+    return shared_block_cache;
+}
+
+SharedBlockCache::SharedBlockCache() {
+    int ret;
+
+    ret = uv_mutex_init(&m_mutex);
+    if (ret != 0) {
+        log(LOG_ERROR, "UvMutexInitFailed %i", ret);
+        return;
+    }
+    ret = uv_cond_init(&m_cond);
+    if (ret != 0) {
+        log(LOG_ERROR, "UvCondInitFailed %i", ret);
+        return;
+    }
+}
+
+SharedBlockCache::~SharedBlockCache() {
+    uv_mutex_destroy(&m_mutex);
+    uv_cond_destroy(&m_cond);
+}
+
+std::string SharedBlockCache::getKey(const std::string &uri, int64_t file_size, int64_t block_index) {
+    return uri + "#" + std::to_string(file_size) + "#" + std::to_string(block_index);
+}
+
+void SharedBlockCache::setMaxSize(int64_t max_size) {
+    UvMutexLock lock(m_mutex);
+
+    m_max_size = max_size;
+    evict();
+}
+
+SharedBlockCache::LookupResult SharedBlockCache::lookupOrClaim(const std::string &key, std::shared_ptr<const BlockData> &data, uint64_t &claim_id) {
+    UvMutexLock lock(m_mutex);
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        claim_id = m_next_claim_id++;
+        Entry &entry = m_entries[key];
+        entry.claim_id = claim_id;
+        entry.lru_it = m_lru.end();
+        return BLOCK_CLAIMED;
+    }
+
+    Entry &entry = it->second;
+    if (entry.claim_id != 0) {
+        return BLOCK_LOADING;
+    }
+
+    m_lru.splice(m_lru.begin(), m_lru, entry.lru_it);
+    data = entry.data;
+    return BLOCK_READY;
+}
+
+void SharedBlockCache::complete(const std::string &key, uint64_t claim_id, std::shared_ptr<const BlockData> data) {
+    {
+        UvMutexLock lock(m_mutex);
+
+        auto it = m_entries.find(key);
+        if (it == m_entries.end() || it->second.claim_id != claim_id) {
+            // not ours anymore
+            return;
+        }
+
+        if (!data || m_max_size == 0) {
+            // waiters wake up, find no entry, and claim it themselves
+            m_entries.erase(it);
+        } else {
+            Entry &entry = it->second;
+            entry.claim_id = 0;
+            entry.data = data;
+            m_lru.push_front(key);
+            entry.lru_it = m_lru.begin();
+            addSize(*data);
+            evict();
+        }
+    }
+    uv_cond_broadcast(&m_cond);
+}
+
+std::shared_ptr<const BlockData> SharedBlockCache::waitFor(const std::string &key, std::function<bool()> is_cancelled) {
+    UvMutexLock lock(m_mutex);
+
+    while (true) {
+        auto it = m_entries.find(key);
+        if (it == m_entries.end()) {
+            return nullptr;
+        }
+        if (it->second.claim_id == 0) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second.lru_it);
+            return it->second.data;
+        }
+        if (is_cancelled()) {
+            return nullptr;
+        }
+        uv_cond_timedwait(&m_cond, &m_mutex, WAIT_CHECK_NSEC);
+    }
+}
+
+// called with m_mutex held
+void SharedBlockCache::evict() {
+    while (m_size > m_max_size && !m_lru.empty()) {
+        auto it = m_entries.find(m_lru.back());
+        removeSize(*it->second.data);
+        m_entries.erase(it);
+        m_lru.pop_back();
+    }
+}
+
+// called with m_mutex held
+void SharedBlockCache::addSize(const BlockData &data) {
+    if (!data.getOwner()) {
+        m_size += (int64_t)data.size();
+        return;
+    }
+    if (m_owner_counts[data.getOwner()]++ == 0) {
+        m_size += (int64_t)data.getOwnerSize();
+    }
+}
+
+// called with m_mutex held
+void SharedBlockCache::removeSize(const BlockData &data) {
+    if (!data.getOwner()) {
+        m_size -= (int64_t)data.size();
+        return;
+    }
+    auto it = m_owner_counts.find(data.getOwner());
+    if (--it->second == 0) {
+        m_size -= (int64_t)data.getOwnerSize();
+        m_owner_counts.erase(it);
+    }
+}
@@ -0,0 +1,137 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "uv.h"
+
+// The bytes of a block: either its own, or a view into memory kept alive by an owner (a
+// javascript Buffer, see pinJsBuffer()) of owner_size bytes, all of which stay in memory for as
+// long as any block pointing into it does
+class BlockData {
+public:
+    BlockData(size_t size) :
+        m_own_data(size),
+        m_data(m_own_data.data()),
+        m_size(size) {
+    }
+
+    BlockData(std::shared_ptr<void> owner, size_t owner_size, const uint8_t *data, size_t size) :
+        m_owner(owner),
+        m_owner_size(owner_size),
+        m_data(data),
+        m_size(size) {
+    }
+
+    const uint8_t * data() const {
+        return m_data;
+    }
+
+    // only for a block with its own data, while filling it in
+    uint8_t * data() {
+        return m_own_data.data();
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    // null for a block with its own data
+    const void * getOwner() const {
+        return m_owner.get();
+    }
+
+    size_t getOwnerSize() const {
+        return m_owner_size;
+    }
+
+private:
+    std::vector<uint8_t> m_own_data;
+    std::shared_ptr<void> m_owner;
+    size_t m_owner_size = 0;
+    const uint8_t *m_data;
+    size_t m_size;
+};
+
+// Process wide cache of fixed size blocks of input resources, shared by every ResourceIo so
+// that readers working on the same asset at the same time fetch its bytes from javascript
+// (and from wherever javascript gets them) only once.
+//
+// A block that isn't cached is claimed by the first reader to want it, which fetches it and
+// then completes the claim; anyone else wanting it meanwhile waits for that instead of
+// fetching it again. Completed blocks are kept within a byte budget, least recently used
+// going first. A block that points into a javascript Buffer counts the whole Buffer, once
+// for all the cached blocks in it, since that is what is kept in memory.
+class SharedBlockCache {
+public:
+    static constexpr int64_t BLOCK_SIZE = 1024 * 1024;
+    static constexpr int64_t DEFAULT_MAX_SIZE = 256 * 1024 * 1024;
+
+    enum LookupResult {
+        // data is set
+        BLOCK_READY,
+        // the caller has to fetch the block and then call complete() with claim_id
+        BLOCK_CLAIMED,
+        // someone else is fetching it, see waitFor()
+        BLOCK_LOADING,
+    };
+
+    static SharedBlockCache & getInstance();
+
+    // the file size is part of the key, so a resource that is rewritten (like a growing
+    // m3u8) doesn't get served stale blocks
+    static std::string getKey(const std::string &uri, int64_t file_size, int64_t block_index);
+
+    // 0 turns caching off; claims still de-duplicate concurrent fetches
+    void setMaxSize(int64_t max_size);
+
+    LookupResult lookupOrClaim(const std::string &key, std::shared_ptr<const BlockData> &data, uint64_t &claim_id);
+
+    // ends a claim; data is null if the block couldn't be fetched, which lets the next reader
+    // to want it claim it again
+    void complete(const std::string &key, uint64_t claim_id, std::shared_ptr<const BlockData> data);
+
+    // waits for the reader fetching key to complete it; returns null if that failed, or if
+    // is_cancelled returned true first
+    std::shared_ptr<const BlockData> waitFor(const std::string &key, std::function<bool()> is_cancelled);
+
+private:
+    SharedBlockCache();
+    ~SharedBlockCache();
+
+    struct Entry {
+        std::shared_ptr<const BlockData> data;
+        // non-zero while the block is being fetched
+        uint64_t claim_id = 0;
+        std::list<std::string>::iterator lru_it;
+    };
+
+    uv_mutex_t m_mutex;
+    uv_cond_t m_cond;
+
+    int64_t m_max_size = DEFAULT_MAX_SIZE;
+    int64_t m_size = 0;
+    // owners of the cached blocks that point into one, with how many of those there are
+    std::unordered_map<const void *, int> m_owner_counts;
+    uint64_t m_next_claim_id = 1;
+
+    std::unordered_map<std::string, Entry> m_entries;
+    // keys of completed entries, most recently used first
+    std::list<std::string> m_lru;
+
+    // called with m_mutex held; keep m_size and m_owner_counts up to date
+    void addSize(const BlockData &data);
+    void removeSize(const BlockData &data);
+
+    void evict();
+};
@@ -0,0 +1,48 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+import log from '../log.js';
+
+import Avalanche from '../avalanche.js';
+import ResourceIo from '../resource_io.js';
+
+// gets the volume data and a few images at the same time, each on its own reader, with the
+// input only probed once
+const main = async function () {
+  if (process.argv.length < 4) {
+    log.info('usage: test_asset_session.js <video_filename> <timestamp> [<timestamp> ...]');
+    return;
+  }
+
+  const uri = process.argv[2];
+  const timestamps = process.argv.slice(3).map(parseFloat);
+
+  const resourceIo = new ResourceIo(uri);
+  const assetSession = Avalanche.createAssetSession(resourceIo, {}, { max_readers: 4 });
+  try {
+    if (!(await assetSession.init())) {
+      log.error('unable to open', uri);
+      return;
+    }
+
+    const startTime = Date.now();
+    const [volumeData, ...images] = await Promise.all([
+      assetSession.getVolumeData(() => {}),
+      ...timestamps.map((timestamp) => assetSession.getImageAtTimestamp(timestamp)),
+    ]);
+    log.info('volume data', volumeData);
+    for (const image of images) {
+      log.info('got image', image.timestamp);
+    }
+    log.info('took', Date.now() - startTime, 'ms');
+    log.info('session stats', assetSession.getStats());
+  } catch (err) {
+    log.error('error', err);
+  } finally {
+    await assetSession.destroy();
+    Avalanche.destroy();
+  }
+};
+
+main();
@@ -0,0 +1,55 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+import log from '../log.js';
+
+import Avalanche from '../avalanche.js';
+import ResourceIo from '../resource_io.js';
+
+// starts a remux, cancels it part way through, then checks the same reader can still get the
+// metadata and an image
+const main = async function () {
+  if (process.argv.length !== 4) {
+    log.info('usage: test_cancel_action.js <source_filename> <dest_filename>');
+    return;
+  }
+
+  const sourceUri = process.argv[2];
+  const resourceIo = new ResourceIo(sourceUri);
+  try {
+    const videoReader = Avalanche.createVideoReader();
+    await videoReader.init(resourceIo);
+
+    const controller = new AbortController();
+    try {
+      await videoReader.remux(
+        process.argv[3],
+        (step, total) => {
+          log.info('progress', step, total);
+          if (step >= total / 2) {
+            controller.abort();
+          }
+        },
+        {},
+        { signal: controller.signal },
+      );
+      log.info('remux finished before it was cancelled');
+    } catch (err) {
+      log.info('remux stopped with', err.message);
+    }
+
+    const metadata = await videoReader.getMetadata({ priority: 'interactive', timeout: 10 });
+    log.info('metadata', metadata);
+    const image = await videoReader.getImageAtTimestamp(1, { priority: 'interactive', timeout: 10 });
+    log.info('image', image.timestamp, image.net_image_buffer.length);
+  } catch (err) {
+    log.info('failed', err);
+    return;
+  } finally {
+    Avalanche.destroy();
+  }
+  log.info('done');
+};
+
+main();
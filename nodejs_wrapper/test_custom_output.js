@@ -0,0 +1,68 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+import fs from 'fs';
+
+import log from '../log.js';
+
+import Avalanche from '../avalanche.js';
+import ResourceIo from '../resource_io.js';
+
+const main = async function () {
+  if (process.argv.length !== 7) {
+    log.info('usage: test_custom_output.js <source_filename> <memory|stream> <dest_filename> <start_time> <end_time>');
+    return;
+  }
+
+  log.info('lavf version', Avalanche.getAvFormatVersionString());
+
+  const sourceUri = process.argv[2];
+  const mode = process.argv[3];
+  const destUri = process.argv[4];
+
+  const resourceIo = new ResourceIo(sourceUri);
+  let fd = null;
+  if (mode === 'memory') {
+    resourceIo.registerOutput(destUri, { inMemory: true });
+  } else {
+    fd = fs.openSync(destUri, 'w');
+    resourceIo.registerOutput(destUri, {
+      writeChunk: async (offset, buffer) => {
+        log.info('writing chunk', offset, buffer.length);
+        fs.writeSync(fd, buffer, 0, buffer.length, offset);
+      },
+    });
+  }
+
+  try {
+    const videoReader = Avalanche.createVideoReader();
+    await videoReader.init(resourceIo);
+    const result = await videoReader.extractClipReencode(
+      destUri,
+      parseFloat(process.argv[5]),
+      parseFloat(process.argv[6]),
+      (step, total) => {
+        log.info('progress', step, total);
+      },
+    );
+    if (result.output_buffer) {
+      log.info('writing in memory output', result.output_buffer.length);
+      fs.writeFileSync(destUri, result.output_buffer);
+      delete result.output_buffer;
+    }
+    log.info('result', result);
+    log.info('activity', resourceIo.summarizeActivity());
+  } catch (err) {
+    log.info('failed to extract clip to custom output', err);
+    return;
+  } finally {
+    if (fd !== null) {
+      fs.closeSync(fd);
+    }
+    Avalanche.destroy();
+  }
+  log.info('done');
+};
+
+main();
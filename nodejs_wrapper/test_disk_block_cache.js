@@ -0,0 +1,48 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+import log from '../log.js';
+
+import Avalanche from '../avalanche.js';
+import ResourceIo from '../resource_io.js';
+
+const MAX_CACHE_SIZE = 1024 * 1024 * 1024;
+
+// reads the metadata twice; the second time (or every time, on later runs) the blocks should
+// come from the disk cache rather than from the resource
+const main = async function () {
+  if (process.argv.length !== 4) {
+    log.info('usage: test_disk_block_cache.js <video_filename> <cache_dir>');
+    return;
+  }
+
+  const uri = process.argv[2];
+  const cacheDir = process.argv[3];
+
+  if (!Avalanche.setDiskBlockCache(cacheDir, MAX_CACHE_SIZE)) {
+    log.error('unable to use cache dir', cacheDir);
+    return;
+  }
+  // so the second read can't be served from memory instead
+  Avalanche.setSharedBlockCacheSize(0);
+
+  try {
+    for (let i = 0; i < 2; i++) {
+      const resourceIo = new ResourceIo(uri);
+      const videoReader = Avalanche.createVideoReader();
+      await videoReader.init(resourceIo);
+      const metadata = await videoReader.getMetadata();
+      log.info('result is', metadata);
+      log.info('io stats', videoReader.getIoStats());
+      log.info('resource io activity', resourceIo.summarizeActivity());
+      await videoReader.destroy();
+    }
+  } catch (err) {
+    log.error('error', err);
+  } finally {
+    Avalanche.destroy();
+  }
+};
+
+main();
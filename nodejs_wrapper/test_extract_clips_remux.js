@@ -0,0 +1,45 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+import log from '../log.js';
+
+import Avalanche from '../avalanche.js';
+import ResourceIo from '../resource_io.js';
+
+const main = async function () {
+  if (process.argv.length < 6 || (process.argv.length - 3) % 3 !== 0) {
+    log.info('usage: test_extract_clips_remux.js <source_filename> [<dest_filename> <start_time> <end_time>]...');
+    return;
+  }
+
+  log.info('lavf version', Avalanche.getAvFormatVersionString());
+
+  const clipRanges = [];
+  for (let i = 3; i < process.argv.length; i += 3) {
+    clipRanges.push({
+      dest_uri: process.argv[i],
+      start_time: parseFloat(process.argv[i + 1]),
+      end_time: parseFloat(process.argv[i + 2]),
+    });
+  }
+
+  const sourceUri = process.argv[2];
+  const resourceIo = new ResourceIo(sourceUri);
+  try {
+    const videoReader = Avalanche.createVideoReader();
+    await videoReader.init(resourceIo);
+    const results = await videoReader.extractClipsRemux(clipRanges, (step, total) => {
+      log.info('progress', step, total);
+    });
+    log.info('results', results);
+  } catch (err) {
+    log.info('failed to extract clips remux', err);
+    return;
+  } finally {
+    Avalanche.destroy();
+  }
+  log.info('done');
+};
+
+main();
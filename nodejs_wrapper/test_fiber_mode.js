@@ -0,0 +1,54 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+import log from '../log.js';
+
+import Avalanche from '../avalanche.js';
+import ResourceIo from '../resource_io.js';
+
+// gets an image with many readers at once on a worker pool of two threads running on fibers;
+// the readers waiting on their reads should be suspended rather than holding up the threads
+const main = async function () {
+  if (process.argv.length !== 5) {
+    log.info('usage: test_fiber_mode.js <video_filename> <timestamp> <count_readers>');
+    return;
+  }
+
+  const uri = process.argv[2];
+  const timestamp = parseFloat(process.argv[3]);
+  const countReaders = parseInt(process.argv[4], 10);
+
+  // both have to be set before the first operation starts the pool
+  Avalanche.setWorkerPoolSize(2);
+  if (!Avalanche.setWorkerPoolFiberMode(true)) {
+    log.error('unable to set fiber mode');
+    return;
+  }
+
+  const startTime = Date.now();
+  try {
+    const getImage = async () => {
+      const videoReader = Avalanche.createVideoReader();
+      try {
+        await videoReader.init(new ResourceIo(uri));
+        return await videoReader.getImageAtTimestamp(timestamp);
+      } finally {
+        await videoReader.destroy();
+      }
+    };
+    const promises = [];
+    for (let i = 0; i < countReaders; i++) {
+      promises.push(getImage());
+    }
+    const results = await Promise.all(promises);
+    log.info('got', results.length, 'images in', Date.now() - startTime, 'ms');
+    log.info('worker pool stats', Avalanche.getWorkerPoolStats());
+  } catch (err) {
+    log.error('error', err);
+  } finally {
+    Avalanche.destroy();
+  }
+};
+
+main();
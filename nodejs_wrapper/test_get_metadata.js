@@ -8,19 +8,26 @@ import Avalanche from '../avalanche.js';
 import ResourceIo from '../resource_io.js';
 
 const main = async function () {
-  if (process.argv.length !== 3) {
-    log.info('usage: test_get_metadata.js <video_filename>');
+  if (process.argv.length !== 3 && process.argv.length !== 4) {
+    log.info('usage: test_get_metadata.js <video_filename> [local|async]');
     return;
   }
 
   log.info('lavf version', Avalanche.getAvFormatVersionString());
 
   const uri = process.argv[2];
-  const resourceIo = new ResourceIo(uri);
+  // local and async read the file natively, bypassing ResourceIo
+  const ioMode = process.argv[3];
   let metadata;
   try {
     const videoReader = Avalanche.createVideoReader();
-    await videoReader.init(resourceIo);
+    if (ioMode === 'local') {
+      await videoReader.init(uri, { use_local_file_io: true });
+    } else if (ioMode === 'async') {
+      await videoReader.init(uri, { use_async_file_io: true });
+    } else {
+      await videoReader.init(new ResourceIo(uri));
+    }
     metadata = await videoReader.getMetadata();
   } catch (err) {
     return;
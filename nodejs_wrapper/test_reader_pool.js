@@ -0,0 +1,43 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+import log from '../log.js';
+
+import Avalanche from '../avalanche.js';
+import ResourceIo from '../resource_io.js';
+
+// gets an image from the same input with a new reader three times; the second and third should
+// get a pooled reader and skip probing
+const main = async function () {
+  if (process.argv.length !== 4) {
+    log.info('usage: test_reader_pool.js <video_filename> <timestamp>');
+    return;
+  }
+
+  const uri = process.argv[2];
+  const timestamp = parseFloat(process.argv[3]);
+
+  Avalanche.setReaderPoolOptions({ ttl: 30 });
+
+  // the pool only matches the same resource io
+  const resourceIo = new ResourceIo(uri);
+  try {
+    for (let i = 0; i < 3; i++) {
+      const startTime = Date.now();
+      const videoReader = Avalanche.createVideoReader();
+      await videoReader.init(resourceIo);
+      const result = await videoReader.getImageAtTimestamp(timestamp);
+      await videoReader.destroy();
+      log.info('got image', result.timestamp, 'in', Date.now() - startTime, 'ms');
+      log.info('reader pool stats', Avalanche.getReaderPoolStats());
+    }
+  } catch (err) {
+    log.error('error', err);
+  } finally {
+    Avalanche.clearReaderPool();
+    Avalanche.destroy();
+  }
+};
+
+main();
@@ -8,11 +8,17 @@ import Avalanche from '../avalanche.js';
 import ResourceIo from '../resource_io.js';
 
 const main = async function () {
-  if (process.argv.length !== 4) {
-    log.info('usage: test_remux.js <source_filename> <dest_filename>');
+  if (process.argv.length !== 4 && process.argv.length !== 5) {
+    log.info('usage: test_remux.js <source_filename> <dest_filename> [fragment_duration]');
     return;
   }
 
+  const outputOptions = {};
+  if (process.argv.length === 5) {
+    outputOptions.is_fragmented = true;
+    outputOptions.fragment_duration = parseFloat(process.argv[4]);
+  }
+
   log.info('lavf version', Avalanche.getAvFormatVersionString());
 
   const sourceUri = process.argv[2];
@@ -20,9 +26,13 @@ const main = async function () {
   try {
     const videoReader = Avalanche.createVideoReader();
     await videoReader.init(resourceIo);
-    const result = await videoReader.remux(process.argv[3], (step, total) => {
-      log.info('progress', step, total);
-    });
+    const result = await videoReader.remux(
+      process.argv[3],
+      (step, total) => {
+        log.info('progress', step, total);
+      },
+      outputOptions,
+    );
     log.info('result', result);
   } catch (err) {
     log.info('failed to remux', err);
@@ -0,0 +1,467 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "../private/utils.h"
+
+#include "../utils.h"
+#include "../uv_mutex_lock.h"
+
+#include "worker_pool.h"
+
+using namespace Avalanche;
+
+constexpr int MIN_DEFAULT_SIZE = 4;
+// per worker, kept for the next tasks instead of being unmapped
+constexpr size_t MAX_FREE_FIBERS = 16;
+
+struct WorkerPoolFiber {
+    ucontext_t context;
+    // where to switch back to when the task is done or suspends; set each time it is switched to
+    ucontext_t *return_context = nullptr;
+    void *stack = nullptr;
+    size_t stack_size = 0;
+    WorkerPool::Task task;
+    WorkerPool::Priority priority = WorkerPool::PRIORITY_NORMAL;
+    bool is_done = false;
+    // set by suspend(), for runFiber() to call once it has switched off the fiber
+    WorkerPool::ArmFunc arm;
+};
+
+// the worker the current thread is, if it is one of the pool's
+static thread_local int current_worker_index = -1;
+// of the task the current thread is running
+static thread_local WorkerPool::Priority current_priority = WorkerPool::PRIORITY_NORMAL;
+// the fiber the current thread is running on, if any
+static thread_local WorkerPoolFiber *current_fiber = nullptr;
+// the fiber being switched to, for fiberEntry() to pick up the first time
+static thread_local WorkerPoolFiber *starting_fiber = nullptr;
+
+static void fiberEntry() {
+    WorkerPoolFiber *fiber = starting_fiber;
+    while (true) {
+        fiber->task();
+        fiber->task = nullptr;
+        fiber->is_done = true;
+        // runFiber() switches back here with the next task to run on this fiber, if it is kept
+        swapcontext(&fiber->context, fiber->return_context);
+    }
+}
+
+static void destroyFiber(WorkerPoolFiber *fiber) {
+    munmap(fiber->stack, fiber->stack_size);
+    delete fiber;
+}
+
+static WorkerPoolFiber * createFiber() {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    // the lowest page is a guard, so running off the end of the stack crashes instead of
+    // writing over whatever is below it
+    size_t stack_size = WorkerPool::FIBER_STACK_SIZE + page_size;
+    void *stack = mmap(nullptr, stack_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        log(LOG_ERROR, "Unable to map fiber stack\n");
+        return nullptr;
+    }
+    if (mprotect(stack, page_size, PROT_NONE) != 0) {
+        log(LOG_ERROR, "Unable to protect fiber stack guard page\n");
+        munmap(stack, stack_size);
+        return nullptr;
+    }
+
+    auto fiber = new WorkerPoolFiber();
+    fiber->stack = stack;
+    fiber->stack_size = stack_size;
+    if (getcontext(&fiber->context) != 0) {
+        log(LOG_ERROR, "Unable to get fiber context\n");
+        destroyFiber(fiber);
+        return nullptr;
+    }
+    fiber->context.uc_stack.ss_sp = static_cast<uint8_t *>(stack) + page_size;
+    fiber->context.uc_stack.ss_size = WorkerPool::FIBER_STACK_SIZE;
+    fiber->context.uc_link = nullptr;
+    makecontext(&fiber->context, fiberEntry, 0);
+    return fiber;
+}
+
+WorkerPool & WorkerPool::getInstance() {
+    // never destroyed, the threads run until the process exits
+    static WorkerPool *worker_pool = new WorkerPool();
+    return *worker_pool;
+}
+
+WorkerPool::WorkerPool() {
+    int ret;
+
+    for (auto &count: m_count_queued_by_priority) {
+        count = 0;
+    }
+
+    ret = uv_mutex_init(&m_mutex);
+    if (ret != 0) {
+        log(LOG_ERROR, "UvMutexInitFailed %i", ret);
+        return;
+    }
+    ret = uv_cond_init(&m_cond);
+    if (ret != 0) {
+        log(LOG_ERROR, "UvCondInitFailed %i", ret);
+        return;
+    }
+}
+
+bool WorkerPool::setSize(int size) {
+    UvMutexLock lock(m_mutex);
+
+    if (m_is_started) {
+        log(LOG_ERROR, "Worker pool size can't be changed once it has started\n");
+        return false;
+    }
+    if (size < 0) {
+        log(LOG_ERROR, "Bad worker pool size %i\n", size);
+        return false;
+    }
+    m_size = size;
+    return true;
+}
+
+bool WorkerPool::setFiberMode(bool is_fiber_mode) {
+    UvMutexLock lock(m_mutex);
+
+    if (m_is_started) {
+        log(LOG_ERROR, "Worker pool fiber mode can't be changed once it has started\n");
+        return false;
+    }
+    m_is_fiber_mode = is_fiber_mode;
+    return true;
+}
+
+void WorkerPool::start() {
+    m_is_started = true;
+    m_start_time_ns = uv_hrtime();
+
+    int size = m_size;
+    if (size == 0) {
+        size = std::max((int)std::thread::hardware_concurrency(), MIN_DEFAULT_SIZE);
+    }
+
+    for (int i = 0; i < size; i++) {
+        auto worker = std::make_unique<Worker>();
+        worker->pool = this;
+        worker->index = m_workers.size();
+        int ret = uv_mutex_init(&worker->mutex);
+        if (ret != 0) {
+            log(LOG_ERROR, "UvMutexInitFailed %i", ret);
+            break;
+        }
+        m_workers.push_back(std::move(worker));
+    }
+
+    // the threads look at all the workers, so none are started until they are all there
+    for (auto &worker: m_workers) {
+        int ret = uv_thread_create(&worker->thread, &WorkerPool::workerThreadEntry, worker.get());
+        if (ret != 0) {
+            // its queues are still looked at by the others, but nothing is queued on it
+            log(LOG_ERROR, "Unable to start worker thread %i\n", ret);
+            continue;
+        }
+        worker->is_running = true;
+    }
+}
+
+bool WorkerPool::queue(Task task, Priority priority) {
+    Worker *worker = nullptr;
+    {
+        UvMutexLock lock(m_mutex);
+
+        if (!m_is_started) {
+            start();
+        }
+        if (current_worker_index >= 0) {
+            worker = m_workers[current_worker_index].get();
+        } else {
+            for (size_t i = 0; i < m_workers.size() && !worker; i++) {
+                Worker *next = m_workers[m_next_worker].get();
+                m_next_worker = (m_next_worker + 1) % m_workers.size();
+                if (next->is_running) {
+                    worker = next;
+                }
+            }
+            if (!worker) {
+                log(LOG_ERROR, "No worker threads to run a task\n");
+                return false;
+            }
+        }
+    }
+
+    {
+        UvMutexLock lock(worker->mutex);
+        worker->tasks[priority].push_back({ std::move(task), priority, uv_hrtime(), m_next_task_id++ });
+        m_count_queued_by_priority[priority]++;
+    }
+
+    UvMutexLock lock(m_mutex);
+    m_count_queued++;
+    uv_cond_signal(&m_cond);
+    return true;
+}
+
+void WorkerPool::yield() {
+    if (current_worker_index < 0) {
+        return;
+    }
+
+    Worker *worker = m_workers[current_worker_index].get();
+    Priority priority = current_priority;
+    while (true) {
+        bool is_waiting = false;
+        for (int p = 0; p < priority; p++) {
+            if (m_count_queued_by_priority[p] > 0) {
+                is_waiting = true;
+            }
+        }
+        if (!is_waiting) {
+            break;
+        }
+
+        QueuedTask queued_task;
+        if (!takeTask(worker, priority, queued_task)) {
+            break;
+        }
+        {
+            UvMutexLock lock(m_mutex);
+            m_count_yielded++;
+        }
+        runTask(worker, queued_task);
+    }
+    current_priority = priority;
+}
+
+bool WorkerPool::isOnFiber() {
+    return current_fiber != nullptr;
+}
+
+void WorkerPool::suspend(ArmFunc arm) {
+    WorkerPoolFiber *fiber = current_fiber;
+    if (!fiber) {
+        log(LOG_ERROR, "Only tasks running on a fiber can be suspended\n");
+        return;
+    }
+
+    fiber->arm = std::move(arm);
+    // back to runFiber(), which switches here again when the task is resumed
+    swapcontext(&fiber->context, fiber->return_context);
+}
+
+void WorkerPool::resume(Worker *worker, WorkerPoolFiber *fiber) {
+    {
+        UvMutexLock lock(worker->mutex);
+        worker->resumed_tasks[fiber->priority].push_back({ nullptr, fiber->priority, uv_hrtime(), m_next_task_id++, fiber });
+        m_count_queued_by_priority[fiber->priority]++;
+    }
+
+    UvMutexLock lock(m_mutex);
+    m_count_waiting--;
+    worker->count_resumed++;
+    // only its own worker can take it, and it may not be the one a signal would wake
+    uv_cond_broadcast(&m_cond);
+}
+
+WorkerPoolStats WorkerPool::getStats() {
+    UvMutexLock lock(m_mutex);
+
+    WorkerPoolStats stats;
+    for (auto &worker: m_workers) {
+        if (worker->is_running) {
+            stats.count_threads++;
+        }
+    }
+    stats.count_busy = m_count_busy;
+    stats.queue_depth = m_count_queued;
+    for (auto &worker: m_workers) {
+        stats.queue_depth += worker->count_resumed;
+    }
+    stats.count_completed = m_count_completed;
+    stats.count_stolen = m_count_stolen;
+    stats.count_yielded = m_count_yielded;
+    stats.count_suspended = m_count_suspended;
+    stats.count_waiting = m_count_waiting;
+    stats.busy_time_ns = m_busy_time_ns;
+    if (m_is_started) {
+        stats.uptime_ns = uv_hrtime() - m_start_time_ns;
+    }
+    return stats;
+}
+
+void WorkerPool::workerThreadEntry(void *arg) {
+    auto worker = static_cast<Worker *>(arg);
+    worker->pool->runWorker(worker);
+}
+
+bool WorkerPool::takeTask(Worker *worker, int end_priority, QueuedTask &queued_task) {
+    while (true) {
+        // find the best task by looking at the front of every queue, this worker's first so it
+        // wins ties
+        Worker *best_worker = nullptr;
+        int best_priority = 0;
+        bool is_best_resumed = false;
+        uint64_t best_rank = 0;
+        uint64_t best_id = 0;
+        for (size_t i = 0; i < m_workers.size(); i++) {
+            Worker *other = m_workers[(worker->index + i) % m_workers.size()].get();
+            UvMutexLock lock(other->mutex);
+            for (int p = 0; p < end_priority; p++) {
+                // resumed tasks stay on the thread they were started on
+                for (int is_resumed = 0; is_resumed < (other == worker ? 2 : 1); is_resumed++) {
+                    auto &tasks = is_resumed ? other->resumed_tasks[p] : other->tasks[p];
+                    if (tasks.empty()) {
+                        continue;
+                    }
+                    auto &front = tasks.front();
+                    uint64_t rank = front.queue_time_ns + p * AGING_PERIOD_NS;
+                    if (!best_worker || rank < best_rank) {
+                        best_worker = other;
+                        best_priority = p;
+                        is_best_resumed = is_resumed;
+                        best_rank = rank;
+                        best_id = front.id;
+                    }
+                }
+            }
+        }
+        if (!best_worker) {
+            return false;
+        }
+
+        {
+            UvMutexLock lock(best_worker->mutex);
+            auto &tasks = is_best_resumed ? best_worker->resumed_tasks[best_priority] : best_worker->tasks[best_priority];
+            // another thread may have taken it while the rest were looked at
+            if (tasks.empty() || tasks.front().id != best_id) {
+                continue;
+            }
+            queued_task = std::move(tasks.front());
+            tasks.pop_front();
+            m_count_queued_by_priority[best_priority]--;
+        }
+
+        UvMutexLock lock(m_mutex);
+        if (is_best_resumed) {
+            worker->count_resumed--;
+        } else {
+            m_count_queued--;
+        }
+        if (best_worker != worker) {
+            m_count_stolen++;
+        }
+        return true;
+    }
+}
+
+void WorkerPool::runTask(Worker *worker, QueuedTask &queued_task) {
+    current_priority = queued_task.priority;
+
+    if (m_is_fiber_mode && runFiber(worker, queued_task)) {
+        return;
+    }
+
+    queued_task.task();
+    queued_task.task = nullptr;
+
+    UvMutexLock lock(m_mutex);
+    m_count_completed++;
+}
+
+void WorkerPool::runWorker(Worker *worker) {
+    current_worker_index = worker->index;
+
+    while (true) {
+        {
+            UvMutexLock lock(m_mutex);
+            while (m_count_queued <= 0 && worker->count_resumed <= 0) {
+                uv_cond_wait(&m_cond, &m_mutex);
+            }
+        }
+
+        QueuedTask queued_task;
+        if (!takeTask(worker, COUNT_PRIORITIES, queued_task)) {
+            // another thread took it first, or is just about to count that it did
+            std::this_thread::yield();
+            continue;
+        }
+
+        {
+            UvMutexLock lock(m_mutex);
+            m_count_busy++;
+        }
+        // this includes any tasks run from yield() in the middle of it
+        uint64_t start_time_ns = uv_hrtime();
+        runTask(worker, queued_task);
+        uint64_t busy_time_ns = uv_hrtime() - start_time_ns;
+        {
+            UvMutexLock lock(m_mutex);
+            m_count_busy--;
+            m_busy_time_ns += busy_time_ns;
+        }
+    }
+}
+
+bool WorkerPool::runFiber(Worker *worker, QueuedTask &queued_task) {
+    WorkerPoolFiber *fiber = queued_task.fiber;
+    if (!fiber) {
+        if (!worker->free_fibers.empty()) {
+            fiber = worker->free_fibers.back();
+            worker->free_fibers.pop_back();
+        } else {
+            fiber = createFiber();
+            if (!fiber) {
+                // it is run on the thread instead, and holds on to it while it waits
+                return false;
+            }
+        }
+        fiber->task = std::move(queued_task.task);
+        fiber->priority = queued_task.priority;
+        fiber->is_done = false;
+    }
+
+    // a task run from a yield point is switched to from the fiber of the task that yielded
+    WorkerPoolFiber *outer_fiber = current_fiber;
+    ucontext_t return_context;
+    fiber->return_context = &return_context;
+    current_fiber = fiber;
+    starting_fiber = fiber;
+    swapcontext(&return_context, &fiber->context);
+    current_fiber = outer_fiber;
+
+    if (fiber->is_done) {
+        if (worker->free_fibers.size() < MAX_FREE_FIBERS) {
+            worker->free_fibers.push_back(fiber);
+        } else {
+            destroyFiber(fiber);
+        }
+
+        UvMutexLock lock(m_mutex);
+        m_count_completed++;
+        return true;
+    }
+
+    // it suspended; now that nothing is running on its stack, whatever it is waiting for can
+    // be told how to resume it, even if that happens on another thread right away
+    {
+        UvMutexLock lock(m_mutex);
+        m_count_suspended++;
+        m_count_waiting++;
+    }
+    ArmFunc arm = std::move(fiber->arm);
+    fiber->arm = nullptr;
+    arm([this, worker, fiber]() {
+        resume(worker, fiber);
+    });
+    return true;
+}
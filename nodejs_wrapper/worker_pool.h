@@ -0,0 +1,165 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "uv.h"
+
+struct WorkerPoolStats {
+    int count_threads = 0;
+    int count_busy = 0;
+    // tasks waiting for a thread
+    int queue_depth = 0;
+    int64_t count_completed = 0;
+    // tasks run by a different thread than the one they were queued on
+    int64_t count_stolen = 0;
+    // tasks run from a yield point in the middle of another one
+    int64_t count_yielded = 0;
+    // times a task running on a fiber gave up its thread to wait for something
+    int64_t count_suspended = 0;
+    // tasks on fibers that are waiting for something right now
+    int count_waiting = 0;
+    // summed over all threads since the pool started
+    int64_t busy_time_ns = 0;
+    int64_t uptime_ns = 0;
+};
+
+// what a task runs on in fiber mode, see worker_pool.cc
+struct WorkerPoolFiber;
+
+// Process wide pool of threads that run the native side of VideoReader operations, instead of
+// libuv's default threadpool, which is shared with fs, dns and zlib and is only 4 threads unless
+// UV_THREADPOOL_SIZE is set before anything uses it.
+//
+// Each thread has its own queues, one per priority. Tasks queued from a pool thread go on that
+// thread's queues and the rest are spread around the threads in turn; a thread takes the best
+// task waiting on any of them, preferring its own. The best task is the one that has waited the
+// longest, after counting each priority below interactive as AGING_PERIOD_NS of waiting time it
+// doesn't have, so batch work still gets run when interactive work keeps coming.
+//
+// Long running tasks call yield() now and then, which runs any tasks of a higher priority than
+// theirs that are waiting, right there, before going on. The threads are started when the first
+// task is queued.
+//
+// In fiber mode, each task runs on a stack of its own instead of its thread's, so that when it
+// has to wait for something (javascript fetching a file, say, deep inside a libav read), it can
+// suspend() and leave its thread free to run other tasks, rather than parking it until the wait
+// is over. Whatever it waits on resumes it, and it carries on from where it was, on the same
+// thread: the threads' thread locals (libav's and libc's included) may be cached by code on the
+// task's stack, so a task is never moved to another thread once it has started. Fibers are
+// opt in, since each waiting task holds on to a stack, and switching costs a couple of syscalls.
+class WorkerPool {
+public:
+    enum Priority {
+        PRIORITY_INTERACTIVE = 0,
+        PRIORITY_NORMAL,
+        PRIORITY_BATCH,
+        COUNT_PRIORITIES,
+    };
+
+    static constexpr uint64_t AGING_PERIOD_NS = 5000ull * 1000 * 1000;
+
+    typedef std::function<void()> Task;
+    // gets a suspended task going again; from any thread, once
+    typedef std::function<void()> ResumeFunc;
+    // called once a suspended task is off its thread, to hand the resume func to whatever
+    // it is waiting on
+    typedef std::function<void(ResumeFunc)> ArmFunc;
+
+    static constexpr size_t FIBER_STACK_SIZE = 2 * 1024 * 1024;
+
+    static WorkerPool & getInstance();
+
+    // only before the first task is queued; 0 means one thread per cpu
+    bool setSize(int size);
+    // only before the first task is queued
+    bool setFiberMode(bool is_fiber_mode);
+
+    // false if there are no threads to run it
+    bool queue(Task task, Priority priority = PRIORITY_NORMAL);
+
+    // from a running task; does nothing when called from any other thread
+    void yield();
+
+    // true if called from a task running on a fiber, which can suspend()
+    bool isOnFiber();
+    // from a task running on a fiber; switches off it, then calls arm, and returns once the
+    // resume func arm was given has been called. arm may call it right away
+    void suspend(ArmFunc arm);
+
+    WorkerPoolStats getStats();
+
+private:
+    WorkerPool();
+
+    struct QueuedTask {
+        Task task;
+        Priority priority;
+        uint64_t queue_time_ns;
+        uint64_t id;
+        // of a suspended task being resumed, instead of task
+        WorkerPoolFiber *fiber = nullptr;
+    };
+
+    struct Worker {
+        WorkerPool *pool;
+        int index;
+        bool is_running = false;
+        uv_thread_t thread;
+        uv_mutex_t mutex;
+        std::deque<QueuedTask> tasks[COUNT_PRIORITIES];
+        // resumed tasks, which only this worker can take
+        std::deque<QueuedTask> resumed_tasks[COUNT_PRIORITIES];
+        // the same count, guarded by the pool's m_mutex
+        int count_resumed = 0;
+        // done with, for the next task; only touched by this worker's thread
+        std::vector<WorkerPoolFiber *> free_fibers;
+    };
+
+    uv_mutex_t m_mutex;
+    // signalled when a task is queued
+    uv_cond_t m_cond;
+
+    int m_size = 0;
+    bool m_is_fiber_mode = false;
+    bool m_is_started = false;
+    // only changed by start(), before any of the threads are running
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    int m_next_worker = 0;
+    std::atomic<uint64_t> m_next_task_id{0};
+
+    // queued but not yet taken by a thread
+    int m_count_queued = 0;
+    // the same, by priority, for yield() to look at without locking
+    std::atomic<int> m_count_queued_by_priority[COUNT_PRIORITIES];
+    int m_count_busy = 0;
+    int64_t m_count_completed = 0;
+    int64_t m_count_stolen = 0;
+    int64_t m_count_yielded = 0;
+    int64_t m_count_suspended = 0;
+    int m_count_waiting = 0;
+    int64_t m_busy_time_ns = 0;
+    uint64_t m_start_time_ns = 0;
+
+    // called with m_mutex held
+    void start();
+
+    static void workerThreadEntry(void *arg);
+    void runWorker(Worker *worker);
+    // only tasks with a priority before end_priority are looked at
+    bool takeTask(Worker *worker, int end_priority, QueuedTask &queued_task);
+    void runTask(Worker *worker, QueuedTask &queued_task);
+    // runs or resumes the task on a fiber, until it is done or suspends; false if there is no
+    // fiber to run it on, in which case it hasn't been run
+    bool runFiber(Worker *worker, QueuedTask &queued_task);
+    void resume(Worker *worker, WorkerPoolFiber *fiber);
+};
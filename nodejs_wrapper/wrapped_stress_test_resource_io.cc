@@ -42,10 +42,12 @@ public:
                 break;
             }
 
-            m_resource_io_group->read(fake_m3u8, 0, read_buf, sizeof(read_buf));
-            m_resource_io_group->read(fake_m3u8, 0, read_buf, sizeof(read_buf));
-            m_resource_io_group->read(fake_ts, 0, read_buf, sizeof(read_buf));
-            m_resource_io_group->read(fake_ts, 0, read_buf, sizeof(read_buf));
+            auto resource_io = static_cast<ResourceIo *>(input_format_context->opaque);
+            auto resource_io2 = static_cast<ResourceIo *>(input_format_context2->opaque);
+            m_resource_io_group->read(resource_io, 0, read_buf, sizeof(read_buf));
+            m_resource_io_group->read(resource_io, 0, read_buf, sizeof(read_buf));
+            m_resource_io_group->read(resource_io2, 0, read_buf, sizeof(read_buf));
+            m_resource_io_group->read(resource_io2, 0, read_buf, sizeof(read_buf));
             m_resource_io_group->close(input_format_context2->opaque);
             m_resource_io_group->close(input_format_context->opaque);
         }
@@ -10,6 +10,66 @@
 
 using namespace Avalanche;
 
+// wraps output kept in memory by a custom output in a Buffer without copying it
+static Napi::Value newOutputBuffer(Napi::Env env, std::shared_ptr<OutputChunk> output_data) {
+    auto hint = new std::shared_ptr<OutputChunk>(output_data);
+    auto finalizer = [](Napi::Env, uint8_t *, std::shared_ptr<OutputChunk> *hint) {
+        delete hint;
+    };
+    return Napi::Buffer<uint8_t>::New(env, output_data->data(), output_data->size(), finalizer, hint);
+}
+
+// reads the optional output options object:
+// { is_fragmented, fragment_duration, hls_segment_duration, is_hls_mpegts }
+static bool getOutputOptions(const Napi::Value &value, OutputOptions &output_options) {
+    if (!value.IsObject()) {
+        return false;
+    }
+    auto obj = value.As<Napi::Object>();
+
+    if (obj.Has("is_fragmented")) {
+        Napi::Value val_is_fragmented = obj.Get("is_fragmented");
+        if (!val_is_fragmented.IsBoolean()) {
+            return false;
+        }
+        output_options.is_fragmented = val_is_fragmented.As<Napi::Boolean>().Value();
+    }
+    if (obj.Has("fragment_duration")) {
+        Napi::Value val_fragment_duration = obj.Get("fragment_duration");
+        if (!val_fragment_duration.IsNumber()) {
+            return false;
+        }
+        output_options.fragment_duration = val_fragment_duration.As<Napi::Number>().DoubleValue();
+    }
+    if (obj.Has("hls_segment_duration")) {
+        Napi::Value val_hls_segment_duration = obj.Get("hls_segment_duration");
+        if (!val_hls_segment_duration.IsNumber()) {
+            return false;
+        }
+        output_options.hls_segment_duration = val_hls_segment_duration.As<Napi::Number>().DoubleValue();
+    }
+    if (obj.Has("is_hls_mpegts")) {
+        Napi::Value val_is_hls_mpegts = obj.Get("is_hls_mpegts");
+        if (!val_is_hls_mpegts.IsBoolean()) {
+            return false;
+        }
+        output_options.is_hls_mpegts = val_is_hls_mpegts.As<Napi::Boolean>().Value();
+    }
+    return true;
+}
+
+// what an action that didn't succeed is rejected with; stopping it on purpose isn't a failure
+static std::string getFailure(VideoReader &video_reader, const char *failure) {
+    OperationControl &operation_control = video_reader.getOperationControl();
+    if (operation_control.isCancelled()) {
+        return "Cancelled";
+    }
+    if (operation_control.isPastDeadline()) {
+        return "DeadlineExceeded";
+    }
+    return failure;
+}
+
 WrappedVideoReader::WrappedVideoReader(const Napi::CallbackInfo &info) : ObjectWrap(info) {
     Napi::Env env = info.Env();
 
@@ -31,11 +91,11 @@ WrappedVideoReader::~WrappedVideoReader() {
         // and the close() would hang
         m_resource_io_group->setStopProcessing();
     }
-
-    for (auto buffer_image: m_pending_buffer_images) {
-        // BufferImage has the same issue as resource_io_group--it calls back to javascript,
-        // so we need to trigger all pending callbacks to stop now
-        buffer_image->drain();
+    if (m_local_file_io_group) {
+        m_local_file_io_group->setStopProcessing();
+    }
+    if (m_async_file_io_group) {
+        m_async_file_io_group->setStopProcessing();
     }
 
     m_video_reader.destroy();
@@ -43,6 +103,12 @@ WrappedVideoReader::~WrappedVideoReader() {
     if (m_resource_io_group) {
         m_resource_io_group = nullptr;
     }
+    if (m_local_file_io_group) {
+        m_local_file_io_group = nullptr;
+    }
+    if (m_async_file_io_group) {
+        m_async_file_io_group = nullptr;
+    }
 
 }
 
@@ -54,13 +120,17 @@ class InitWorker : public PromiseWorker {
 public:
     InitWorker(
         const Napi::Promise::Deferred &deferred,
-        std::shared_ptr<ResourceIoGroup> resource_io_group,
+        std::shared_ptr<CustomIoGroup> custom_io_group,
         VideoReader &video_reader,
-        const std::string &uri) :
+        const std::string &uri,
+        std::unique_ptr<ProbeSnapshot> probe_snapshot,
+        const std::vector<ProbeTier> &probe_tiers) :
         PromiseWorker(deferred),
-        m_resource_io_group(resource_io_group),
+        m_custom_io_group(custom_io_group),
         m_video_reader(video_reader),
-        m_uri(uri) {
+        m_uri(uri),
+        m_probe_snapshot(std::move(probe_snapshot)),
+        m_probe_tiers(probe_tiers) {
     }
 
     virtual ~InitWorker() {
@@ -68,7 +138,11 @@ public:
 
     // This code will be executed on the worker thread; not allowed to call any napi
     void Execute() override {
-        if (!m_video_reader.init(m_resource_io_group.get(), m_uri)) {
+        m_video_reader.setProbeTiers(m_probe_tiers);
+        if (!m_video_reader.init(m_custom_io_group.get(), m_uri, m_probe_snapshot.get())) {
+            if (m_video_reader.getOperationControl().isStopped()) {
+                SetError(getFailure(m_video_reader, "InitFailure"));
+            }
             m_success = false;
             return;
         }
@@ -82,18 +156,54 @@ public:
     }
 
 private:
-    std::shared_ptr<ResourceIoGroup> m_resource_io_group;
+    std::shared_ptr<CustomIoGroup> m_custom_io_group;
     VideoReader &m_video_reader;
     std::string m_uri;
+    std::unique_ptr<ProbeSnapshot> m_probe_snapshot;
+    std::vector<ProbeTier> m_probe_tiers;
 
     bool m_success = false;
 };
 
+// reads the probe_tiers init option: [{ probe_size, analyze_duration }, ...]
+static bool getProbeTiers(const Napi::Value &value, std::vector<ProbeTier> &probe_tiers) {
+    if (!value.IsArray()) {
+        return false;
+    }
+    auto array = value.As<Napi::Array>();
+    if (array.Length() == 0) {
+        return false;
+    }
+
+    probe_tiers.clear();
+    for (uint32_t i = 0; i < array.Length(); i++) {
+        Napi::Value val_tier = array.Get(i);
+        if (!val_tier.IsObject()) {
+            return false;
+        }
+        auto tier_obj = val_tier.As<Napi::Object>();
+        Napi::Value val_probe_size = tier_obj.Get("probe_size");
+        Napi::Value val_analyze_duration = tier_obj.Get("analyze_duration");
+        if (!val_probe_size.IsNumber() || !val_analyze_duration.IsNumber()) {
+            return false;
+        }
+        ProbeTier probe_tier;
+        probe_tier.probe_size = val_probe_size.As<Napi::Number>().Int64Value();
+        probe_tier.analyze_duration = val_analyze_duration.As<Napi::Number>().DoubleValue();
+        // libav won't probe with less than this
+        if (probe_tier.probe_size < 32 || probe_tier.analyze_duration <= 0) {
+            return false;
+        }
+        probe_tiers.push_back(probe_tier);
+    }
+    return true;
+}
+
 Napi::Value WrappedVideoReader::init(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
 
-    if (info.Length() != 1) {
+    if (info.Length() != 1 && info.Length() != 2) {
         std::string err = "Wrong number of arguments " + info.Length();
         Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
         return env.Null();
@@ -104,21 +214,89 @@ Napi::Value WrappedVideoReader::init(const Napi::CallbackInfo &info) {
         return env.Null();
     }
 
+    // optional { use_local_file_io, use_async_file_io }, which read a local file natively
+    // instead of through libav's file protocol: memory mapped, or with reads queued ahead, and
+    // { probe_snapshot }, a Buffer from getProbeSnapshot() after an earlier init of the input,
+    // and { probe_tiers } to probe it with instead of the default ones
+    bool use_local_file_io = false;
+    bool use_async_file_io = false;
+    std::unique_ptr<ProbeSnapshot> probe_snapshot;
+    std::vector<ProbeTier> probe_tiers = VideoReader::getDefaultProbeTiers();
+    if (info.Length() == 2) {
+        if (!info[1].IsObject()) {
+            Napi::TypeError::New(env, "Wrong argument 1").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        auto options_obj = info[1].As<Napi::Object>();
+        if (options_obj.Has("use_local_file_io")) {
+            Napi::Value val_use_local_file_io = options_obj.Get("use_local_file_io");
+            if (!val_use_local_file_io.IsBoolean()) {
+                Napi::TypeError::New(env, "Wrong argument 1").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            use_local_file_io = val_use_local_file_io.As<Napi::Boolean>().Value();
+        }
+        if (options_obj.Has("use_async_file_io")) {
+            Napi::Value val_use_async_file_io = options_obj.Get("use_async_file_io");
+            if (!val_use_async_file_io.IsBoolean()) {
+                Napi::TypeError::New(env, "Wrong argument 1").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            use_async_file_io = val_use_async_file_io.As<Napi::Boolean>().Value();
+        }
+        if (options_obj.Has("probe_snapshot")) {
+            Napi::Value val_probe_snapshot = options_obj.Get("probe_snapshot");
+            if (!val_probe_snapshot.IsBuffer()) {
+                Napi::TypeError::New(env, "Wrong argument 1").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            auto buffer = val_probe_snapshot.As<Napi::Buffer<char>>();
+            probe_snapshot = std::make_unique<ProbeSnapshot>();
+            // one that can't be read is ignored, and the input is probed as usual
+            if (!probe_snapshot->deserialize(std::string(buffer.Data(), buffer.Length()))) {
+                probe_snapshot = nullptr;
+            }
+        }
+        if (options_obj.Has("probe_tiers")) {
+            if (!getProbeTiers(options_obj.Get("probe_tiers"), probe_tiers)) {
+                Napi::TypeError::New(env, "Wrong argument 1").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+        }
+    }
+    if (use_local_file_io && use_async_file_io) {
+        Napi::TypeError::New(env, "Only one of use_local_file_io and use_async_file_io can be set").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
     std::string source_uri;
-    auto resource_io_obj = info[0].As<Napi::Object>();
+    std::shared_ptr<CustomIoGroup> custom_io_group;
     if (info[0].IsObject()) {
+        if (use_local_file_io || use_async_file_io) {
+            Napi::TypeError::New(env, "Local file io needs a file path, not a resource io").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        auto resource_io_obj = info[0].As<Napi::Object>();
         m_resource_io_group = std::make_shared<ResourceIoGroup>(resource_io_obj);
+        custom_io_group = m_resource_io_group;
         Napi::Function get_primary_uri_func = resource_io_obj.Get("getPrimaryUri").As<Napi::Function>();
         auto val_uri = get_primary_uri_func.Call(resource_io_obj, {});
         source_uri = val_uri.As<Napi::String>();
     } else {
         source_uri = info[0].As<Napi::String>();
+        if (use_local_file_io) {
+            m_local_file_io_group = std::make_shared<LocalFileIoGroup>();
+            custom_io_group = m_local_file_io_group;
+        } else if (use_async_file_io) {
+            m_async_file_io_group = std::make_shared<AsyncFileIoGroup>();
+            custom_io_group = m_async_file_io_group;
+        }
     }
 
     Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
 
-    InitWorker *worker = new InitWorker(deferred, m_resource_io_group, m_video_reader, source_uri);
-    worker->Queue();
+    InitWorker *worker = new InitWorker(deferred, custom_io_group, m_video_reader, source_uri, std::move(probe_snapshot), probe_tiers);
+    worker->Queue(m_priority);
 
     return deferred.Promise();
 }
@@ -142,11 +320,11 @@ Napi::Value WrappedVideoReader::destroy(const Napi::CallbackInfo &info) {
         // and the close() would hang
         m_resource_io_group->setStopProcessing();
     }
-
-    for (auto buffer_image: m_pending_buffer_images) {
-        // BufferImage has the same issue as resource_io_group--it calls back to javascript,
-        // so we need to trigger all pending callbacks to stop now
-        buffer_image->drain();
+    if (m_local_file_io_group) {
+        m_local_file_io_group->setStopProcessing();
+    }
+    if (m_async_file_io_group) {
+        m_async_file_io_group->setStopProcessing();
     }
 
     m_video_reader.destroy();
@@ -154,6 +332,12 @@ Napi::Value WrappedVideoReader::destroy(const Napi::CallbackInfo &info) {
     if (m_resource_io_group) {
         m_resource_io_group = nullptr;
     }
+    if (m_local_file_io_group) {
+        m_local_file_io_group = nullptr;
+    }
+    if (m_async_file_io_group) {
+        m_async_file_io_group = nullptr;
+    }
 
     //printf("WrappedVideoReader::destroy returning\n");
 
@@ -179,11 +363,11 @@ Napi::Value WrappedVideoReader::drain(const Napi::CallbackInfo &info) {
         // and the close() would hang
         m_resource_io_group->setStopProcessing();
     }
-
-    for (auto buffer_image: m_pending_buffer_images) {
-        // BufferImage has the same issue as resource_io_group--it calls back to javascript,
-        // so we need to trigger all pending callbacks to stop now
-        buffer_image->drain();
+    if (m_local_file_io_group) {
+        m_local_file_io_group->setStopProcessing();
+    }
+    if (m_async_file_io_group) {
+        m_async_file_io_group->setStopProcessing();
     }
 
     //printf("WrappedVideoReader::drain returning\n");
@@ -228,18 +412,13 @@ public:
     GetImageAtTimestampWorker(
         const Napi::Promise::Deferred &deferred,
         VideoReader &video_reader,
-        BufferImageSet &pending_buffer_images,
         double timestamp) :
         PromiseWorker(deferred),
         m_video_reader(video_reader),
-        m_pending_buffer_images(pending_buffer_images),
-        m_timestamp(timestamp),
-        m_image(deferred.Env()) {
-        m_pending_buffer_images.insert(&m_image);
+        m_timestamp(timestamp) {
     }
 
     virtual ~GetImageAtTimestampWorker() {
-        m_pending_buffer_images.erase(&m_image);
     }
 
     // This code will be executed on the worker thread; not allowed to call any napi
@@ -248,7 +427,7 @@ public:
             if (m_get_image_result.is_eof) {
                 SetError("Eof");
             } else {
-                SetError("GetImageAtTimestampFailure");
+                SetError(getFailure(m_video_reader, "GetImageAtTimestampFailure"));
             }
             return;
         }
@@ -265,22 +444,16 @@ public:
             return;
         }
 
-        Napi::Reference<Napi::Buffer<uint8_t>> &buffer_ref = m_image.getBufferRef();
-        auto net_image_buffer = buffer_ref.Value();
-
         Napi::Object result = Napi::Object::New(env);
-        result.Set("net_image_buffer", net_image_buffer);
+        result.Set("net_image_buffer", m_image.takeBuffer(env));
         result.Set("timestamp", Napi::Number::New(env, m_get_image_result.timestamp));
         result.Set("duration", Napi::Number::New(env, m_get_image_result.duration));
 
-        buffer_ref.Unref();
-
         deferred.Resolve(result);
     }
 
 private:
     VideoReader &m_video_reader;
-    BufferImageSet &m_pending_buffer_images;
     double m_timestamp;
 
     BufferImage m_image;
@@ -306,8 +479,8 @@ Napi::Value WrappedVideoReader::getImageAtTimestamp(const Napi::CallbackInfo &in
 
     Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
 
-    GetImageAtTimestampWorker *worker = new GetImageAtTimestampWorker(deferred, m_video_reader, m_pending_buffer_images, timestamp);
-    worker->Queue();
+    GetImageAtTimestampWorker *worker = new GetImageAtTimestampWorker(deferred, m_video_reader, timestamp);
+    worker->Queue(m_priority);
 
     return deferred.Promise();
 }
@@ -328,7 +501,7 @@ public:
     // This code will be executed on the worker thread; not allowed to call any napi
     void Execute() override {
         if (!m_video_reader.getMetadata(m_get_metadata_result)) {
-            SetError("GetMetadataFailure");
+            SetError(getFailure(m_video_reader, "GetMetadataFailure"));
             return;
         }
     }
@@ -370,7 +543,7 @@ Napi::Value WrappedVideoReader::getMetadata(const Napi::CallbackInfo &info) {
     Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
 
     GetMetadataWorker *worker = new GetMetadataWorker(deferred, m_video_reader);
-    worker->Queue();
+    worker->Queue(m_priority);
 
     return deferred.Promise();
 }
@@ -383,13 +556,15 @@ public:
         const std::string &dest_uri,
         double start_time,
         double end_time,
-        const Napi::Function &progress_func
+        const Napi::Function &progress_func,
+        const OutputOptions &output_options
         ) :
         PromiseWorker(deferred),
         m_video_reader(video_reader),
         m_dest_uri(dest_uri),
         m_start_time(start_time),
-        m_end_time(end_time) {
+        m_end_time(end_time),
+        m_output_options(output_options) {
 
         auto finalizer = [](const Napi::Env &) {};
         m_progress_func = Napi::ThreadSafeFunction::New(deferred.Env(), progress_func, "progress_log", 0, 1, finalizer);
@@ -418,8 +593,8 @@ public:
             m_progress_func.Release();
         };
 
-        if (!m_video_reader.extractClipReencode(m_dest_uri, m_start_time, m_end_time, m_extract_clip_result, progress_func)) {
-            SetError("ExtractClipReencodeFailure");
+        if (!m_video_reader.extractClipReencode(m_dest_uri, m_start_time, m_end_time, m_extract_clip_result, progress_func, m_output_options)) {
+            SetError(getFailure(m_video_reader, "ExtractClipReencodeFailure"));
             return;
         }
     }
@@ -434,6 +609,10 @@ public:
         result.Set("count_video_packets", Napi::Number::New(env, m_extract_clip_result.count_video_packets));
         result.Set("count_key_frames", Napi::Number::New(env, m_extract_clip_result.count_key_frames));
 
+        if (m_extract_clip_result.output_data) {
+            result.Set("output_buffer", newOutputBuffer(env, m_extract_clip_result.output_data));
+        }
+
         deferred.Resolve(result);
     }
 
@@ -443,6 +622,7 @@ private:
     double m_start_time;
     double m_end_time;
     Napi::ThreadSafeFunction m_progress_func;
+    OutputOptions m_output_options;
 
     ExtractClipResult m_extract_clip_result;
 };
@@ -451,7 +631,7 @@ Napi::Value WrappedVideoReader::extractClipReencode(const Napi::CallbackInfo &in
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
 
-    if (info.Length() != 4) {
+    if (info.Length() != 4 && info.Length() != 5) {
         std::string err = "Wrong number of arguments " + info.Length();
         Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
         return env.Null();
@@ -479,10 +659,16 @@ Napi::Value WrappedVideoReader::extractClipReencode(const Napi::CallbackInfo &in
     double end_time(info[2].As<Napi::Number>().DoubleValue());
     Napi::Function progress_func = info[3].As<Napi::Function>();
 
+    OutputOptions output_options;
+    if (info.Length() == 5 && !getOutputOptions(info[4], output_options)) {
+        Napi::TypeError::New(env, "Wrong argument 4").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
     Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
 
-    ExtractClipReencodeWorker *worker = new ExtractClipReencodeWorker(deferred, m_video_reader, dest_uri, start_time, end_time, progress_func);
-    worker->Queue();
+    ExtractClipReencodeWorker *worker = new ExtractClipReencodeWorker(deferred, m_video_reader, dest_uri, start_time, end_time, progress_func, output_options);
+    worker->Queue(m_priority);
 
     return deferred.Promise();
 }
@@ -495,13 +681,15 @@ public:
         const std::string &dest_uri,
         double start_time,
         double end_time,
-        const Napi::Function &progress_func
+        const Napi::Function &progress_func,
+        const OutputOptions &output_options
         ) :
         PromiseWorker(deferred),
         m_video_reader(video_reader),
         m_dest_uri(dest_uri),
         m_start_time(start_time),
-        m_end_time(end_time) {
+        m_end_time(end_time),
+        m_output_options(output_options) {
 
         auto finalizer = [](const Napi::Env &) {};
         m_progress_func = Napi::ThreadSafeFunction::New(deferred.Env(), progress_func, "progress_log", 0, 1, finalizer);
@@ -530,8 +718,8 @@ public:
             m_progress_func.Release();
         };
 
-        if (!m_video_reader.extractClipRemux(m_dest_uri, m_start_time, m_end_time, m_extract_clip_result, progress_func)) {
-            SetError("ExtractClipRemuxFailure");
+        if (!m_video_reader.extractClipRemux(m_dest_uri, m_start_time, m_end_time, m_extract_clip_result, progress_func, m_output_options)) {
+            SetError(getFailure(m_video_reader, "ExtractClipRemuxFailure"));
             return;
         }
     }
@@ -546,6 +734,10 @@ public:
         result.Set("count_video_packets", Napi::Number::New(env, m_extract_clip_result.count_video_packets));
         result.Set("count_key_frames", Napi::Number::New(env, m_extract_clip_result.count_key_frames));
 
+        if (m_extract_clip_result.output_data) {
+            result.Set("output_buffer", newOutputBuffer(env, m_extract_clip_result.output_data));
+        }
+
         deferred.Resolve(result);
     }
 
@@ -555,6 +747,7 @@ private:
     double m_start_time;
     double m_end_time;
     Napi::ThreadSafeFunction m_progress_func;
+    OutputOptions m_output_options;
 
     ExtractClipResult m_extract_clip_result;
 };
@@ -563,7 +756,7 @@ Napi::Value WrappedVideoReader::extractClipRemux(const Napi::CallbackInfo &info)
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
 
-    if (info.Length() != 4) {
+    if (info.Length() != 4 && info.Length() != 5) {
         std::string err = "Wrong number of arguments " + info.Length();
         Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
         return env.Null();
@@ -591,10 +784,160 @@ Napi::Value WrappedVideoReader::extractClipRemux(const Napi::CallbackInfo &info)
     double end_time(info[2].As<Napi::Number>().DoubleValue());
     Napi::Function progress_func = info[3].As<Napi::Function>();
 
+    OutputOptions output_options;
+    if (info.Length() == 5 && !getOutputOptions(info[4], output_options)) {
+        Napi::TypeError::New(env, "Wrong argument 4").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
     Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
 
-    ExtractClipRemuxWorker *worker = new ExtractClipRemuxWorker(deferred, m_video_reader, dest_uri, start_time, end_time, progress_func);
-    worker->Queue();
+    ExtractClipRemuxWorker *worker = new ExtractClipRemuxWorker(deferred, m_video_reader, dest_uri, start_time, end_time, progress_func, output_options);
+    worker->Queue(m_priority);
+
+    return deferred.Promise();
+}
+
+class ExtractClipsRemuxWorker : public PromiseWorker {
+public:
+    ExtractClipsRemuxWorker(
+        const Napi::Promise::Deferred &deferred,
+        VideoReader &video_reader,
+        const std::vector<ClipRange> &clip_ranges,
+        const Napi::Function &progress_func,
+        const OutputOptions &output_options
+        ) :
+        PromiseWorker(deferred),
+        m_video_reader(video_reader),
+        m_clip_ranges(clip_ranges),
+        m_output_options(output_options) {
+
+        auto finalizer = [](const Napi::Env &) {};
+        m_progress_func = Napi::ThreadSafeFunction::New(deferred.Env(), progress_func, "progress_log", 0, 1, finalizer);
+    }
+
+    virtual ~ExtractClipsRemuxWorker() {
+        m_progress_func.Release();
+    }
+
+    // This code will be executed on the worker thread; not allowed to call any napi
+    void Execute() override {
+        // this function will also be executed on the worker thread, called back from remux
+        auto progress_func = [this] (int step, int total) {
+            m_progress_func.Acquire();
+            napi_status status = m_progress_func.BlockingCall((void *)NULL, [step, total](const Napi::Env &env, const Napi::Function &js_func, void *) {
+                // this code is run in the main js thread
+                Napi::Value val_step = Napi::Number::New(env, step);
+                Napi::Value val_total = Napi::Number::New(env, total);
+
+                js_func.Call({val_step, val_total});
+            });
+            if (status != napi_ok) {
+                printf("failed to call js_func for progress\n");
+            }
+
+            m_progress_func.Release();
+        };
+
+        if (!m_video_reader.extractClipsRemux(m_clip_ranges, m_extract_clip_results, progress_func, m_output_options)) {
+            SetError(getFailure(m_video_reader, "ExtractClipsRemuxFailure"));
+            return;
+        }
+    }
+
+    void Resolve(Napi::Promise::Deferred const &deferred) override {
+        auto env = deferred.Env();
+
+        Napi::Array results = Napi::Array::New(env, m_extract_clip_results.size());
+        for (size_t i = 0; i < m_extract_clip_results.size(); i++) {
+            auto &extract_clip_result = m_extract_clip_results[i];
+
+            Napi::Object result = Napi::Object::New(env);
+            result.Set("video_start_time", Napi::Number::New(env, extract_clip_result.video_start_time));
+            result.Set("video_duration", Napi::Number::New(env, extract_clip_result.video_duration));
+
+            result.Set("count_video_packets", Napi::Number::New(env, extract_clip_result.count_video_packets));
+            result.Set("count_key_frames", Napi::Number::New(env, extract_clip_result.count_key_frames));
+
+            if (extract_clip_result.output_data) {
+                result.Set("output_buffer", newOutputBuffer(env, extract_clip_result.output_data));
+            }
+
+            results.Set(i, result);
+        }
+
+        deferred.Resolve(results);
+    }
+
+private:
+    VideoReader &m_video_reader;
+    std::vector<ClipRange> m_clip_ranges;
+    Napi::ThreadSafeFunction m_progress_func;
+    OutputOptions m_output_options;
+
+    std::vector<ExtractClipResult> m_extract_clip_results;
+};
+
+// reads [{ start_time, end_time, dest_uri }, ...]
+static bool getClipRanges(const Napi::Value &value, std::vector<ClipRange> &clip_ranges) {
+    if (!value.IsArray()) {
+        return false;
+    }
+    auto arr = value.As<Napi::Array>();
+    for (uint32_t i = 0; i < arr.Length(); i++) {
+        Napi::Value val_clip = arr.Get(i);
+        if (!val_clip.IsObject()) {
+            return false;
+        }
+        auto obj = val_clip.As<Napi::Object>();
+        Napi::Value val_start_time = obj.Get("start_time");
+        Napi::Value val_end_time = obj.Get("end_time");
+        Napi::Value val_dest_uri = obj.Get("dest_uri");
+        if (!val_start_time.IsNumber() || !val_end_time.IsNumber() || !val_dest_uri.IsString()) {
+            return false;
+        }
+
+        ClipRange clip_range;
+        clip_range.start_time = val_start_time.As<Napi::Number>().DoubleValue();
+        clip_range.end_time = val_end_time.As<Napi::Number>().DoubleValue();
+        clip_range.dest_uri = val_dest_uri.As<Napi::String>();
+        clip_ranges.push_back(clip_range);
+    }
+    return true;
+}
+
+Napi::Value WrappedVideoReader::extractClipsRemux(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 2 && info.Length() != 3) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    std::vector<ClipRange> clip_ranges;
+    if (!getClipRanges(info[0], clip_ranges)) {
+        Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!info[1].IsFunction()) {
+        Napi::TypeError::New(env, "Wrong argument 1").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    Napi::Function progress_func = info[1].As<Napi::Function>();
+
+    OutputOptions output_options;
+    if (info.Length() == 3 && !getOutputOptions(info[2], output_options)) {
+        Napi::TypeError::New(env, "Wrong argument 2").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
+
+    ExtractClipsRemuxWorker *worker = new ExtractClipsRemuxWorker(deferred, m_video_reader, clip_ranges, progress_func, output_options);
+    worker->Queue(m_priority);
 
     return deferred.Promise();
 }
@@ -605,11 +948,13 @@ public:
         const Napi::Promise::Deferred &deferred,
         VideoReader &video_reader,
         const std::string &dest_uri,
-        const Napi::Function &progress_func
+        const Napi::Function &progress_func,
+        const OutputOptions &output_options
         ) :
         PromiseWorker(deferred),
         m_video_reader(video_reader),
-        m_dest_uri(dest_uri) {
+        m_dest_uri(dest_uri),
+        m_output_options(output_options) {
 
         auto finalizer = [](const Napi::Env &) {};
         m_progress_func = Napi::ThreadSafeFunction::New(deferred.Env(), progress_func, "progress_log", 0, 1, finalizer);
@@ -638,8 +983,8 @@ public:
             m_progress_func.Release();
         };
 
-        if (!m_video_reader.remux(m_dest_uri, m_extract_clip_result, progress_func)) {
-            SetError("RemuxFailure");
+        if (!m_video_reader.remux(m_dest_uri, m_extract_clip_result, progress_func, m_output_options)) {
+            SetError(getFailure(m_video_reader, "RemuxFailure"));
             return;
         }
     }
@@ -654,6 +999,10 @@ public:
         result.Set("count_video_packets", Napi::Number::New(env, m_extract_clip_result.count_video_packets));
         result.Set("count_key_frames", Napi::Number::New(env, m_extract_clip_result.count_key_frames));
 
+        if (m_extract_clip_result.output_data) {
+            result.Set("output_buffer", newOutputBuffer(env, m_extract_clip_result.output_data));
+        }
+
         deferred.Resolve(result);
     }
 
@@ -661,6 +1010,7 @@ private:
     VideoReader &m_video_reader;
     std::string m_dest_uri;
     Napi::ThreadSafeFunction m_progress_func;
+    OutputOptions m_output_options;
 
     ExtractClipResult m_extract_clip_result;
 };
@@ -669,7 +1019,7 @@ Napi::Value WrappedVideoReader::remux(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
 
-    if (info.Length() != 2) {
+    if (info.Length() != 2 && info.Length() != 3) {
         std::string err = "Wrong number of arguments " + info.Length();
         Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
         return env.Null();
@@ -688,10 +1038,16 @@ Napi::Value WrappedVideoReader::remux(const Napi::CallbackInfo &info) {
     std::string dest_uri(info[0].As<Napi::String>());
     Napi::Function progress_func = info[1].As<Napi::Function>();
 
+    OutputOptions output_options;
+    if (info.Length() == 3 && !getOutputOptions(info[2], output_options)) {
+        Napi::TypeError::New(env, "Wrong argument 2").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
     Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
 
-    RemuxWorker *worker = new RemuxWorker(deferred, m_video_reader, dest_uri, progress_func);
-    worker->Queue();
+    RemuxWorker *worker = new RemuxWorker(deferred, m_video_reader, dest_uri, progress_func, output_options);
+    worker->Queue(m_priority);
 
     return deferred.Promise();
 }
@@ -738,7 +1094,7 @@ public:
         };
 
         if (!m_video_reader.getClipVolumeData(m_start_time, m_end_time, m_get_clip_volume_data_result, progress_func)) {
-            SetError("GetClipVolumeDataFailure");
+            SetError(getFailure(m_video_reader, "GetClipVolumeDataFailure"));
             return;
         }
     }
@@ -792,7 +1148,7 @@ Napi::Value WrappedVideoReader::getClipVolumeData(const Napi::CallbackInfo &info
     Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
 
     GetClipVolumeDataWorker *worker = new GetClipVolumeDataWorker(deferred, m_video_reader, start_time, end_time, progress_func);
-    worker->Queue();
+    worker->Queue(m_priority);
 
     return deferred.Promise();
 }
@@ -834,7 +1190,7 @@ public:
         };
 
         if (!m_video_reader.getVolumeData(m_get_clip_volume_data_result, progress_func)) {
-            SetError("GetVolumeDataFailure");
+            SetError(getFailure(m_video_reader, "GetVolumeDataFailure"));
             return;
         }
     }
@@ -876,11 +1232,163 @@ Napi::Value WrappedVideoReader::getVolumeData(const Napi::CallbackInfo &info) {
     Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
 
     GetVolumeDataWorker *worker = new GetVolumeDataWorker(deferred, m_video_reader, progress_func);
-    worker->Queue();
+    worker->Queue(m_priority);
 
     return deferred.Promise();
 }
 
+Napi::Value WrappedVideoReader::getIoStats(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 0) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    if (!m_resource_io_group) {
+        // only reads through a resource io object are tracked
+        return env.Null();
+    }
+
+    ResourceIoStats stats = m_resource_io_group->getStats();
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("count_reads", Napi::Number::New(env, stats.count_reads));
+    result.Set("count_seeks", Napi::Number::New(env, stats.count_seeks));
+    result.Set("bytes_cached", Napi::Number::New(env, stats.bytes_cached));
+    result.Set("bytes_read", Napi::Number::New(env, stats.bytes_read));
+    result.Set("min_read_size", Napi::Number::New(env, stats.min_read_size));
+    result.Set("max_read_size", Napi::Number::New(env, stats.max_read_size));
+
+    return result;
+}
+
+// getMemoryUsage(): roughly how many bytes the reader holds on to between operations, in its
+// read caches, queued packets and decoders; only meaningful while no operation is running
+Napi::Value WrappedVideoReader::getMemoryUsage(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 0) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    int64_t memory_usage = m_video_reader.getMemoryUsage();
+    if (m_resource_io_group) {
+        memory_usage += m_resource_io_group->getCacheSize();
+    }
+
+    return Napi::Number::New(env, memory_usage);
+}
+
+// getProbeSnapshot(): what init found out about the input's streams, as a Buffer that can be
+// kept (on disk, say) and given to a later init of the same input to skip probing it; null
+// before init
+Napi::Value WrappedVideoReader::getProbeSnapshot(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 0) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    const ProbeSnapshot &probe_snapshot = m_video_reader.getProbeSnapshot();
+    if (probe_snapshot.isEmpty()) {
+        return env.Null();
+    }
+
+    std::string data;
+    probe_snapshot.serialize(data);
+    return Napi::Buffer<char>::Copy(env, data.data(), data.size());
+}
+
+// getProbeStats(): how init found out about the input's streams: { count_tiers, bytes_read,
+// time, is_probe_snapshot_used, is_complete }, with time in seconds
+Napi::Value WrappedVideoReader::getProbeStats(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 0) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    const ProbeStats &stats = m_video_reader.getProbeStats();
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("count_tiers", Napi::Number::New(env, stats.count_tiers));
+    result.Set("bytes_read", Napi::Number::New(env, stats.bytes_read));
+    result.Set("time", Napi::Number::New(env, stats.time));
+    result.Set("is_probe_snapshot_used", Napi::Boolean::New(env, stats.is_probe_snapshot_used));
+    result.Set("is_complete", Napi::Boolean::New(env, stats.is_complete));
+
+    return result;
+}
+
+// setActionOptions(priority, timeout): for the next operation. The priority is 'interactive',
+// 'normal' or 'batch', which decides the order operations get a worker thread in and what they
+// can interrupt. The operation fails with DeadlineExceeded once it has run for timeout seconds
+// (0 for no limit)
+Napi::Value WrappedVideoReader::setActionOptions(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 2) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!info[0].IsString()) {
+        Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Wrong argument 1").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    std::string priority = info[0].As<Napi::String>();
+    if (priority == "interactive") {
+        m_priority = WorkerPool::PRIORITY_INTERACTIVE;
+    } else if (priority == "normal") {
+        m_priority = WorkerPool::PRIORITY_NORMAL;
+    } else if (priority == "batch") {
+        m_priority = WorkerPool::PRIORITY_BATCH;
+    } else {
+        Napi::TypeError::New(env, "Wrong argument 0").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    // no operation is running, they are started one at a time
+    m_video_reader.getOperationControl().reset(info[1].As<Napi::Number>().DoubleValue());
+
+    return env.Null();
+}
+
+// cancelAction(): the running operation fails with Cancelled as soon as it next checks, which
+// leaves the reader ready for another one
+Napi::Value WrappedVideoReader::cancelAction(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    if (info.Length() != 0) {
+        std::string err = "Wrong number of arguments " + info.Length();
+        Napi::TypeError::New(env, err.c_str()).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    m_video_reader.getOperationControl().cancel();
+
+    return env.Null();
+}
+
 Napi::Function WrappedVideoReader::GetClass(Napi::Env env) {
     return DefineClass(env, "VideoReader", {
         WrappedVideoReader::InstanceMethod("init", &WrappedVideoReader::init),
@@ -892,8 +1400,15 @@ Napi::Function WrappedVideoReader::GetClass(Napi::Env env) {
         WrappedVideoReader::InstanceMethod("getMetadata", &WrappedVideoReader::getMetadata),
         WrappedVideoReader::InstanceMethod("extractClipReencode", &WrappedVideoReader::extractClipReencode),
         WrappedVideoReader::InstanceMethod("extractClipRemux", &WrappedVideoReader::extractClipRemux),
+        WrappedVideoReader::InstanceMethod("extractClipsRemux", &WrappedVideoReader::extractClipsRemux),
         WrappedVideoReader::InstanceMethod("remux", &WrappedVideoReader::remux),
         WrappedVideoReader::InstanceMethod("getClipVolumeData", &WrappedVideoReader::getClipVolumeData),
         WrappedVideoReader::InstanceMethod("getVolumeData", &WrappedVideoReader::getVolumeData),
+        WrappedVideoReader::InstanceMethod("getIoStats", &WrappedVideoReader::getIoStats),
+        WrappedVideoReader::InstanceMethod("getMemoryUsage", &WrappedVideoReader::getMemoryUsage),
+        WrappedVideoReader::InstanceMethod("getProbeSnapshot", &WrappedVideoReader::getProbeSnapshot),
+        WrappedVideoReader::InstanceMethod("getProbeStats", &WrappedVideoReader::getProbeStats),
+        WrappedVideoReader::InstanceMethod("setActionOptions", &WrappedVideoReader::setActionOptions),
+        WrappedVideoReader::InstanceMethod("cancelAction", &WrappedVideoReader::cancelAction),
     });
 }
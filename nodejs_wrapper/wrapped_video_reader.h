@@ -8,12 +8,13 @@
 
 #include <napi.h>
 
+#include "../async_file_io_group.h"
+#include "../local_file_io_group.h"
 #include "../video_reader.h"
 
 #include "buffer_image.h"
 #include "resource_io_group.h"
-
-typedef std::unordered_set<BufferImage *> BufferImageSet;
+#include "worker_pool.h"
 
 class WrappedVideoReader : public Napi::ObjectWrap<WrappedVideoReader>
 {
@@ -32,16 +33,26 @@ public:
     Napi::Value getMetadata(const Napi::CallbackInfo &info);
     Napi::Value extractClipReencode(const Napi::CallbackInfo &info);
     Napi::Value extractClipRemux(const Napi::CallbackInfo &info);
+    Napi::Value extractClipsRemux(const Napi::CallbackInfo &info);
     Napi::Value remux(const Napi::CallbackInfo &info);
     Napi::Value getClipVolumeData(const Napi::CallbackInfo &info);
     Napi::Value getVolumeData(const Napi::CallbackInfo &info);
+    Napi::Value getIoStats(const Napi::CallbackInfo &info);
+    Napi::Value getMemoryUsage(const Napi::CallbackInfo &info);
+    Napi::Value getProbeSnapshot(const Napi::CallbackInfo &info);
+    Napi::Value getProbeStats(const Napi::CallbackInfo &info);
+    Napi::Value setActionOptions(const Napi::CallbackInfo &info);
+    Napi::Value cancelAction(const Napi::CallbackInfo &info);
 
     static Napi::Function GetClass(Napi::Env env);
 
 private:
     std::shared_ptr<ResourceIoGroup> m_resource_io_group;
-
-    BufferImageSet m_pending_buffer_images;
+    std::shared_ptr<Avalanche::LocalFileIoGroup> m_local_file_io_group;
+    std::shared_ptr<Avalanche::AsyncFileIoGroup> m_async_file_io_group;
 
     Avalanche::VideoReader m_video_reader;
+
+    // for the operations started from now on
+    WorkerPool::Priority m_priority = WorkerPool::PRIORITY_NORMAL;
 };
@@ -0,0 +1,51 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+namespace Avalanche {
+
+// Lets the high level action a VideoReader is running be stopped early, from any thread, or
+// once a deadline has passed. The reader checks it for every packet it reads and from libav's
+// interrupt callback; the action then fails, and the reader cleans up after it at the start of
+// the next one.
+class OperationControl {
+public:
+    // for the next action: not cancelled, and stopped after timeout seconds, or never if 0
+    void reset(double timeout) {
+        m_is_cancelled = false;
+        m_deadline_usec = timeout > 0 ? av_gettime_relative() + (int64_t)(timeout * 1000000) : 0;
+    }
+
+    void cancel() {
+        m_is_cancelled = true;
+    }
+
+    bool isCancelled() {
+        return m_is_cancelled;
+    }
+
+    bool isPastDeadline() {
+        int64_t deadline_usec = m_deadline_usec;
+        return deadline_usec != 0 && av_gettime_relative() >= deadline_usec;
+    }
+
+    bool isStopped() {
+        return isCancelled() || isPastDeadline();
+    }
+
+private:
+    std::atomic<bool> m_is_cancelled{false};
+    std::atomic<int64_t> m_deadline_usec{0};
+};
+
+}
@@ -0,0 +1,280 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+#ifdef AVALANCHE_USE_IO_URING
+#include <liburing.h>
+#endif
+
+#include "../utils.h"
+
+#include "async_read_engine.h"
+#include "utils.h"
+
+using namespace Avalanche;
+
+// threads shared by every ThreadPoolReadEngine
+constexpr int COUNT_READ_THREADS = 8;
+
+namespace {
+
+class ReadThreadPool {
+public:
+    static ReadThreadPool & getInstance() {
+        static ReadThreadPool read_thread_pool;
+        return read_thread_pool;
+    }
+
+    void submit(int fd, AsyncReadRequest *request) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            request->is_done = false;
+            m_jobs.push_back(std::make_pair(fd, request));
+        }
+        m_job_cond.notify_one();
+    }
+
+    bool isDone(AsyncReadRequest *request) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return request->is_done;
+    }
+
+    void wait(AsyncReadRequest *request) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cond.wait(lock, [request]() {
+            return request->is_done;
+        });
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_job_cond;
+    std::condition_variable m_done_cond;
+    std::deque<std::pair<int, AsyncReadRequest *>> m_jobs;
+    bool m_is_stopping = false;
+    std::vector<std::thread> m_threads;
+
+    ReadThreadPool() {
+        for (int i = 0; i < COUNT_READ_THREADS; i++) {
+            m_threads.emplace_back(&ReadThreadPool::run, this);
+        }
+    }
+
+    ~ReadThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_is_stopping = true;
+        }
+        m_job_cond.notify_all();
+        for (auto &thread: m_threads) {
+            thread.join();
+        }
+    }
+
+    void run() {
+        while (true) {
+            int fd;
+            AsyncReadRequest *request;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_job_cond.wait(lock, [this]() {
+                    return m_is_stopping || !m_jobs.empty();
+                });
+                if (m_jobs.empty()) {
+                    return;
+                }
+                std::tie(fd, request) = m_jobs.front();
+                m_jobs.pop_front();
+            }
+
+            // pread can return less than asked for anywhere in the file, only 0 means the end
+            size_t count_read = 0;
+            int error = 0;
+            while (count_read < request->data.size()) {
+                ssize_t res = pread(fd, request->data.data() + count_read, request->data.size() - count_read, request->offset + (int64_t)count_read);
+                if (res < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (res < 0) {
+                    error = -errno;
+                    break;
+                }
+                if (res == 0) {
+                    break;
+                }
+                count_read += (size_t)res;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                request->result = error < 0 ? error : (int)count_read;
+                request->is_done = true;
+            }
+            m_done_cond.notify_all();
+        }
+    }
+};
+
+class ThreadPoolReadEngine : public AsyncReadEngine {
+public:
+    ThreadPoolReadEngine(int fd) :
+        m_fd(fd) {
+    }
+
+    bool submit(AsyncReadRequest *request) override {
+        ReadThreadPool::getInstance().submit(m_fd, request);
+        return true;
+    }
+
+    bool isDone(AsyncReadRequest *request) override {
+        return ReadThreadPool::getInstance().isDone(request);
+    }
+
+    void wait(AsyncReadRequest *request) override {
+        ReadThreadPool::getInstance().wait(request);
+    }
+
+private:
+    int m_fd;
+};
+
+#ifdef AVALANCHE_USE_IO_URING
+
+// one ring per file, only ever used from the thread reading it, so completions are reaped by
+// whoever is waiting and nothing needs locking
+class IoUringReadEngine : public AsyncReadEngine {
+public:
+    IoUringReadEngine(int fd) :
+        m_fd(fd) {
+    }
+
+    ~IoUringReadEngine() {
+        if (m_is_initialized) {
+            io_uring_queue_exit(&m_ring);
+        }
+    }
+
+    bool init(int queue_depth) {
+        int ret = io_uring_queue_init(queue_depth, &m_ring, 0);
+        if (ret < 0) {
+            log(LOG_INFO, "io_uring is not available, using a thread pool instead: %s\n", strerror(-ret));
+            return false;
+        }
+        m_is_initialized = true;
+        return true;
+    }
+
+    bool submit(AsyncReadRequest *request) override {
+        request->result = 0;
+        request->is_done = false;
+        int ret = submitRest(request);
+        if (ret < 0) {
+            request->result = ret;
+            request->is_done = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool isDone(AsyncReadRequest *request) override {
+        struct io_uring_cqe *cqe;
+        while (!request->is_done && io_uring_peek_cqe(&m_ring, &cqe) == 0) {
+            complete(cqe);
+        }
+        return request->is_done;
+    }
+
+    void wait(AsyncReadRequest *request) override {
+        while (!request->is_done) {
+            struct io_uring_cqe *cqe;
+            int ret = io_uring_wait_cqe(&m_ring, &cqe);
+            if (ret == -EINTR) {
+                continue;
+            }
+            if (ret < 0) {
+                log(LOG_ERROR, "io_uring wait failed: %s\n", strerror(-ret));
+                request->result = ret;
+                request->is_done = true;
+                return;
+            }
+            complete(cqe);
+        }
+    }
+
+private:
+    int m_fd;
+    struct io_uring m_ring;
+    bool m_is_initialized = false;
+
+    // reads the part of the request that hasn't been read yet; 0 or a negative errno
+    int submitRest(AsyncReadRequest *request) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+        if (!sqe) {
+            log(LOG_ERROR, "io_uring submission queue is full\n");
+            return -EBUSY;
+        }
+        io_uring_prep_read(sqe, m_fd, request->data.data() + request->result, (unsigned)(request->data.size() - request->result), request->offset + request->result);
+        io_uring_sqe_set_data(sqe, request);
+
+        int ret = io_uring_submit(&m_ring);
+        if (ret < 0) {
+            log(LOG_ERROR, "io_uring submit failed: %s\n", strerror(-ret));
+            return ret;
+        }
+        return 0;
+    }
+
+    void complete(struct io_uring_cqe *cqe) {
+        auto request = static_cast<AsyncReadRequest *>(io_uring_cqe_get_data(cqe));
+        int res = cqe->res;
+        io_uring_cqe_seen(&m_ring, cqe);
+
+        if (res == -EINTR || res == -EAGAIN) {
+            res = 0;
+        } else if (res < 0) {
+            request->result = res;
+            request->is_done = true;
+            return;
+        } else if (res == 0) {
+            // the end of the file
+            request->is_done = true;
+            return;
+        }
+
+        // a read can come back short anywhere in the file, so go again for the rest
+        request->result += res;
+        if (request->result < (int)request->data.size()) {
+            int ret = submitRest(request);
+            if (ret < 0) {
+                request->result = ret;
+                request->is_done = true;
+            }
+            return;
+        }
+        request->is_done = true;
+    }
+};
+
+#endif
+
+}
+
+std::unique_ptr<AsyncReadEngine> AsyncReadEngine::create(int fd, int queue_depth) {
+#ifdef AVALANCHE_USE_IO_URING
+    auto io_uring_read_engine = std::make_unique<IoUringReadEngine>(fd);
+    if (io_uring_read_engine->init(queue_depth)) {
+        return io_uring_read_engine;
+    }
+#endif
+    return std::make_unique<ThreadPoolReadEngine>(fd);
+}
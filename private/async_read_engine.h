@@ -0,0 +1,43 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+namespace Avalanche {
+
+struct AsyncReadRequest {
+    int64_t offset = 0;
+    std::vector<uint8_t> data;
+    // bytes read, which is data.size() unless the file ends first, or a negative errno; only
+    // valid once done
+    int result = 0;
+    // guarded by the engine; use AsyncReadEngine::isDone()
+    bool is_done = true;
+};
+
+// Runs reads of one file in the background, several at a time. A request must stay alive (and
+// its data untouched) until it is done.
+class AsyncReadEngine {
+public:
+    virtual ~AsyncReadEngine() {
+    }
+
+    // io_uring when built with AVALANCHE_USE_IO_URING and the kernel allows it, otherwise a
+    // shared pool of threads doing pread
+    static std::unique_ptr<AsyncReadEngine> create(int fd, int queue_depth);
+
+    // reads request->data.size() bytes at request->offset, or up to the end of the file; a
+    // short read from the system is followed by another for the rest
+    virtual bool submit(AsyncReadRequest *request) = 0;
+    // never blocks
+    virtual bool isDone(AsyncReadRequest *request) = 0;
+    virtual void wait(AsyncReadRequest *request) = 0;
+};
+
+}
@@ -14,6 +14,8 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 
+#include "custom_io_setup.h"
+
 namespace Avalanche {
 
 struct AVFormatContextInputCloser {
@@ -37,9 +39,8 @@ struct AVFormatContextOutputCloser {
     // called by smart ptr to destroy/free the resource
     void operator()(AVFormatContext *output_format_context) {
         //printf("cleaning up av_format_context %p\n", output_format_context);
-        if (output_format_context->pb && !(output_format_context->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&output_format_context->pb);
-        }
+        // normally already closed with closeOutputIo, unless we bailed out on an error
+        abandonOutputIo(output_format_context);
         avformat_free_context(output_format_context);
     }
 };
@@ -0,0 +1,226 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace Avalanche {
+
+// Bounded multi-producer queue used to connect pipeline stages running on separate threads.
+// Items move through a lock-free ring of cells (each cell carries a sequence number, so
+// producers and consumers only contend on the cell they are claiming). The mutex and
+// condition variables are only touched when a side actually has to sleep: producers sleep
+// while the queue is full (backpressure) and consumers sleep while it is empty.
+//
+// The queue is closed once every producer has called producerDone(); pop() then returns
+// false after the remaining items are drained. abort() wakes everyone up and makes all
+// further push() and pop() calls fail, which is how a failing stage stops the others.
+template <typename T>
+class BoundedQueue {
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+public:
+    BoundedQueue(size_t capacity, int count_producers = 1) :
+        m_count_producers(count_producers) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_cells = std::unique_ptr<Cell[]>(new Cell[size]);
+        for (size_t i = 0; i < size; i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~BoundedQueue() {
+    }
+
+    // never blocks; returns false if the queue is full (item is left untouched in that case)
+    bool tryPush(T &item) {
+        Cell *cell;
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->item = std::move(item);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // never blocks; returns false if the queue is empty
+    bool tryPop(T &item) {
+        Cell *cell;
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->item);
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // blocks while the queue is full; returns false if the queue was aborted.
+    // time spent blocked is added to wait_usec if given
+    bool push(T item, int64_t *wait_usec = nullptr) {
+        if (tryPush(item)) {
+            wake(m_count_waiting_consumers, m_not_empty_cond);
+            return !m_is_aborted.load();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool success = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_count_waiting_producers++;
+            while (!m_is_aborted.load()) {
+                // retried while registered as a waiter, so a consumer that pops after this
+                // will see us waiting and notify
+                if (tryPush(item)) {
+                    success = true;
+                    break;
+                }
+                m_not_full_cond.wait(lock);
+            }
+            m_count_waiting_producers--;
+        }
+        if (wait_usec) {
+            *wait_usec += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (success) {
+            wake(m_count_waiting_consumers, m_not_empty_cond);
+        }
+        return success;
+    }
+
+    // blocks while the queue is empty; returns false once the queue is closed and drained,
+    // or if it was aborted. time spent blocked is added to wait_usec if given
+    bool pop(T &item, int64_t *wait_usec = nullptr) {
+        if (m_is_aborted.load()) {
+            return false;
+        }
+        if (tryPop(item)) {
+            wake(m_count_waiting_producers, m_not_full_cond);
+            return true;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool success = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_count_waiting_consumers++;
+            while (!m_is_aborted.load()) {
+                if (tryPop(item)) {
+                    success = true;
+                    break;
+                }
+                if (m_count_producers.load() == 0) {
+                    // a producer always pushes before it calls producerDone(), so one last
+                    // try catches anything pushed before the queue was closed
+                    success = tryPop(item);
+                    break;
+                }
+                m_not_empty_cond.wait(lock);
+            }
+            m_count_waiting_consumers--;
+        }
+        if (wait_usec) {
+            *wait_usec += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (success) {
+            wake(m_count_waiting_producers, m_not_full_cond);
+        }
+        return success;
+    }
+
+    // called by each producer when it will not push anything else
+    void producerDone() {
+        m_count_producers--;
+        wakeAll();
+    }
+
+    // makes every blocked and future push() and pop() fail
+    void abort() {
+        m_is_aborted = true;
+        wakeAll();
+    }
+
+    bool isAborted() const {
+        return m_is_aborted.load();
+    }
+
+private:
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+
+    std::atomic<size_t> m_enqueue_pos{0};
+    std::atomic<size_t> m_dequeue_pos{0};
+
+    std::atomic<int> m_count_producers;
+    std::atomic<bool> m_is_aborted{false};
+
+    // only used to put a blocked side to sleep; the fast paths never touch it
+    std::mutex m_mutex;
+    std::condition_variable m_not_full_cond;
+    std::condition_variable m_not_empty_cond;
+    std::atomic<int> m_count_waiting_producers{0};
+    std::atomic<int> m_count_waiting_consumers{0};
+
+    void wake(std::atomic<int> &count_waiting, std::condition_variable &cond) {
+        // orders our push/pop before reading the waiter count (pairs with the increment
+        // a waiter does before its retry)
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (count_waiting.load() > 0) {
+            // taking the mutex guarantees the waiter is either before its retry or already
+            // inside wait(), so the notify can't be lost
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+            }
+            cond.notify_one();
+        }
+    }
+
+    void wakeAll() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_not_full_cond.notify_all();
+        m_not_empty_cond.notify_all();
+    }
+};
+
+}
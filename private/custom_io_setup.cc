@@ -3,8 +3,11 @@
  */
 
 #include "../custom_io_group.h"
+#include "../custom_output_io.h"
+#include "../utils.h"
 
 #include "custom_io_setup.h"
+#include "utils.h"
 
 using namespace Avalanche;
 
@@ -39,6 +42,9 @@ int libavInterruptCallback(void *opaque)
 
     //printf("libavInterruptCallback %p\n", custom_io_group);
 
+    if (custom_io_group->isOperationStopped()) {
+        return 1;
+    }
     return custom_io_group->interruptCallback();
 }
 
@@ -53,3 +59,157 @@ void Avalanche::setupInputCustomIoIfNeeded(CustomIoGroup *custom_io_group, AVFor
         input_format_context->interrupt_callback.opaque = custom_io_group;
     }
 }
+
+int libavOutputOpen(AVFormatContext *format_context, AVIOContext **pb, const char *url, int flags, AVDictionary **options) {
+    CustomIoGroup *custom_io_group = static_cast<CustomIoGroup *>(format_context->opaque);
+
+    //printf("libavOutputOpen, %s %i\n", url, flags);
+
+    if (flags & AVIO_FLAG_READ) {
+        // the mp4 muxer reads back its own output to do faststart
+        CustomOutputIo *output_io = format_context->pb ? CustomOutputIo::fromAvioContext(format_context->pb) : nullptr;
+        if (!output_io || output_io->getUri() != url) {
+            return AVERROR(ENOSYS);
+        }
+        AVIOContext *avio_context = output_io->openReadBack();
+        if (!avio_context) {
+            return AVERROR(ENOSYS);
+        }
+        *pb = avio_context;
+        return 0;
+    }
+
+    // muxers that write more than one file (hls) open the others through here
+    CustomOutputIo *output_io = nullptr;
+    if (!custom_io_group->openOutput(url, output_io)) {
+        return AVERROR(EIO);
+    }
+    if (!output_io) {
+        return avio_open2(pb, url, flags, &format_context->interrupt_callback, options);
+    }
+
+    *pb = output_io->getAvioContext();
+    return 0;
+}
+
+void libavOutputClose(AVFormatContext *format_context, AVIOContext *pb) {
+    CustomIoGroup *custom_io_group = static_cast<CustomIoGroup *>(format_context->opaque);
+
+    if (CustomOutputIo::isReadBack(pb)) {
+        CustomOutputIo::closeReadBack(pb);
+        return;
+    }
+
+    CustomOutputIo *output_io = CustomOutputIo::fromAvioContext(pb);
+    if (!output_io) {
+        avio_close(pb);
+        return;
+    }
+
+    // nowhere to return an error to from here; libav has already checked pb->error if it cares
+    if (!output_io->finish()) {
+        log(LOG_ERROR, "Error finishing output %s\n", output_io->getUri().c_str());
+    }
+    custom_io_group->closeOutput(output_io);
+}
+
+static void setupOutputCustomIo(CustomIoGroup *custom_io_group, AVFormatContext *output_format_context) {
+    output_format_context->opaque = custom_io_group;
+    output_format_context->io_open = libavOutputOpen;
+    output_format_context->io_close = libavOutputClose;
+
+    output_format_context->interrupt_callback.callback = libavInterruptCallback;
+    output_format_context->interrupt_callback.opaque = custom_io_group;
+}
+
+bool Avalanche::openOutputIo(CustomIoGroup *custom_io_group, AVFormatContext *output_format_context, const std::string &dest_uri) {
+    if (output_format_context->oformat->flags & AVFMT_NOFILE) {
+        // the muxer opens its own files (hls writes a playlist and segments), so give the
+        // custom io group a chance at each of them
+        if (custom_io_group) {
+            setupOutputCustomIo(custom_io_group, output_format_context);
+        }
+        return true;
+    }
+
+    CustomOutputIo *output_io = nullptr;
+    if (custom_io_group) {
+        if (!custom_io_group->openOutput(dest_uri, output_io)) {
+            log(LOG_ERROR, "Error opening custom output %s\n", dest_uri.c_str());
+            return false;
+        }
+    }
+
+    if (!output_io) {
+        int ret = avio_open(&output_format_context->pb, dest_uri.c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            char buf[100];
+            av_strerror(ret, buf, sizeof(buf));
+            log(LOG_ERROR, "Error opening output file %s %i %s\n", dest_uri.c_str(), ret, buf);
+            return false;
+        }
+        return true;
+    }
+
+    output_format_context->pb = output_io->getAvioContext();
+    setupOutputCustomIo(custom_io_group, output_format_context);
+
+    return true;
+}
+
+bool Avalanche::canReadBackOutput(AVFormatContext *output_format_context) {
+    if (!output_format_context->pb) {
+        return false;
+    }
+    CustomOutputIo *output_io = CustomOutputIo::fromAvioContext(output_format_context->pb);
+    if (!output_io) {
+        // a local file
+        return true;
+    }
+    return output_io->isInMemory();
+}
+
+bool Avalanche::closeOutputIo(AVFormatContext *output_format_context, std::shared_ptr<OutputChunk> &output_data) {
+    if (!output_format_context->pb || (output_format_context->oformat->flags & AVFMT_NOFILE)) {
+        return true;
+    }
+
+    CustomOutputIo *output_io = CustomOutputIo::fromAvioContext(output_format_context->pb);
+    if (!output_io) {
+        int ret = avio_closep(&output_format_context->pb);
+        if (ret < 0) {
+            char buf[100];
+            av_strerror(ret, buf, sizeof(buf));
+            log(LOG_ERROR, "Error closing output file %i %s\n", ret, buf);
+            return false;
+        }
+        return true;
+    }
+
+    bool success = output_io->finish();
+    if (success) {
+        output_data = output_io->takeMemoryData();
+    }
+
+    CustomIoGroup *custom_io_group = static_cast<CustomIoGroup *>(output_format_context->opaque);
+    output_format_context->pb = NULL;
+    custom_io_group->closeOutput(output_io);
+
+    return success;
+}
+
+void Avalanche::abandonOutputIo(AVFormatContext *output_format_context) {
+    if (!output_format_context->pb || (output_format_context->oformat->flags & AVFMT_NOFILE)) {
+        return;
+    }
+
+    CustomOutputIo *output_io = CustomOutputIo::fromAvioContext(output_format_context->pb);
+    if (!output_io) {
+        avio_closep(&output_format_context->pb);
+        return;
+    }
+
+    CustomIoGroup *custom_io_group = static_cast<CustomIoGroup *>(output_format_context->opaque);
+    output_format_context->pb = NULL;
+    custom_io_group->closeOutput(output_io);
+}
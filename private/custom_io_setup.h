@@ -4,14 +4,32 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
+
 extern "C" {
 #include <libavformat/avformat.h>
 }
 
 #include "../custom_io_group.h"
+#include "../custom_output_io.h"
 
 namespace Avalanche {
 
 void setupInputCustomIoIfNeeded(CustomIoGroup *custom_io_group, AVFormatContext *input_format_context);
 
+// opens output_format_context->pb for dest_uri, through custom_io_group if it handles output
+// (custom_io_group may be null)
+bool openOutputIo(CustomIoGroup *custom_io_group, AVFormatContext *output_format_context, const std::string &dest_uri);
+
+// false if the output can't be read back while muxing, which the mp4 faststart option needs
+bool canReadBackOutput(AVFormatContext *output_format_context);
+
+// call after av_write_trailer. Finishes and closes output_format_context->pb; for in memory
+// custom output the written file is moved into output_data
+bool closeOutputIo(AVFormatContext *output_format_context, std::shared_ptr<OutputChunk> &output_data);
+
+// closes output_format_context->pb without finishing it, for error paths
+void abandonOutputIo(AVFormatContext *output_format_context);
+
 }
@@ -120,6 +120,15 @@ public:
         return m_packets.size();
     }
 
+    // of the packets' data
+    int64_t getDataSize() {
+        int64_t data_size = 0;
+        for (auto &packet: m_packets) {
+            data_size += packet->size;
+        }
+        return data_size;
+    }
+
 private:
     PacketHolder m_packets;
 };
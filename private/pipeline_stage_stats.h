@@ -0,0 +1,55 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+
+#include "../utils.h"
+
+#include "utils.h"
+
+namespace Avalanche {
+
+// timing for one stage of a threaded pipeline. Whatever is left of total time after the
+// waits is time the stage spent working; the stage with the most working time (and whose
+// neighbours spend their time waiting on it) is the bottleneck.
+struct PipelineStageStats {
+    PipelineStageStats(const char *name) :
+        name(name) {
+    }
+
+    void start() {
+        m_start = std::chrono::steady_clock::now();
+    }
+
+    void stop() {
+        total_usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+    int64_t getWorkUsec() const {
+        return total_usec - input_wait_usec - output_wait_usec;
+    }
+
+    void logStats() const {
+        log(LOG_INFO, "stage %s handled %li items in %.3fs: working %.3fs, waiting for input %.3fs, blocked on output %.3fs\n",
+            name, count_items, total_usec / 1e6, getWorkUsec() / 1e6, input_wait_usec / 1e6, output_wait_usec / 1e6);
+    }
+
+    const char *name;
+
+    int64_t count_items = 0;
+    int64_t total_usec = 0;
+    // time blocked on an empty input queue, i.e. waiting on the stage before this one
+    int64_t input_wait_usec = 0;
+    // time blocked on a full output queue, i.e. waiting on the stage after this one
+    int64_t output_wait_usec = 0;
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+}
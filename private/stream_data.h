@@ -32,7 +32,9 @@ struct StreamData {
         output_audio_codec(NULL),
         output_audio_codec_context(nullptr),
         output_audio_resampling_context(NULL),
-        output_audio_start_pts(-1)
+        output_audio_start_pts(-1),
+        forced_key_frame_interval(0),
+        next_forced_key_frame_pts(0)
     {
     }
 
@@ -66,6 +68,12 @@ struct StreamData {
     SwrContext *output_audio_resampling_context;
     int64_t output_audio_start_pts; // this is in the time base of the output stream
 
+    // when encoding video, frames at least this far apart are forced to be key frames (so
+    // segmented output can cut exactly there); 0 means no forcing. Both are in the time base of
+    // the input stream, relative to base_pts
+    int64_t forced_key_frame_interval;
+    int64_t next_forced_key_frame_pts;
+
 };
 
 }
@@ -244,6 +244,15 @@ bool StreamMap::createOutputStreamsStandard(AVFormatContext *output_format_conte
                 return false;
             }
 
+            // frames we force to be key frames (see setForcedKeyFrameInterval) should be IDR frames,
+            // so that segments cut there are independently decodable
+            opt_name = "forced-idr";
+            ret = av_opt_set_int(stream_data->output_video_codec_context->priv_data, opt_name.c_str(), 1, 0);
+            if (ret < 0) {
+                log(LOG_ERROR, "Error setting output video codec option %s %i\n", opt_name.c_str(), ret);
+                return false;
+            }
+
             stream_data->output_video_codec_context->height = m_input_format_context->streams[stream_data->input_stream_index]->codecpar->height;
             stream_data->output_video_codec_context->width = m_input_format_context->streams[stream_data->input_stream_index]->codecpar->width;
             stream_data->output_video_codec_context->sample_aspect_ratio = m_input_format_context->streams[stream_data->input_stream_index]->codecpar->sample_aspect_ratio;
@@ -352,6 +361,15 @@ bool StreamMap::createOutputStreamsStandard(AVFormatContext *output_format_conte
     return true;
 }
 
+void StreamMap::setForcedKeyFrameInterval(double interval_sec) {
+    auto stream_data = getVideoStreamData();
+    if (!stream_data) {
+        return;
+    }
+    stream_data->forced_key_frame_interval = (int64_t)(interval_sec / av_q2d(getVideoAvStream()->time_base));
+    stream_data->next_forced_key_frame_pts = 0;
+}
+
 void StreamMap::setAllBasePts(std::shared_ptr<StreamData> reference_stream_data, int64_t base_pts) {
     m_has_base_pts = true;
 
@@ -429,22 +447,20 @@ bool StreamMap::remuxPacket(AVPacket *packet, AVFormatContext *output_format_con
     stream_data->count_bytes += packet->size;
 
     // write out the packet
-    //https://ffmpeg.org/doxygen/trunk/group__lavf__encoding.html#ga37352ed2c63493c38219d935e71db6c1
-    int ret = av_interleaved_write_frame(output_format_context, packet);
-    if (ret < 0) {
-        char buf[100];
-        av_strerror(ret, buf, sizeof(buf));
-        log(LOG_ERROR, "Error writing frame %i %s\n", ret, buf);
-        return false;
-    }
-
-    return true;
+    return writePacket(output_format_context, packet);
 }
 
-bool StreamMap::encodeVideo(std::shared_ptr<StreamData> stream_data, AVFormatContext *output_format_context, AVFrame *input_frame) {
+bool StreamMap::encodeVideo(std::shared_ptr<StreamData> stream_data, AVFrame *input_frame, const WritePacketFunc &write_packet_func) {
     if (input_frame) {
         input_frame->pict_type = AV_PICTURE_TYPE_NONE;
         input_frame->pts -= stream_data->base_pts;
+
+        if (stream_data->forced_key_frame_interval > 0 && input_frame->pts >= stream_data->next_forced_key_frame_pts) {
+            input_frame->pict_type = AV_PICTURE_TYPE_I;
+            while (stream_data->next_forced_key_frame_pts <= input_frame->pts) {
+                stream_data->next_forced_key_frame_pts += stream_data->forced_key_frame_interval;
+            }
+        }
     }
 
     // put it in a smart pointer to get it properly freed in all cases
@@ -481,7 +497,7 @@ bool StreamMap::encodeVideo(std::shared_ptr<StreamData> stream_data, AVFormatCon
 
         av_packet_rescale_ts(output_packet.get(), input_stream->time_base, output_stream->time_base);
 
-        // av_interleaved_write_frame zeros out the packet size, so record some stats first
+        // writing zeros out the packet size, so record some stats first
         stream_data->output_last_dts = output_packet->dts;
         stream_data->count_packets++;
         if (output_packet->flags == AV_PKT_FLAG_KEY) {
@@ -489,11 +505,7 @@ bool StreamMap::encodeVideo(std::shared_ptr<StreamData> stream_data, AVFormatCon
         }
         stream_data->count_bytes += output_packet->size;
 
-        ret = av_interleaved_write_frame(output_format_context, output_packet.get());
-        if (ret < 0) {
-            char buf[100];
-            av_strerror(ret, buf, sizeof(buf));
-            log(LOG_ERROR, "Error writing video frame %i %s\n", ret, buf);
+        if (!write_packet_func(output_packet.get())) {
             return false;
         }
     }
@@ -501,7 +513,7 @@ bool StreamMap::encodeVideo(std::shared_ptr<StreamData> stream_data, AVFormatCon
     return true;
 }
 
-bool StreamMap::encodeAudio(std::shared_ptr<StreamData> stream_data, AVFormatContext *output_format_context, AVFrame *input_frame) {
+bool StreamMap::encodeAudio(std::shared_ptr<StreamData> stream_data, AVFrame *input_frame, const WritePacketFunc &write_packet_func) {
     // put it in a smart pointer to get it properly freed in all cases
     auto output_packet = std::unique_ptr<AVPacket, AVPacketUnreferDeleter>(av_packet_alloc(), AVPacketUnreferDeleter());
     if (!output_packet) {
@@ -591,16 +603,12 @@ bool StreamMap::encodeAudio(std::shared_ptr<StreamData> stream_data, AVFormatCon
 
             output_packet->stream_index = stream_data->output_stream_index;
 
-            // av_interleaved_write_frame zeros out the packet size, so record some stats first
+            // writing zeros out the packet size, so record some stats first
             stream_data->output_last_dts = output_packet->dts;
             stream_data->count_packets++;
             stream_data->count_bytes += output_packet->size;
 
-            ret = av_interleaved_write_frame(output_format_context, output_packet.get());
-            if (ret < 0) {
-                char buf[100];
-                av_strerror(ret, buf, sizeof(buf));
-                log(LOG_ERROR, "Error writing audio frame %i %s\n", ret, buf);
+            if (!write_packet_func(output_packet.get())) {
                 return false;
             }
         }
@@ -609,6 +617,18 @@ bool StreamMap::encodeAudio(std::shared_ptr<StreamData> stream_data, AVFormatCon
     return true;
 }
 
+bool StreamMap::writePacket(AVFormatContext *output_format_context, AVPacket *packet) {
+    //https://ffmpeg.org/doxygen/trunk/group__lavf__encoding.html#ga37352ed2c63493c38219d935e71db6c1
+    int ret = av_interleaved_write_frame(output_format_context, packet);
+    if (ret < 0) {
+        char buf[100];
+        av_strerror(ret, buf, sizeof(buf));
+        log(LOG_ERROR, "Error writing frame %i %s\n", ret, buf);
+        return false;
+    }
+    return true;
+}
+
 void StreamMap::logStats() {
     for (auto it: m_map) {
         auto stream_data = it.second;
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <functional>
 #include <map>
 #include <memory>
 
@@ -15,6 +16,9 @@ extern "C" {
 
 namespace Avalanche {
 
+// takes over the reference held by packet (leaving it blank, like av_interleaved_write_frame does)
+typedef std::function<bool(AVPacket *packet)> WritePacketFunc;
+
 class StreamMap {
 public:
 
@@ -51,6 +55,9 @@ public:
     bool createOutputStreamsCopyInputFormat(AVFormatContext *output_format_context);
     bool createOutputStreamsStandard(AVFormatContext *output_format_context, AVCodecContext *audio_codec_context);
 
+    // encodeVideo will force a key frame every interval_sec of output
+    void setForcedKeyFrameInterval(double interval_sec);
+
     bool hasBasePts() const { return m_has_base_pts; }
     void setAllBasePts(std::shared_ptr<StreamData> reference_stream_data, int64_t base_pts);
 
@@ -59,8 +66,12 @@ public:
 
     bool remuxPacket(AVPacket *packet, AVFormatContext *output_format_context);
 
-    bool encodeVideo(std::shared_ptr<StreamData> stream_data, AVFormatContext *output_format_context, AVFrame *input_frame);
-    bool encodeAudio(std::shared_ptr<StreamData> stream_data, AVFormatContext *output_format_context, AVFrame *input_frame);
+    // encoded packets are handed to write_packet_func instead of being written directly, so
+    // encoding can run on a different thread than the muxer
+    bool encodeVideo(std::shared_ptr<StreamData> stream_data, AVFrame *input_frame, const WritePacketFunc &write_packet_func);
+    bool encodeAudio(std::shared_ptr<StreamData> stream_data, AVFrame *input_frame, const WritePacketFunc &write_packet_func);
+
+    static bool writePacket(AVFormatContext *output_format_context, AVPacket *packet);
 
     void logStats();
 
@@ -14,6 +14,9 @@ namespace Avalanche {
 
 void log(int level, const char *fmt, ...);
 
+// gives the yield func, if there is one, a chance to run other work
+void yieldPoint();
+
 bool stringEndsWith(const std::string &s, const std::string &suffix);
 
 }
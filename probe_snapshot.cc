@@ -0,0 +1,403 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <string.h>
+
+#include "probe_snapshot.h"
+
+#include "utils.h"
+
+#include "private/utils.h"
+
+using namespace Avalanche;
+
+static const char SNAPSHOT_MAGIC[4] = { 'A', 'V', 'P', 'S' };
+// bump when the layout changes; snapshots from other versions are ignored
+constexpr int64_t SNAPSHOT_VERSION = 1;
+
+// little endian, whatever the machine is, so snapshots can be shared between hosts
+static void putInt64(std::string &data, int64_t value) {
+    uint64_t u = (uint64_t)value;
+    for (int i = 0; i < 8; i++) {
+        data.push_back((char)((u >> (i * 8)) & 0xff));
+    }
+}
+
+static void putRational(std::string &data, AVRational value) {
+    putInt64(data, value.num);
+    putInt64(data, value.den);
+}
+
+static void putString(std::string &data, const std::string &value) {
+    putInt64(data, value.size());
+    data.append(value);
+}
+
+class SnapshotReader {
+public:
+    SnapshotReader(const std::string &data) : m_data(data) {
+    }
+
+    bool getMagic() {
+        if (m_data.size() < sizeof(SNAPSHOT_MAGIC) || memcmp(m_data.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            return false;
+        }
+        m_pos = sizeof(SNAPSHOT_MAGIC);
+        return true;
+    }
+
+    bool getInt64(int64_t &value) {
+        if (m_data.size() - m_pos < 8) {
+            return false;
+        }
+        uint64_t u = 0;
+        for (int i = 0; i < 8; i++) {
+            u |= (uint64_t)(uint8_t)m_data[m_pos + i] << (i * 8);
+        }
+        m_pos += 8;
+        value = (int64_t)u;
+        return true;
+    }
+
+    template<typename T>
+    bool getInt(T &value) {
+        int64_t value64;
+        if (!getInt64(value64)) {
+            return false;
+        }
+        value = (T)value64;
+        return true;
+    }
+
+    bool getRational(AVRational &value) {
+        return getInt(value.num) && getInt(value.den);
+    }
+
+    bool getString(std::string &value) {
+        int64_t size;
+        if (!getInt64(size) || size < 0 || (uint64_t)size > m_data.size() - m_pos) {
+            return false;
+        }
+        value.assign(m_data, m_pos, size);
+        m_pos += size;
+        return true;
+    }
+
+    bool isAtEnd() {
+        return m_pos == m_data.size();
+    }
+
+private:
+    const std::string &m_data;
+    size_t m_pos = 0;
+};
+
+bool ProbeSnapshot::capture(const AVFormatContext *format_context) {
+    if (!format_context->iformat) {
+        log(LOG_ERROR, "Probe snapshot needs an input\n");
+        return false;
+    }
+
+    m_format_name = format_context->iformat->name;
+    m_start_time = format_context->start_time;
+    m_duration = format_context->duration;
+    m_bit_rate = format_context->bit_rate;
+
+    m_streams.clear();
+    for (unsigned int i = 0; i < format_context->nb_streams; i++) {
+        const AVStream *av_stream = format_context->streams[i];
+        const AVCodecParameters *codecpar = av_stream->codecpar;
+
+        Stream stream;
+        stream.id = av_stream->id;
+        stream.time_base = av_stream->time_base;
+        stream.start_time = av_stream->start_time;
+        stream.duration = av_stream->duration;
+        stream.nb_frames = av_stream->nb_frames;
+        stream.avg_frame_rate = av_stream->avg_frame_rate;
+        stream.r_frame_rate = av_stream->r_frame_rate;
+        stream.sample_aspect_ratio = av_stream->sample_aspect_ratio;
+        stream.disposition = av_stream->disposition;
+
+        stream.codec_type = codecpar->codec_type;
+        stream.codec_id = codecpar->codec_id;
+        stream.codec_tag = codecpar->codec_tag;
+        if (codecpar->extradata_size > 0) {
+            stream.extradata.assign((const char *)codecpar->extradata, codecpar->extradata_size);
+        }
+        stream.format = codecpar->format;
+        stream.bit_rate = codecpar->bit_rate;
+        stream.bits_per_coded_sample = codecpar->bits_per_coded_sample;
+        stream.bits_per_raw_sample = codecpar->bits_per_raw_sample;
+        stream.profile = codecpar->profile;
+        stream.level = codecpar->level;
+        stream.width = codecpar->width;
+        stream.height = codecpar->height;
+        stream.codec_sample_aspect_ratio = codecpar->sample_aspect_ratio;
+        stream.field_order = codecpar->field_order;
+        stream.color_range = codecpar->color_range;
+        stream.color_primaries = codecpar->color_primaries;
+        stream.color_trc = codecpar->color_trc;
+        stream.color_space = codecpar->color_space;
+        stream.chroma_location = codecpar->chroma_location;
+        stream.video_delay = codecpar->video_delay;
+        stream.channel_layout = codecpar->channel_layout;
+        stream.channels = codecpar->channels;
+        stream.sample_rate = codecpar->sample_rate;
+        stream.block_align = codecpar->block_align;
+        stream.frame_size = codecpar->frame_size;
+        stream.initial_padding = codecpar->initial_padding;
+        stream.trailing_padding = codecpar->trailing_padding;
+        stream.seek_preroll = codecpar->seek_preroll;
+
+        m_streams.push_back(stream);
+    }
+
+    return true;
+}
+
+void ProbeSnapshot::serialize(std::string &data) const {
+    data.assign(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    putInt64(data, SNAPSHOT_VERSION);
+
+    putString(data, m_format_name);
+    putInt64(data, m_start_time);
+    putInt64(data, m_duration);
+    putInt64(data, m_bit_rate);
+
+    putInt64(data, m_streams.size());
+    for (auto &stream: m_streams) {
+        putInt64(data, stream.id);
+        putRational(data, stream.time_base);
+        putInt64(data, stream.start_time);
+        putInt64(data, stream.duration);
+        putInt64(data, stream.nb_frames);
+        putRational(data, stream.avg_frame_rate);
+        putRational(data, stream.r_frame_rate);
+        putRational(data, stream.sample_aspect_ratio);
+        putInt64(data, stream.disposition);
+
+        putInt64(data, stream.codec_type);
+        putInt64(data, stream.codec_id);
+        putInt64(data, stream.codec_tag);
+        putString(data, stream.extradata);
+        putInt64(data, stream.format);
+        putInt64(data, stream.bit_rate);
+        putInt64(data, stream.bits_per_coded_sample);
+        putInt64(data, stream.bits_per_raw_sample);
+        putInt64(data, stream.profile);
+        putInt64(data, stream.level);
+        putInt64(data, stream.width);
+        putInt64(data, stream.height);
+        putRational(data, stream.codec_sample_aspect_ratio);
+        putInt64(data, stream.field_order);
+        putInt64(data, stream.color_range);
+        putInt64(data, stream.color_primaries);
+        putInt64(data, stream.color_trc);
+        putInt64(data, stream.color_space);
+        putInt64(data, stream.chroma_location);
+        putInt64(data, stream.video_delay);
+        putInt64(data, stream.channel_layout);
+        putInt64(data, stream.channels);
+        putInt64(data, stream.sample_rate);
+        putInt64(data, stream.block_align);
+        putInt64(data, stream.frame_size);
+        putInt64(data, stream.initial_padding);
+        putInt64(data, stream.trailing_padding);
+        putInt64(data, stream.seek_preroll);
+    }
+}
+
+bool ProbeSnapshot::deserialize(const std::string &data) {
+    m_streams.clear();
+
+    SnapshotReader reader(data);
+    if (!reader.getMagic()) {
+        log(LOG_ERROR, "Not a probe snapshot\n");
+        return false;
+    }
+    int64_t version;
+    if (!reader.getInt64(version) || version != SNAPSHOT_VERSION) {
+        log(LOG_INFO, "Probe snapshot is from a different version\n");
+        return false;
+    }
+
+    int64_t count_streams;
+    bool is_ok = reader.getString(m_format_name) &&
+        reader.getInt64(m_start_time) &&
+        reader.getInt64(m_duration) &&
+        reader.getInt64(m_bit_rate) &&
+        reader.getInt64(count_streams);
+    // a stream takes hundreds of bytes, this only keeps a bad count from reserving too much
+    if (!is_ok || count_streams < 0 || (uint64_t)count_streams > data.size()) {
+        log(LOG_ERROR, "Bad probe snapshot\n");
+        return false;
+    }
+
+    std::vector<Stream> streams(count_streams);
+    for (auto &stream: streams) {
+        is_ok = reader.getInt(stream.id) &&
+            reader.getRational(stream.time_base) &&
+            reader.getInt64(stream.start_time) &&
+            reader.getInt64(stream.duration) &&
+            reader.getInt64(stream.nb_frames) &&
+            reader.getRational(stream.avg_frame_rate) &&
+            reader.getRational(stream.r_frame_rate) &&
+            reader.getRational(stream.sample_aspect_ratio) &&
+            reader.getInt(stream.disposition) &&
+            reader.getInt(stream.codec_type) &&
+            reader.getInt(stream.codec_id) &&
+            reader.getInt(stream.codec_tag) &&
+            reader.getString(stream.extradata) &&
+            reader.getInt(stream.format) &&
+            reader.getInt64(stream.bit_rate) &&
+            reader.getInt(stream.bits_per_coded_sample) &&
+            reader.getInt(stream.bits_per_raw_sample) &&
+            reader.getInt(stream.profile) &&
+            reader.getInt(stream.level) &&
+            reader.getInt(stream.width) &&
+            reader.getInt(stream.height) &&
+            reader.getRational(stream.codec_sample_aspect_ratio) &&
+            reader.getInt(stream.field_order) &&
+            reader.getInt(stream.color_range) &&
+            reader.getInt(stream.color_primaries) &&
+            reader.getInt(stream.color_trc) &&
+            reader.getInt(stream.color_space) &&
+            reader.getInt(stream.chroma_location) &&
+            reader.getInt(stream.video_delay) &&
+            reader.getInt(stream.channel_layout) &&
+            reader.getInt(stream.channels) &&
+            reader.getInt(stream.sample_rate) &&
+            reader.getInt(stream.block_align) &&
+            reader.getInt(stream.frame_size) &&
+            reader.getInt(stream.initial_padding) &&
+            reader.getInt(stream.trailing_padding) &&
+            reader.getInt(stream.seek_preroll);
+        if (!is_ok) {
+            log(LOG_ERROR, "Bad probe snapshot\n");
+            return false;
+        }
+    }
+    if (!reader.isAtEnd()) {
+        log(LOG_ERROR, "Bad probe snapshot\n");
+        return false;
+    }
+
+    m_streams = std::move(streams);
+    return true;
+}
+
+bool ProbeSnapshot::matches(const AVFormatContext *format_context) const {
+    if (isEmpty() || !format_context->iformat || m_format_name != format_context->iformat->name) {
+        return false;
+    }
+    // streams found later while reading packets would be missing from it
+    if (format_context->nb_streams != m_streams.size()) {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < format_context->nb_streams; i++) {
+        const AVStream *av_stream = format_context->streams[i];
+        const AVCodecParameters *codecpar = av_stream->codecpar;
+        const Stream &stream = m_streams[i];
+
+        // packets come in the demuxer's time base, so this has to be the same as before
+        if (av_stream->id != stream.id || av_cmp_q(av_stream->time_base, stream.time_base) != 0) {
+            return false;
+        }
+        if (codecpar->codec_type != stream.codec_type) {
+            return false;
+        }
+
+        // anything the headers already give has to agree
+        if (codecpar->codec_id != AV_CODEC_ID_NONE && codecpar->codec_id != stream.codec_id) {
+            return false;
+        }
+        if (codecpar->width > 0 && (codecpar->width != stream.width || codecpar->height != stream.height)) {
+            return false;
+        }
+        if (codecpar->sample_rate > 0 && codecpar->sample_rate != stream.sample_rate) {
+            return false;
+        }
+        if (codecpar->extradata_size > 0 &&
+            ((size_t)codecpar->extradata_size != stream.extradata.size() ||
+             memcmp(codecpar->extradata, stream.extradata.data(), codecpar->extradata_size) != 0)) {
+            return false;
+        }
+        if (av_stream->duration != AV_NOPTS_VALUE && av_stream->duration != stream.duration) {
+            return false;
+        }
+        if (av_stream->nb_frames > 0 && av_stream->nb_frames != stream.nb_frames) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ProbeSnapshot::apply(AVFormatContext *format_context) const {
+    if (format_context->nb_streams != m_streams.size()) {
+        log(LOG_ERROR, "Probe snapshot doesn't fit the input\n");
+        return false;
+    }
+
+    format_context->start_time = m_start_time;
+    format_context->duration = m_duration;
+    format_context->bit_rate = m_bit_rate;
+
+    for (unsigned int i = 0; i < format_context->nb_streams; i++) {
+        AVStream *av_stream = format_context->streams[i];
+        AVCodecParameters *codecpar = av_stream->codecpar;
+        const Stream &stream = m_streams[i];
+
+        av_stream->start_time = stream.start_time;
+        av_stream->duration = stream.duration;
+        av_stream->nb_frames = stream.nb_frames;
+        av_stream->avg_frame_rate = stream.avg_frame_rate;
+        av_stream->r_frame_rate = stream.r_frame_rate;
+        av_stream->sample_aspect_ratio = stream.sample_aspect_ratio;
+        av_stream->disposition = stream.disposition;
+
+        av_freep(&codecpar->extradata);
+        codecpar->extradata_size = 0;
+        if (!stream.extradata.empty()) {
+            codecpar->extradata = (uint8_t *)av_mallocz(stream.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (!codecpar->extradata) {
+                log(LOG_ERROR, "Error allocating extradata\n");
+                return false;
+            }
+            memcpy(codecpar->extradata, stream.extradata.data(), stream.extradata.size());
+            codecpar->extradata_size = stream.extradata.size();
+        }
+
+        codecpar->codec_id = (AVCodecID)stream.codec_id;
+        codecpar->codec_tag = stream.codec_tag;
+        codecpar->format = stream.format;
+        codecpar->bit_rate = stream.bit_rate;
+        codecpar->bits_per_coded_sample = stream.bits_per_coded_sample;
+        codecpar->bits_per_raw_sample = stream.bits_per_raw_sample;
+        codecpar->profile = stream.profile;
+        codecpar->level = stream.level;
+        codecpar->width = stream.width;
+        codecpar->height = stream.height;
+        codecpar->sample_aspect_ratio = stream.codec_sample_aspect_ratio;
+        codecpar->field_order = (AVFieldOrder)stream.field_order;
+        codecpar->color_range = (AVColorRange)stream.color_range;
+        codecpar->color_primaries = (AVColorPrimaries)stream.color_primaries;
+        codecpar->color_trc = (AVColorTransferCharacteristic)stream.color_trc;
+        codecpar->color_space = (AVColorSpace)stream.color_space;
+        codecpar->chroma_location = (AVChromaLocation)stream.chroma_location;
+        codecpar->video_delay = stream.video_delay;
+        codecpar->channel_layout = stream.channel_layout;
+        codecpar->channels = stream.channels;
+        codecpar->sample_rate = stream.sample_rate;
+        codecpar->block_align = stream.block_align;
+        codecpar->frame_size = stream.frame_size;
+        codecpar->initial_padding = stream.initial_padding;
+        codecpar->trailing_padding = stream.trailing_padding;
+        codecpar->seek_preroll = stream.seek_preroll;
+    }
+
+    return true;
+}
@@ -0,0 +1,92 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+namespace Avalanche {
+
+// What avformat_find_stream_info worked out about an input: the streams with their codec
+// parameters (extradata included), time bases, start times and durations. A VideoReader given
+// one when it is opened again skips avformat_find_stream_info, which reads and decodes up to
+// several seconds of the input (mpegts and hls have no headers to get this from).
+//
+// It serializes to a string of bytes that can be kept anywhere, and is only used once it has
+// been checked against what the container's headers say, so one for an input that has since
+// changed is ignored instead of giving wrong streams.
+class ProbeSnapshot {
+public:
+    bool isEmpty() const { return m_streams.empty(); }
+
+    // from an input that avformat_find_stream_info has been called on
+    bool capture(const AVFormatContext *format_context);
+
+    void serialize(std::string &data) const;
+    // false (leaving it empty) if data isn't a snapshot this version can read
+    bool deserialize(const std::string &data);
+
+    // whether it fits an input just opened with avformat_open_input: the same demuxer, and the
+    // same streams with the same time bases and anything else the headers already give
+    bool matches(const AVFormatContext *format_context) const;
+    // fills in what avformat_find_stream_info would have; only after matches()
+    bool apply(AVFormatContext *format_context) const;
+
+private:
+    struct Stream {
+        int id;
+        AVRational time_base;
+        int64_t start_time;
+        int64_t duration;
+        int64_t nb_frames;
+        AVRational avg_frame_rate;
+        AVRational r_frame_rate;
+        AVRational sample_aspect_ratio;
+        int disposition;
+
+        int codec_type;
+        int codec_id;
+        uint32_t codec_tag;
+        std::string extradata;
+        int format;
+        int64_t bit_rate;
+        int bits_per_coded_sample;
+        int bits_per_raw_sample;
+        int profile;
+        int level;
+        int width;
+        int height;
+        AVRational codec_sample_aspect_ratio;
+        int field_order;
+        int color_range;
+        int color_primaries;
+        int color_trc;
+        int color_space;
+        int chroma_location;
+        int video_delay;
+        uint64_t channel_layout;
+        int channels;
+        int sample_rate;
+        int block_align;
+        int frame_size;
+        int initial_padding;
+        int trailing_padding;
+        int seek_preroll;
+    };
+
+    std::string m_format_name;
+    int64_t m_start_time = AV_NOPTS_VALUE;
+    int64_t m_duration = AV_NOPTS_VALUE;
+    int64_t m_bit_rate = 0;
+    std::vector<Stream> m_streams;
+};
+
+}
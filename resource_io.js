@@ -6,8 +6,10 @@ import log from './log.js';
 
 import DataSource from './data_source.js';
 
+// hlsPrefetchSegments and hlsPrefetchBytes control how many hls segments past the one being
+// read are fetched ahead, and how many bytes of them can be waiting to be read
 export default class ResourceIo {
-  constructor(uri) {
+  constructor(uri, { hlsPrefetchSegments = 3, hlsPrefetchBytes = 64 * 1024 * 1024 } = {}) {
     // some versions of libav have trouble handling HLS videos with s3 urls
     // EVEN THOUGH we are doing custom io, so it should NOT care about the url at all.
     // To work around the issue, we just tell it about the path, and handle the true prefix ourselves
@@ -15,9 +17,15 @@ export default class ResourceIo {
     this.uriPrefix = `${canonicalUrl.protocol}//${canonicalUrl.host}`;
     this.primaryUri = canonicalUrl.pathname;
 
+    this.hlsPrefetchSegments = hlsPrefetchSegments;
+    this.hlsPrefetchBytes = hlsPrefetchBytes;
+
     // map from url to DataSource
     this.dataSources = {};
 
+    // map from output uri to how it is handled, see registerOutput()
+    this.outputs = {};
+
     this.latestOpen = '';
     this.latestClose = '';
     this.latestReadUri = '';
@@ -42,11 +50,37 @@ export default class ResourceIo {
       latestRead: this.latestRead,
       totalBytes_read: this.totalBytesRead,
       dataSources: dataSources,
+      outputs: Object.fromEntries(
+        Object.entries(this.outputs).map(([uri, output]) => [uri, { inMemory: output.inMemory, bytesWritten: output.bytesWritten }]),
+      ),
     };
 
     return retval;
   }
 
+  // By default output goes to the local filesystem. Registering a destination uri makes
+  // output to it come back here instead: with inMemory the whole file is returned as
+  // output_buffer in the result, otherwise writeChunk(offset, buffer, uri) is called (and
+  // awaited) for each chunk as it is produced. Chunks are not always in order; the mp4 muxer
+  // goes back to patch the header at the end.
+  //
+  // Registering an .m3u8 also covers the hls segments written next to it, which is why
+  // writeChunk gets the uri. The playlist is rewritten from the start after every segment.
+  // hls output can't be kept in memory.
+  registerOutput(uri, { inMemory = false, writeChunk = null } = {}) {
+    if (!inMemory && !writeChunk) {
+      throw new Error('registerOutput needs either inMemory or writeChunk');
+    }
+    if (inMemory && uri.endsWith('.m3u8')) {
+      throw new Error('hls output can not be kept in memory');
+    }
+    this.outputs[uri] = { inMemory, writeChunk, bytesWritten: 0, openCount: 0 };
+  }
+
+  unregisterOutput(uri) {
+    delete this.outputs[uri];
+  }
+
   // below here is called from c++
   async openFile(uri) {
     try {
@@ -56,15 +90,19 @@ export default class ResourceIo {
 
       let dataSource;
       if (Object.hasOwn(this.dataSources, uri)) {
-        // already opened
+        // already opened (hls segments are opened ahead of time), though maybe still opening
         dataSource = this.dataSources[uri];
+        await dataSource.initPromise;
       } else {
         // re-add the true uri prefix to work around libav issues we do not understand
         const canonicalUri = this.uriPrefix + uri;
         dataSource = new DataSource(canonicalUri);
+        // readers sharing this resource io (an asset session's) can have it open at once
+        dataSource.openCount = 0;
 
         this.dataSources[uri] = dataSource;
-        await dataSource.init();
+        dataSource.initPromise = dataSource.init();
+        await dataSource.initPromise;
       }
 
       const totalSize = dataSource.getTotalSize();
@@ -74,6 +112,12 @@ export default class ResourceIo {
       }
 
       this.latestOpen.output = totalSize;
+      dataSource.openCount++;
+      // the etag keys native caching, so a changed file isn't served from its old blocks
+      const etag = dataSource.getEtag();
+      if (etag) {
+        return { size: totalSize, etag };
+      }
       return totalSize;
     } catch (err) {
       this.latestOpen.output = 'exception';
@@ -93,7 +137,11 @@ export default class ResourceIo {
         this.latestClose.output = 'error_not_open';
         return;
       }
-      delete this.dataSources[uri];
+      const dataSource = this.dataSources[uri];
+      dataSource.openCount--;
+      if (dataSource.openCount <= 0) {
+        delete this.dataSources[uri];
+      }
       this.latestClose.output = 'success';
     } catch (err) {
       this.latestClose.output = 'exception';
@@ -126,4 +174,70 @@ export default class ResourceIo {
       return null;
     }
   }
+
+  // ranges is an array of [uri, offset, count]; starts them all at once and returns an array
+  // with a promise for each, resolving the same way readFile does
+  readFileRanges(ranges) {
+    return ranges.map(([uri, offset, count]) => this.readFile(uri, offset, count));
+  }
+
+  _findOutput(uri) {
+    if (Object.hasOwn(this.outputs, uri)) {
+      return this.outputs[uri];
+    }
+    // hls segments live in the same directory as their playlist
+    const dir = uri.substring(0, uri.lastIndexOf('/') + 1);
+    for (const [outputUri, output] of Object.entries(this.outputs)) {
+      if (outputUri.endsWith('.m3u8') && outputUri.substring(0, outputUri.lastIndexOf('/') + 1) === dir) {
+        return output;
+      }
+    }
+    return null;
+  }
+
+  async openOutputFile(uri) {
+    try {
+      const output = this._findOutput(uri);
+      if (!output) {
+        return 'file';
+      }
+      output.openCount++;
+      return output.inMemory ? 'memory' : 'stream';
+    } catch (err) {
+      log.info('error opening output file', uri, err);
+      return null;
+    }
+  }
+
+  async writeFile(uri, offset, buffer) {
+    try {
+      const output = this._findOutput(uri);
+      if (!output || output.openCount <= 0) {
+        log.error('write file called when file is not open', uri);
+        return false;
+      }
+      await output.writeChunk(offset, buffer, uri);
+      output.bytesWritten += buffer.length;
+      return true;
+    } catch (err) {
+      log.info('error writing file', uri, offset, buffer.length, err);
+      return false;
+    }
+  }
+
+  closeOutputFile(uri, isComplete) {
+    try {
+      const output = this._findOutput(uri);
+      if (!output) {
+        log.error('close output file callback called when file is not registered', uri);
+        return;
+      }
+      output.openCount--;
+      if (!isComplete) {
+        log.info('output file closed before it was complete', uri);
+      }
+    } catch (err) {
+      log.info('error closing output file', uri, err);
+    }
+  }
 }
@@ -627,6 +627,7 @@ ResourceLib.getDetails = async function (uri) {
             size: parseInt(response.headers['content-length'], 10),
             modified: response.headers['last-modified'],
             type: response.headers['content-type'],
+            etag: response.headers.etag,
           };
           return resolve(details);
         }),
@@ -647,6 +648,8 @@ ResourceLib.getDetails = async function (uri) {
       const details = {
         size: stat.size,
         modified: stat.mtime,
+        // no real etag, but this changes whenever the file does
+        etag: `${stat.ino}-${stat.mtimeMs}`,
       };
       details.type = mime.getType(uri) || UNKNOWN_MIME_TYPE;
       if (stat.isDirectory()) {
@@ -0,0 +1,65 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "../utils.h"
+#include "../video_reader.h"
+
+#include "file_io_group.h"
+
+void logProgress(int step, int total) {
+    printf("progress %i/%i\n", step, total);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 5 || (argc - 2) % 3 != 0) {
+        printf("Need filename to read, then filename to write, start_time, and end_time for each clip\n");
+        return 1;
+    }
+
+    std::string source_pathname = argv[1];
+
+    std::vector<Avalanche::ClipRange> clip_ranges;
+    for (int i = 2; i < argc; i += 3) {
+        Avalanche::ClipRange clip_range;
+        clip_range.dest_uri = argv[i];
+        clip_range.start_time = std::stod(argv[i + 1]);
+        clip_range.end_time = std::stod(argv[i + 2]);
+        clip_ranges.push_back(clip_range);
+    }
+
+    Avalanche::setDefaultLogFunc();
+
+    printf("lavf version %s\n", Avalanche::getAvFormatVersionString().c_str());
+
+    FileIoGroup file_io_group;
+
+    Avalanche::VideoReader video_reader;
+
+    if (!video_reader.init(&file_io_group, source_pathname)) {
+        printf("video reader init failed\n");
+        return 1;
+    }
+
+    if (!video_reader.verifyHasVideoStream()) {
+        printf("video has no video stream\n");
+        return 1;
+    }
+
+    std::vector<Avalanche::ExtractClipResult> results;
+    if (!video_reader.extractClipsRemux(clip_ranges, results, logProgress)) {
+        printf("failed to extract clips remux\n");
+        return 1;
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        auto &clip_data = results[i];
+        printf("%s: total video packets %i key frames %i start_time %f duration %f\n", clip_ranges[i].dest_uri.c_str(), clip_data.count_video_packets, clip_data.count_key_frames, clip_data.video_start_time, clip_data.video_duration);
+    }
+
+    return 0;
+}
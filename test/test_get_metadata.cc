@@ -6,6 +6,8 @@
 
 #include <string>
 
+#include "../async_file_io_group.h"
+#include "../local_file_io_group.h"
 #include "../utils.h"
 #include "../video_reader.h"
 
@@ -13,25 +15,38 @@
 
 int main(int argc, char **argv) {
     if (argc < 2) {
-        printf("Need filename to read\n");
+        printf("Need filename to read, optionally followed by local or async to read it with LocalFileIoGroup or AsyncFileIoGroup\n");
         return 1;
     }
 
     std::string source_pathname = argv[1];
+    std::string io_mode = argc > 2 ? argv[2] : "";
 
     Avalanche::setDefaultLogFunc();
 
     printf("lavf version %s\n", Avalanche::getAvFormatVersionString().c_str());
 
     FileIoGroup file_io_group;
+    Avalanche::LocalFileIoGroup local_file_io_group;
+    Avalanche::AsyncFileIoGroup async_file_io_group;
+
+    Avalanche::CustomIoGroup *custom_io_group = &file_io_group;
+    if (io_mode == "local") {
+        custom_io_group = &local_file_io_group;
+    } else if (io_mode == "async") {
+        custom_io_group = &async_file_io_group;
+    }
 
     Avalanche::VideoReader video_reader;
 
-    if (!video_reader.init(&file_io_group, source_pathname)) {
+    if (!video_reader.init(custom_io_group, source_pathname)) {
         printf("video reader init failed\n");
         return 1;
     }
 
+    const Avalanche::ProbeStats &probe_stats = video_reader.getProbeStats();
+    printf("probe tiers: %i bytes read: %li time: %f complete: %i\n", probe_stats.count_tiers, probe_stats.bytes_read, probe_stats.time, probe_stats.is_complete);
+
     if (!video_reader.verifyHasVideoStream()) {
         printf("video has no video stream\n");
         return 1;
@@ -0,0 +1,91 @@
+/**
+ * (c) Chad Walker, Chris Kirmse
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+#include "../image.h"
+#include "../probe_snapshot.h"
+#include "../utils.h"
+#include "../video_reader.h"
+
+#include "file_io_group.h"
+
+static bool printMetadata(Avalanche::VideoReader &video_reader) {
+    Avalanche::GetMetadataResult get_metadata_result;
+    if (!video_reader.getMetadata(get_metadata_result)) {
+        printf("failed to get metadata\n");
+        return false;
+    }
+
+    printf("video_encoding_name: %s\n", get_metadata_result.video_encoding_name.c_str());
+    printf("audio_encoding_name: %s\n", get_metadata_result.audio_encoding_name.c_str());
+    printf("container_start_time: %f\n", get_metadata_result.container_start_time);
+    printf("container_duration: %f\n", get_metadata_result.container_duration);
+    printf("video_width: %i\n", get_metadata_result.video_width);
+    printf("video_height: %i\n", get_metadata_result.video_height);
+    printf("frame_rate: %f\n", get_metadata_result.frame_rate);
+    return true;
+}
+
+// opens the file twice, the second time with a snapshot (round tripped through its serialized
+// form) of the first probe, and gets an image each time; the metadata should be the same and
+// the second init quicker
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("Need filename to read and timestamp of an image to get\n");
+        return 1;
+    }
+
+    std::string source_pathname = argv[1];
+    double timestamp = atof(argv[2]);
+
+    Avalanche::setDefaultLogFunc();
+
+    std::string data;
+    for (int i = 0; i < 2; i++) {
+        FileIoGroup file_io_group;
+        Avalanche::VideoReader video_reader;
+
+        Avalanche::ProbeSnapshot probe_snapshot;
+        if (!data.empty() && !probe_snapshot.deserialize(data)) {
+            printf("probe snapshot deserialize failed\n");
+            return 1;
+        }
+
+        int64_t start_time = av_gettime_relative();
+        if (!video_reader.init(&file_io_group, source_pathname, &probe_snapshot)) {
+            printf("video reader init failed\n");
+            return 1;
+        }
+        printf("init took %f ms, probe snapshot used %i\n", (av_gettime_relative() - start_time) / 1000.0, video_reader.isProbeSnapshotUsed());
+
+        if (!video_reader.verifyHasVideoStream()) {
+            printf("video has no video stream\n");
+            return 1;
+        }
+        if (!printMetadata(video_reader)) {
+            return 1;
+        }
+
+        Avalanche::Image image;
+        Avalanche::GetImageResult get_image_result = {false, image, 0, 0};
+        if (!video_reader.getImageAtTimestamp(timestamp, get_image_result)) {
+            printf("failed to get image\n");
+            return 1;
+        }
+        printf("got image at %f\n", get_image_result.timestamp);
+
+        video_reader.getProbeSnapshot().serialize(data);
+        printf("probe snapshot is %zu bytes\n", data.size());
+    }
+
+    return 0;
+}
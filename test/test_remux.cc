@@ -3,6 +3,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <string>
 
@@ -18,13 +19,19 @@ void logProgress(int step, int total) {
 
 int main(int argc, char **argv) {
     if (argc < 3) {
-        printf("Need filename to read and filename to write\n");
+        printf("Need filename to read and filename to write, optionally fragment duration to write fragmented mp4\n");
         return 1;
     }
 
     std::string source_pathname = argv[1];
     std::string dest_pathname = argv[2];
 
+    Avalanche::OutputOptions output_options;
+    if (argc >= 4) {
+        output_options.is_fragmented = true;
+        output_options.fragment_duration = atof(argv[3]);
+    }
+
     Avalanche::setDefaultLogFunc();
 
     printf("lavf version %s\n", Avalanche::getAvFormatVersionString().c_str());
@@ -44,7 +51,7 @@ int main(int argc, char **argv) {
     }
 
     Avalanche::ExtractClipResult clip_data;
-    if (!video_reader.remux(dest_pathname, clip_data, logProgress)) {
+    if (!video_reader.remux(dest_pathname, clip_data, logProgress, output_options)) {
         printf("failed to remux\n");
         return 1;
     }
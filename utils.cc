@@ -3,6 +3,8 @@
  */
 
 #include <stdio.h>
+
+#include <atomic>
 #include <string>
 
 extern "C" {
@@ -16,6 +18,8 @@ extern "C" {
 using namespace Avalanche;
 
 LogFuncType log_func;
+YieldFuncType yield_func;
+std::atomic<int> min_log_level{LOG_DEBUG};
 
 std::string pending_str;
 void defaultLogFunc(int level, bool is_libav, const char *s) {
@@ -45,13 +49,6 @@ void avLogCallback(void *ptr, int level, const char *fmt, va_list valist)
         return;
     }
 
-    line[0] = 0;
-
-    if (avclass && strcmp(avclass->item_name(ptr), "NULL") != 0 ) {
-        snprintf(line + strlen(line), sizeof(line) - strlen(line), "[%s] ", avclass->item_name(ptr));
-    }
-    vsnprintf(line + strlen(line), sizeof(line) - strlen(line), fmt, valist);
-
     int log_level;
     if (level <= AV_LOG_ERROR) {
         log_level = LOG_ERROR;
@@ -60,11 +57,26 @@ void avLogCallback(void *ptr, int level, const char *fmt, va_list valist)
     } else {
         log_level = LOG_DEBUG;
     }
+    if (log_level < min_log_level) {
+        return;
+    }
+
+    line[0] = 0;
+
+    if (avclass && strcmp(avclass->item_name(ptr), "NULL") != 0 ) {
+        snprintf(line + strlen(line), sizeof(line) - strlen(line), "[%s] ", avclass->item_name(ptr));
+    }
+    vsnprintf(line + strlen(line), sizeof(line) - strlen(line), fmt, valist);
+
     bool is_libav = true;
     log_func(log_level, is_libav, line);
 }
 
 void Avalanche::log(int level, const char *fmt, ...) {
+    if (level < min_log_level) {
+        return;
+    }
+
     char line[1024];
 
     va_list valist;
@@ -95,6 +107,20 @@ void Avalanche::setDefaultLogFunc() {
     //av_log_set_level(AV_LOG_DEBUG);
 }
 
+void Avalanche::setLogLevel(int level) {
+    min_log_level = level;
+}
+
+void Avalanche::setYieldFunc(const YieldFuncType &new_yield_func) {
+    yield_func = new_yield_func;
+}
+
+void Avalanche::yieldPoint() {
+    if (yield_func) {
+        yield_func();
+    }
+}
+
 std::string Avalanche::getAvFormatVersionString() {
     return std::to_string(LIBAVFORMAT_VERSION_MAJOR).append(".").append(std::to_string(LIBAVFORMAT_VERSION_MINOR)).append(".").append(std::to_string(LIBAVFORMAT_VERSION_MICRO));
 }
@@ -18,6 +18,14 @@ typedef void (*LogFuncType)(int level, bool is_libav, const char *s);
 
 void setLogFunc(const LogFuncType &new_log_func);
 void setDefaultLogFunc();
+// lines below level (ours and libav's) are dropped before they are even formatted
+void setLogLevel(int level);
+
+// called now and then from long running loops, so whatever runs them can let more urgent work
+// go first
+typedef void (*YieldFuncType)();
+
+void setYieldFunc(const YieldFuncType &new_yield_func);
 std::string getAvFormatVersionString();
 
 }
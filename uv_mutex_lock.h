@@ -20,3 +20,25 @@ public:
 private:
     uv_mutex_t &m_mutex;
 };
+
+// a uv_cond_t that lives as long as whatever is waited on, so a waiter can have one of its own
+class UvCond {
+public:
+    UvCond() {
+        uv_cond_init(&m_cond);
+    }
+
+    ~UvCond() {
+        uv_cond_destroy(&m_cond);
+    }
+
+    UvCond(const UvCond &) = delete;
+    UvCond & operator=(const UvCond &) = delete;
+
+    uv_cond_t * get() {
+        return &m_cond;
+    }
+
+private:
+    uv_cond_t m_cond;
+};
@@ -2,7 +2,15 @@
  * (c) Chad Walker, Chris Kirmse
  */
 
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <thread>
+#include <vector>
 
 extern "C" {
 #include <libavutil/imgutils.h>
@@ -16,23 +24,173 @@ extern "C" {
 #include "utils.h"
 
 #include "private/av_smart_pointers.h"
+#include "private/bounded_queue.h"
 #include "private/custom_io_setup.h"
 #include "private/packet_queue.h"
+#include "private/pipeline_stage_stats.h"
 #include "private/utils.h"
 #include "private/volume_data.h"
 
 constexpr double MAX_LOOK_PAST_TIME_SEC = 5.;
 
+// when extracting several clips, gaps between them longer than this are skipped with a seek
+// instead of being read through (safeSeek rewinds 11s, so shorter gaps don't pay off)
+constexpr double MIN_CLIP_GAP_TO_SEEK_SEC = 30.;
+
+// sizes of the queues between the extractClipReencode stages. Decoded frames are large
+// (~3MB each at 1080p) so that queue is kept short
+constexpr size_t REENCODE_PACKET_QUEUE_SIZE = 64;
+constexpr size_t REENCODE_FRAME_QUEUE_SIZE = 8;
+
 using namespace Avalanche;
 
-VideoReader::VideoReader() {
+typedef std::unique_ptr<AVPacket, AVPacketDeleter> PacketPtr;
+typedef std::unique_ptr<AVFrame, AVFrameDeleter> FramePtr;
+
+static bool isHlsOutput(AVFormatContext *output_format_context) {
+    return strcmp(output_format_context->oformat->name, "hls") == 0;
+}
+
+static void setMuxerOptions(AVFormatContext *output_format_context, const OutputOptions &output_options, AVDictionary **opts) {
+    if (isHlsOutput(output_format_context)) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%f", output_options.hls_segment_duration);
+        av_dict_set(opts, "hls_time", buf, 0);
+        av_dict_set(opts, "hls_playlist_type", "vod", 0);
+        av_dict_set(opts, "hls_segment_type", output_options.is_hls_mpegts ? "mpegts" : "fmp4", 0);
+        return;
+    }
+
+    if (output_options.is_fragmented) {
+        av_dict_set(opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        if (output_options.fragment_duration > 0) {
+            // frag_keyframe alone starts a fragment at every key frame; this makes it skip key
+            // frames until the fragment is long enough
+            av_dict_set_int(opts, "min_frag_duration", (int64_t)(output_options.fragment_duration * AV_TIME_BASE), 0);
+        }
+        return;
+    }
+
+    // faststart rewrites the whole file at the end to move the moov up front, which needs to
+    // read the output back
+    if (canReadBackOutput(output_format_context)) {
+        av_dict_set(opts, "movflags", "faststart", 0);
+    }
+}
+
+// for inputs without a custom io group, which checks the operation control itself
+static int operationControlInterruptCallback(void *opaque) {
+    return static_cast<OperationControl *>(opaque)->isStopped() ? 1 : 0;
+}
+
+VideoReader::VideoReader() : m_probe_tiers(getDefaultProbeTiers()) {
+}
+
+std::vector<ProbeTier> VideoReader::getDefaultProbeTiers() {
+    // most inputs (mp4 and the like) have their stream parameters in their headers and are done
+    // after the first; the last is what every input used to get
+    return {
+        { 512 * 1024, 1 },
+        { 2 * 1024 * 1024, 5 },
+        { 5000000, 60 },
+    };
 }
 
 VideoReader::~VideoReader() {
     destroy();
 }
 
-bool VideoReader::init(CustomIoGroup *custom_io_group, const std::string &uri) {
+bool VideoReader::init(CustomIoGroup *custom_io_group, const std::string &uri, const ProbeSnapshot *probe_snapshot) {
+    int ret;
+
+    // also used for output
+    m_custom_io_group = custom_io_group;
+    if (custom_io_group) {
+        custom_io_group->setOperationControl(&m_operation_control);
+    }
+
+    m_probe_stats = ProbeStats();
+    int64_t start_time_usec = av_gettime_relative();
+
+    if (m_probe_tiers.empty()) {
+        log(LOG_ERROR, "No probe tiers to probe %s with\n", uri.c_str());
+        return false;
+    }
+
+    if (!openInput(uri)) {
+        return false;
+    }
+
+    if (probe_snapshot && !probe_snapshot->isEmpty()) {
+        if (probe_snapshot->matches(m_av_format_context.get())) {
+            m_probe_stats.is_probe_snapshot_used = probe_snapshot->apply(m_av_format_context.get());
+        }
+        if (!m_probe_stats.is_probe_snapshot_used) {
+            log(LOG_INFO, "Probe snapshot doesn't match %s, probing it instead\n", uri.c_str());
+        }
+    }
+
+    if (m_probe_stats.is_probe_snapshot_used) {
+        m_probe_snapshot = *probe_snapshot;
+        m_probe_stats.is_complete = isProbeComplete();
+    } else {
+        // hls (ts files really) don't have any headers, so libav needs to read through the stream a bit to
+        // extract metadata that is periodically placed in there. Good videos have it all near the start,
+        // messed up videos need a lot more read to find it, so the limits are only raised when it is missing
+        for (size_t i = 0; i < m_probe_tiers.size(); i++) {
+            const ProbeTier &probe_tier = m_probe_tiers[i];
+            if (i > 0) {
+                // libav can't pick up probing where it stopped, so start over with the input opened
+                // again; what was read the last time is normally still in the custom io group's cache
+                m_av_format_context = nullptr;
+                if (!openInput(uri)) {
+                    return false;
+                }
+            }
+
+            m_av_format_context->probesize = probe_tier.probe_size;
+            m_av_format_context->max_analyze_duration = probe_tier.analyze_duration * AV_TIME_BASE;
+
+            ret = avformat_find_stream_info(m_av_format_context.get(), NULL);
+            m_probe_stats.count_tiers++;
+            if (m_av_format_context->pb) {
+                m_probe_stats.bytes_read += m_av_format_context->pb->bytes_read;
+            }
+            bool is_last_tier = i == m_probe_tiers.size() - 1;
+            if (ret < 0) {
+                if (is_last_tier || isStopped()) {
+                    char buf[100];
+                    av_strerror(ret, buf, sizeof(buf));
+                    log(LOG_ERROR, "Error retrieving input stream information %i %s\n", ret, buf);
+                    return false;
+                }
+                continue;
+            }
+
+            m_probe_stats.is_complete = isProbeComplete();
+            if (m_probe_stats.is_complete) {
+                break;
+            }
+            if (is_last_tier) {
+                log(LOG_INFO, "Stream parameters of %s are still incomplete after probing\n", uri.c_str());
+            }
+        }
+
+        if (!m_probe_snapshot.capture(m_av_format_context.get())) {
+            return false;
+        }
+    }
+
+    m_probe_stats.time = (av_gettime_relative() - start_time_usec) / 1000000.0;
+
+    //av_dump_format(input_format_context.get(), 0, source_uri.c_str(), 0);
+
+    m_stream_map.init(m_av_format_context);
+
+    return true;
+}
+
+bool VideoReader::openInput(const std::string &uri) {
     int ret;
 
     AVFormatContext *input_format_context_raw = avformat_alloc_context();
@@ -42,7 +200,11 @@ bool VideoReader::init(CustomIoGroup *custom_io_group, const std::string &uri) {
     }
     input_format_context_raw->protocol_whitelist = av_strdup("file,https,tcp,tls");
 
-    setupInputCustomIoIfNeeded(custom_io_group, input_format_context_raw);
+    setupInputCustomIoIfNeeded(m_custom_io_group, input_format_context_raw);
+    if (!m_custom_io_group) {
+        input_format_context_raw->interrupt_callback.callback = operationControlInterruptCallback;
+        input_format_context_raw->interrupt_callback.opaque = &m_operation_control;
+    }
 
     AVDictionary *opts = NULL;
     if (stringEndsWith(uri, std::string(".m3u8"))) {
@@ -70,22 +232,36 @@ bool VideoReader::init(CustomIoGroup *custom_io_group, const std::string &uri) {
     // put it in a smart pointer to get it properly closed in all cases
     m_av_format_context = std::shared_ptr<AVFormatContext>(input_format_context_raw, AVFormatContextInputCloser());
 
-    // hls (ts files really) don't have any headers, so libav needs to read through the stream a bit to
-    // extract metadata that is periodically placed in there. The default is fine for good videos, but
-    // messed up videos need some extra time to find the metadata
-    m_av_format_context->max_analyze_duration = 60 * AV_TIME_BASE;
+    return true;
+}
 
-    ret = avformat_find_stream_info(m_av_format_context.get(), NULL);
-    if (ret < 0) {
-        char buf[100];
-        av_strerror(ret, buf, sizeof(buf));
-        log(LOG_ERROR, "Error retrieving input stream information %i %s\n", ret, buf);
-        return false;
+bool VideoReader::isProbeComplete() {
+    AVFormatContext *format_context = m_av_format_context.get();
+
+    // the same streams StreamMap picks
+    bool has_video = false;
+    bool has_audio = false;
+    for (unsigned int i = 0; i < format_context->nb_streams; i++) {
+        AVCodecParameters *codecpar = format_context->streams[i]->codecpar;
+        if (codecpar->codec_type == AVMEDIA_TYPE_VIDEO && !has_video) {
+            has_video = true;
+            if (codecpar->width <= 0 || codecpar->height <= 0 || codecpar->format < 0) {
+                return false;
+            }
+        } else if (codecpar->codec_type == AVMEDIA_TYPE_AUDIO && !has_audio) {
+            has_audio = true;
+            // no channel layout is fine, initAudioCodecContext uses the default one for the
+            // number of channels (wav files don't have one)
+            if (codecpar->sample_rate <= 0 || codecpar->channels <= 0 || codecpar->format < 0) {
+                return false;
+            }
+        }
     }
 
-    //av_dump_format(input_format_context.get(), 0, source_uri.c_str(), 0);
-
-    m_stream_map.init(m_av_format_context);
+    // without headers, streams only show up once some of them has been read
+    if (!has_video && (format_context->ctx_flags & AVFMTCTX_NOHEADER)) {
+        return false;
+    }
 
     return true;
 }
@@ -97,17 +273,38 @@ void VideoReader::destroy() {
     m_audio_av_codec_context = nullptr;
 
     m_av_format_context = nullptr;
+    m_custom_io_group = nullptr;
 
     m_stream_map.destroy();
 
+    m_probe_snapshot = ProbeSnapshot();
+    m_probe_stats = ProbeStats();
+
     m_latest_video_pts = -1;
     m_latest_video_duration_pts = 0;
 
     m_pending_packet_queue.clear();
 
+    m_is_stopped = false;
+
     //printf("VideoReader::destroy returning\n");
 }
 
+int64_t VideoReader::getMemoryUsage() {
+    int64_t memory_usage = m_pending_packet_queue.getDataSize();
+
+    if (m_video_av_codec_context) {
+        // the decoder keeps its reference frames, plus one being output
+        AVCodecContext *codec_context = m_video_av_codec_context.get();
+        int size = av_image_get_buffer_size(codec_context->pix_fmt, codec_context->width, codec_context->height, 1);
+        if (size > 0) {
+            memory_usage += (int64_t)size * (std::max(codec_context->refs, 1) + 1);
+        }
+    }
+
+    return memory_usage;
+}
+
 bool VideoReader::verifyHasVideoStream() {
     if (!m_stream_map.hasVideo()) {
         log(LOG_INFO, "no video stream found\n");
@@ -125,6 +322,8 @@ bool VideoReader::verifyHasAudioStream() {
 }
 
 bool VideoReader::getImageAtTimestamp(double timestamp, GetImageResult &get_image_result) {
+    recoverFromStop();
+
     //log(LOG_INFO, "trying to get image at timestamp %f\n", timestamp);
 
     if (!initVideoCodecContext()) {
@@ -226,7 +425,9 @@ bool VideoReader::getMetadata(GetMetadataResult &get_metadata_result) {
     return true;
 }
 
-bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_time, double end_time, ExtractClipResult &result, ProgressFunc progress_func) {
+bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_time, double end_time, ExtractClipResult &result, ProgressFunc progress_func, const OutputOptions &output_options) {
+    recoverFromStop();
+
     if (end_time < start_time) {
         log(LOG_ERROR, "Invalid end time %f before start time %f\n", end_time, start_time);
         return false;
@@ -262,6 +463,11 @@ bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_
         return false;
     }
 
+    if (isHlsOutput(output_format_context.get())) {
+        // so every segment can start exactly on time
+        m_stream_map.setForcedKeyFrameInterval(output_options.hls_segment_duration);
+    }
+
     if (output_format_context->oformat->flags & AVFMT_GLOBALHEADER) {
         output_format_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
     }
@@ -269,16 +475,12 @@ bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_
     av_dump_format(output_format_context.get(), 0, dest_uri.c_str(), 1);
 
     // open and initialize output
-    ret = avio_open(&output_format_context->pb, dest_uri.c_str(), AVIO_FLAG_WRITE);
-    if (ret < 0) {
-        char buf[100];
-        av_strerror(ret, buf, sizeof(buf));
-        log(LOG_ERROR, "Error opening output file %s %i %s\n", dest_uri.c_str(), ret, buf);
+    if (!openOutputIo(m_custom_io_group, output_format_context.get(), dest_uri)) {
         return false;
     }
 
     AVDictionary *opts = NULL;
-    av_dict_set(&opts, "movflags", "faststart", 0);
+    setMuxerOptions(output_format_context.get(), output_options, &opts);
 
     ret = avformat_write_header(output_format_context.get(), &opts);
     if (ret < 0) {
@@ -288,24 +490,9 @@ bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_
         return false;
     }
 
-    // put it in a smart pointer to get it properly freed in all cases
-    auto packet = std::unique_ptr<AVPacket, AVPacketDeleter>(av_packet_alloc(), AVPacketDeleter());
-    if (!packet) {
-        log(LOG_ERROR, "Error allocating packet\n");
-        return false;
-    }
-
-    // put it in a smart pointer to get it properly freed in all cases
-    auto frame = std::unique_ptr<AVFrame, AVFrameDeleter>(av_frame_alloc(), AVFrameDeleter());
-    if (!frame) {
-        printf("Error allocating frame\n");
-        return false;
-    }
-
     double duration = end_time - start_time;
     int total = (int)(ceil(duration + 2)); // let the seek and draining each count a step too
     int prev_step = 0;
-    int64_t progress_pts = 0;
     progress_func(prev_step, total);
 
     // loop through reading all the packets and reencode
@@ -319,50 +506,126 @@ bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_
     prev_step++;
     progress_func(prev_step, total);
 
-    // remember, safeSeek only got us to the latest key frame before the desired_start_pts!
-    // so we need to process some packets before encoding the output
-    bool is_encoding_started = false;
+    // The reencode runs as a pipeline so that reading (which can block on custom io), decoding,
+    // encoding and muxing overlap instead of adding up:
+    //
+    //   demux -+-> video packets -> video decode -> video frames -> video encode -+-> output packets -> mux
+    //          +-> audio packets -> audio decode/resample/encode -----------------+
+    //
+    // Each stage runs on its own thread, except mux which stays on this thread since that's where
+    // progress_func must be called from. The queues are bounded, so a slow stage holds back the
+    // ones before it instead of letting memory grow. A stage that fails aborts every queue, which
+    // unblocks and stops all the others.
 
-    bool is_done = false;
-    while (!is_done) {
-        ret = readFrame(packet.get());
-        if (ret == AVERROR_EOF) {
-            break;
-        }
-        if (ret < 0) {
-            char buf[100];
-            av_strerror(ret, buf, sizeof(buf));
-            log(LOG_ERROR, "Error reading frame %i %s\n", ret, buf);
+    auto video_stream_data = m_stream_map.getVideoStreamData();
+    auto audio_stream_data = m_stream_map.getAudioStreamData();
+    bool has_audio = m_stream_map.hasAudio();
+
+    BoundedQueue<PacketPtr> video_packet_queue(REENCODE_PACKET_QUEUE_SIZE);
+    BoundedQueue<PacketPtr> audio_packet_queue(REENCODE_PACKET_QUEUE_SIZE);
+    BoundedQueue<FramePtr> video_frame_queue(REENCODE_FRAME_QUEUE_SIZE);
+    // the video encoder and the audio stage both feed the muxer
+    BoundedQueue<PacketPtr> output_packet_queue(REENCODE_PACKET_QUEUE_SIZE, has_audio ? 2 : 1);
+
+    std::atomic<bool> is_failed(false);
+    auto fail = [&]() {
+        is_failed = true;
+        video_packet_queue.abort();
+        audio_packet_queue.abort();
+        video_frame_queue.abort();
+        output_packet_queue.abort();
+    };
+
+    // video pts of the latest demuxed packet, only used for progress
+    std::atomic<int64_t> progress_pts(0);
+
+    PipelineStageStats demux_stats("demux");
+    PipelineStageStats video_decode_stats("video decode");
+    PipelineStageStats video_encode_stats("video encode");
+    PipelineStageStats audio_stats("audio decode/encode");
+    PipelineStageStats mux_stats("mux");
+
+    // encoders hand their packets to the muxer through output_packet_queue
+    auto queue_output_packet = [&output_packet_queue](AVPacket *packet, int64_t *wait_usec) -> bool {
+        auto queued_packet = PacketPtr(av_packet_alloc(), AVPacketDeleter());
+        if (!queued_packet) {
+            log(LOG_ERROR, "Error allocating output packet\n");
             return false;
         }
+        av_packet_move_ref(queued_packet.get(), packet);
+        return output_packet_queue.push(std::move(queued_packet), wait_usec);
+    };
 
-        // automatically unreference packet at end of loop
-        AVPacketUnref packet_unref(packet.get());
+    // remember, safeSeek only got us to the latest key frame before the desired_start_pts!
+    // so we need to read some packets before passing them on to be encoded
+    auto demux_func = [&]() -> bool {
+        bool is_encoding_started = false;
+
+        bool is_done = false;
+        while (!is_done) {
+            auto packet = PacketPtr(av_packet_alloc(), AVPacketDeleter());
+            if (!packet) {
+                log(LOG_ERROR, "Error allocating packet\n");
+                return false;
+            }
 
-        std::shared_ptr<StreamData> stream_data = m_stream_map.getStreamDataByInputStreamIndex(packet->stream_index);
-        if (!stream_data) {
-            // not a stream we care about
-            continue;
-        }
+            int ret = readFrame(packet.get());
+            if (ret == AVERROR_EOF) {
+                break;
+            }
+            if (ret < 0) {
+                char buf[100];
+                av_strerror(ret, buf, sizeof(buf));
+                log(LOG_ERROR, "Error reading frame %i %s\n", ret, buf);
+                return false;
+            }
+            demux_stats.count_items++;
 
-        if (packet->stream_index == m_stream_map.getVideoInputStreamIndex()) {
-            if (convertVideoTsToSec(packet->pts) > end_time) {
-                is_done = true;
+            std::shared_ptr<StreamData> stream_data = m_stream_map.getStreamDataByInputStreamIndex(packet->stream_index);
+            if (!stream_data) {
+                // not a stream we care about
+                continue;
             }
-        }
 
-        if (packet->stream_index == m_stream_map.getVideoInputStreamIndex()) {
-            progress_pts = packet->pts;
+            if (packet->stream_index == m_stream_map.getVideoInputStreamIndex()) {
+                if (convertVideoTsToSec(packet->pts) > end_time) {
+                    is_done = true;
+                }
+                progress_pts = packet->pts;
+
+                if (!is_encoding_started && packet->pts + packet->duration > desired_start_pts) {
+                    //printf("starting encoding with pts %li desired start was %li\n", packet->pts, desired_start_pts);
+                    is_encoding_started = true;
+                    // this happens before any packet is queued, so the other stages see the base pts
+                    m_stream_map.setAllBasePts(stream_data, packet->pts);
+                }
 
-            if (!is_encoding_started && packet->pts + packet->duration > desired_start_pts) {
-                //printf("starting encoding with pts %li desired start was %li\n", packet->pts, desired_start_pts);
-                is_encoding_started = true;
-                m_stream_map.setAllBasePts(stream_data, packet->pts);
+                if (!is_encoding_started) {
+                    continue;
+                }
+
+                if (!video_packet_queue.push(std::move(packet), &demux_stats.output_wait_usec)) {
+                    return false;
+                }
+                continue;
             }
 
             if (!is_encoding_started) {
                 continue;
             }
+            if (packet->stream_index == m_stream_map.getAudioInputStreamIndex()) {
+                if (!audio_packet_queue.push(std::move(packet), &demux_stats.output_wait_usec)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    auto video_decode_func = [&]() -> bool {
+        PacketPtr packet;
+        while (video_packet_queue.pop(packet, &video_decode_stats.input_wait_usec)) {
+            video_decode_stats.count_items++;
 
             int ret = avcodec_send_packet(m_video_av_codec_context.get(), packet.get());
             if (ret < 0) {
@@ -373,8 +636,14 @@ bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_
                     return false;
                 }
             }
+            packet = nullptr;
 
             while (true) {
+                auto frame = FramePtr(av_frame_alloc(), AVFrameDeleter());
+                if (!frame) {
+                    log(LOG_ERROR, "Error allocating frame\n");
+                    return false;
+                }
                 ret = avcodec_receive_frame(m_video_av_codec_context.get(), frame.get());
                 if (ret < 0) {
                     if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) {
@@ -386,19 +655,52 @@ bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_
                     return false;
                 }
 
-                // automatically unreference frame at end of loop
-                AVFrameUnref frame_unref(frame.get());
-
-                if (!m_stream_map.encodeVideo(stream_data, output_format_context.get(), frame.get())) {
+                if (!video_frame_queue.push(std::move(frame), &video_decode_stats.output_wait_usec)) {
                     return false;
                 }
             }
         }
+        return true;
+    };
 
-        if (!is_encoding_started) {
-            continue;
+    auto video_encode_func = [&]() -> bool {
+        WritePacketFunc write_packet_func = [&](AVPacket *packet) {
+            return queue_output_packet(packet, &video_encode_stats.output_wait_usec);
+        };
+
+        FramePtr frame;
+        while (video_frame_queue.pop(frame, &video_encode_stats.input_wait_usec)) {
+            video_encode_stats.count_items++;
+
+            if (!m_stream_map.encodeVideo(video_stream_data, frame.get(), write_packet_func)) {
+                return false;
+            }
+            frame = nullptr;
         }
-        if (packet->stream_index == m_stream_map.getAudioInputStreamIndex()) {
+        if (is_failed) {
+            return false;
+        }
+
+        // drain any last frames of video
+        return m_stream_map.encodeVideo(video_stream_data, NULL, write_packet_func);
+    };
+
+    auto audio_func = [&]() -> bool {
+        WritePacketFunc write_packet_func = [&](AVPacket *packet) {
+            return queue_output_packet(packet, &audio_stats.output_wait_usec);
+        };
+
+        // put it in a smart pointer to get it properly freed in all cases
+        auto frame = FramePtr(av_frame_alloc(), AVFrameDeleter());
+        if (!frame) {
+            log(LOG_ERROR, "Error allocating frame\n");
+            return false;
+        }
+
+        PacketPtr packet;
+        while (audio_packet_queue.pop(packet, &audio_stats.input_wait_usec)) {
+            audio_stats.count_items++;
+
             int ret = avcodec_send_packet(m_audio_av_codec_context.get(), packet.get());
             if (ret < 0) {
                 if (ret != AVERROR(EAGAIN)) {
@@ -408,6 +710,7 @@ bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_
                     return false;
                 }
             }
+            packet = nullptr;
 
             while (true) {
                 ret = avcodec_receive_frame(m_audio_av_codec_context.get(), frame.get());
@@ -424,11 +727,62 @@ bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_
                 // automatically unreference frame at end of loop
                 AVFrameUnref frame_unref(frame.get());
 
-                if (!m_stream_map.encodeAudio(stream_data, output_format_context.get(), frame.get())) {
+                if (!m_stream_map.encodeAudio(audio_stream_data, frame.get(), write_packet_func)) {
                     return false;
                 }
             }
         }
+        if (is_failed) {
+            return false;
+        }
+
+        // drain any last frames of audio
+        return m_stream_map.encodeAudio(audio_stream_data, NULL, write_packet_func);
+    };
+
+    // runs a stage on its own thread; when it finishes (either way) it closes its side of its output queues.
+    // These are plain threads, not WorkerPool fibers: the queues between the stages block the thread, so a
+    // stage waiting in the pool's queue could be waited on by the pool thread it needs. So a demux stage
+    // waiting on its input io holds up its thread, and its yieldPoint() calls do nothing
+    auto start_stage = [&fail](PipelineStageStats &stats, std::function<bool()> stage_func, std::function<void()> done_func) {
+        return std::thread([&stats, &fail, stage_func, done_func]() {
+            stats.start();
+            if (!stage_func()) {
+                fail();
+            }
+            done_func();
+            stats.stop();
+        });
+    };
+
+    std::vector<std::thread> threads;
+    threads.push_back(start_stage(demux_stats, demux_func, [&]() {
+        video_packet_queue.producerDone();
+        audio_packet_queue.producerDone();
+    }));
+    threads.push_back(start_stage(video_decode_stats, video_decode_func, [&]() {
+        video_frame_queue.producerDone();
+    }));
+    threads.push_back(start_stage(video_encode_stats, video_encode_func, [&]() {
+        output_packet_queue.producerDone();
+    }));
+    if (has_audio) {
+        threads.push_back(start_stage(audio_stats, audio_func, [&]() {
+            output_packet_queue.producerDone();
+        }));
+    }
+
+    // mux runs right here
+    mux_stats.start();
+    PacketPtr output_packet;
+    while (output_packet_queue.pop(output_packet, &mux_stats.input_wait_usec)) {
+        mux_stats.count_items++;
+
+        if (!StreamMap::writePacket(output_format_context.get(), output_packet.get())) {
+            fail();
+            break;
+        }
+        output_packet = nullptr;
 
         int step = (int)(1 + convertVideoTsToSec(progress_pts) - start_time);
         if (step > prev_step) {
@@ -436,22 +790,32 @@ bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_
             prev_step = step;
         }
     }
+    mux_stats.stop();
 
-    // drain any last frames of video and audio
-    if (!m_stream_map.encodeVideo(m_stream_map.getVideoStreamData(), output_format_context.get(), NULL)) {
-        return false;
+    for (auto &thread: threads) {
+        thread.join();
     }
-    if (m_stream_map.hasAudio()) {
-        if (!m_stream_map.encodeAudio(m_stream_map.getAudioStreamData(), output_format_context.get(), NULL)) {
-            return false;
-        }
+
+    demux_stats.logStats();
+    video_decode_stats.logStats();
+    video_encode_stats.logStats();
+    if (has_audio) {
+        audio_stats.logStats();
+    }
+    mux_stats.logStats();
+
+    if (is_failed) {
+        return false;
     }
 
     av_write_trailer(output_format_context.get());
 
+    if (!closeOutputIo(output_format_context.get(), result.output_data)) {
+        return false;
+    }
+
     progress_func(total, total);
 
-    auto video_stream_data = m_stream_map.getVideoStreamData();
     double output_start_time = video_stream_data->base_pts * av_q2d(m_stream_map.getVideoAvStream()->time_base);
     double output_duration = (getLatestVideoPts() - getLatestVideoDurationPts() - video_stream_data->base_pts) * av_q2d(m_stream_map.getVideoAvStream()->time_base);
 
@@ -465,7 +829,9 @@ bool VideoReader::extractClipReencode(const std::string &dest_uri, double start_
     return true;
 }
 
-bool VideoReader::extractClipRemux(const std::string &dest_uri, double start_time, double end_time, ExtractClipResult &result, ProgressFunc progress_func) {
+bool VideoReader::extractClipRemux(const std::string &dest_uri, double start_time, double end_time, ExtractClipResult &result, ProgressFunc progress_func, const OutputOptions &output_options) {
+    recoverFromStop();
+
     if (end_time < start_time) {
         log(LOG_ERROR, "Invalid end time %f before start time %f\n", end_time, start_time);
         return false;
@@ -481,40 +847,8 @@ bool VideoReader::extractClipRemux(const std::string &dest_uri, double start_tim
 
     int ret;
 
-    AVFormatContext *output_format_context_raw = NULL;
-    ret = avformat_alloc_output_context2(&output_format_context_raw, NULL, NULL, dest_uri.c_str());
-    if (ret < 0) {
-        char buf[100];
-        av_strerror(ret, buf, sizeof(buf));
-        log(LOG_ERROR, "Error allocating output format context %i %s\n", ret, buf);
-        return false;
-    }
-    // put it in a smart pointer to get it properly freed in all cases
-    auto output_format_context = std::unique_ptr<AVFormatContext, AVFormatContextOutputCloser>(output_format_context_raw, AVFormatContextOutputCloser());
-
-    if (!m_stream_map.createOutputStreamsCopyInputFormat(output_format_context.get())) {
-        return false;
-    }
-
-    //av_dump_format(output_format_context.get(), 0, dest_uri.c_str(), 1);
-
-    // open and initialize output
-    ret = avio_open(&output_format_context->pb, dest_uri.c_str(), AVIO_FLAG_WRITE);
-    if (ret < 0) {
-        char buf[100];
-        av_strerror(ret, buf, sizeof(buf));
-        log(LOG_ERROR, "Error opening output file %s %i %s\n", dest_uri.c_str(), ret, buf);
-        return false;
-    }
-
-    AVDictionary *opts = NULL;
-    av_dict_set(&opts, "movflags", "faststart", 0);
-
-    ret = avformat_write_header(output_format_context.get(), &opts);
-    if (ret < 0) {
-        char buf[100];
-        av_strerror(ret, buf, sizeof(buf));
-        log(LOG_ERROR, "Error writing header %i %s\n", ret, buf);
+    std::unique_ptr<AVFormatContext, AVFormatContextOutputCloser> output_format_context;
+    if (!openRemuxOutput(m_stream_map, dest_uri, output_options, output_format_context)) {
         return false;
     }
 
@@ -545,6 +879,9 @@ bool VideoReader::extractClipRemux(const std::string &dest_uri, double start_tim
 
     bool is_done = false;
     while (!is_done) {
+        // this can go on for minutes, let anything more urgent go first
+        yieldPoint();
+
         ret = readFrame(packet.get());
         if (ret == AVERROR_EOF) {
             break;
@@ -603,12 +940,16 @@ bool VideoReader::extractClipRemux(const std::string &dest_uri, double start_tim
     //https://ffmpeg.org/doxygen/trunk/group__lavf__encoding.html#ga7f14007e7dc8f481f054b21614dfec13
     av_write_trailer(output_format_context.get());
 
+    if (!closeOutputIo(output_format_context.get(), result.output_data)) {
+        return false;
+    }
+
     progress_func(total, total);
 
     return true;
 }
 
-bool VideoReader::remux(const std::string &dest_uri, ExtractClipResult &result, ProgressFunc progress_func) {
+bool VideoReader::remux(const std::string &dest_uri, ExtractClipResult &result, ProgressFunc progress_func, const OutputOptions &output_options) {
     if (!initVideoCodecContext()) {
         return false;
     }
@@ -618,10 +959,289 @@ bool VideoReader::remux(const std::string &dest_uri, ExtractClipResult &result,
 
     double end_time = std::max((double)0, getStartTime()) + getDuration() + 1;
 
-    return extractClipRemux(dest_uri, 0, end_time, result, progress_func);
+    return extractClipRemux(dest_uri, 0, end_time, result, progress_func, output_options);
+}
+
+bool VideoReader::openRemuxOutput(StreamMap &stream_map, const std::string &dest_uri, const OutputOptions &output_options, std::unique_ptr<AVFormatContext, AVFormatContextOutputCloser> &output_format_context) {
+    AVFormatContext *output_format_context_raw = NULL;
+    int ret = avformat_alloc_output_context2(&output_format_context_raw, NULL, NULL, dest_uri.c_str());
+    if (ret < 0) {
+        char buf[100];
+        av_strerror(ret, buf, sizeof(buf));
+        log(LOG_ERROR, "Error allocating output format context %i %s\n", ret, buf);
+        return false;
+    }
+    // put it in a smart pointer to get it properly freed in all cases
+    output_format_context = std::unique_ptr<AVFormatContext, AVFormatContextOutputCloser>(output_format_context_raw, AVFormatContextOutputCloser());
+
+    if (!stream_map.createOutputStreamsCopyInputFormat(output_format_context.get())) {
+        return false;
+    }
+
+    //av_dump_format(output_format_context.get(), 0, dest_uri.c_str(), 1);
+
+    // open and initialize output
+    if (!openOutputIo(m_custom_io_group, output_format_context.get(), dest_uri)) {
+        return false;
+    }
+
+    AVDictionary *opts = NULL;
+    setMuxerOptions(output_format_context.get(), output_options, &opts);
+
+    ret = avformat_write_header(output_format_context.get(), &opts);
+    if (ret < 0) {
+        char buf[100];
+        av_strerror(ret, buf, sizeof(buf));
+        log(LOG_ERROR, "Error writing header %i %s\n", ret, buf);
+        return false;
+    }
+
+    return true;
+}
+
+// one output of extractClipsRemux
+struct ClipOutput {
+    ClipOutput(const ClipRange &clip_range, size_t result_index) :
+        clip_range(clip_range),
+        result_index(result_index) {
+    }
+
+    const ClipRange &clip_range;
+    size_t result_index;
+
+    // each output has its own stream map, since base pts and output streams are per output
+    StreamMap stream_map;
+    std::unique_ptr<AVFormatContext, AVFormatContextOutputCloser> output_format_context;
+
+    // input pts and duration of the latest video packet written
+    int64_t latest_video_pts = -1;
+    int64_t latest_video_duration_pts = 0;
+
+    bool is_done = false;
+};
+
+bool VideoReader::extractClipsRemux(const std::vector<ClipRange> &clip_ranges, std::vector<ExtractClipResult> &results, ProgressFunc progress_func, const OutputOptions &output_options) {
+    recoverFromStop();
+
+    if (clip_ranges.empty()) {
+        log(LOG_ERROR, "No clips to extract\n");
+        return false;
+    }
+    for (auto &clip_range: clip_ranges) {
+        if (clip_range.end_time < clip_range.start_time) {
+            log(LOG_ERROR, "Invalid end time %f before start time %f\n", clip_range.end_time, clip_range.start_time);
+            return false;
+        }
+    }
+
+    if (!verifyHasVideoStream()) {
+        return false;
+    }
+
+    m_stream_map.init(m_av_format_context);
+
+    results.clear();
+    results.resize(clip_ranges.size());
+
+    // clips waiting to start, in order of start time
+    std::deque<std::unique_ptr<ClipOutput>> pending_clips;
+    for (size_t i = 0; i < clip_ranges.size(); i++) {
+        pending_clips.push_back(std::make_unique<ClipOutput>(clip_ranges[i], i));
+    }
+    std::stable_sort(pending_clips.begin(), pending_clips.end(), [](const std::unique_ptr<ClipOutput> &a, const std::unique_ptr<ClipOutput> &b) {
+        return a->clip_range.start_time < b->clip_range.start_time;
+    });
+    std::vector<std::unique_ptr<ClipOutput>> active_clips;
+
+    double first_start_time = pending_clips.front()->clip_range.start_time;
+    double last_end_time = first_start_time;
+    for (auto &clip: pending_clips) {
+        last_end_time = std::max(last_end_time, clip->clip_range.end_time);
+    }
+
+    int total = (int)(ceil(last_end_time - first_start_time + 2)); // let the seek and draining each count a step too
+    int prev_step = 0;
+    progress_func(prev_step, total);
+
+    // put it in a smart pointer to get it properly freed in all cases
+    auto packet = std::unique_ptr<AVPacket, AVPacketDeleter>(av_packet_alloc(), AVPacketDeleter());
+    if (!packet) {
+        log(LOG_ERROR, "Error allocating packet\n");
+        return false;
+    }
+    // scratch packet for each output's copy, since remuxing consumes the packet
+    auto output_packet = std::unique_ptr<AVPacket, AVPacketDeleter>(av_packet_alloc(), AVPacketDeleter());
+    if (!output_packet) {
+        log(LOG_ERROR, "Error allocating packet\n");
+        return false;
+    }
+
+    // every packet since the latest video key frame; a clip starting in this gop gets all of them,
+    // the same as seeking to the key frame before its start would have
+    PacketQueue gop_packet_queue;
+
+    auto write_to_clip = [this, &output_packet](ClipOutput &clip, AVPacket *packet) -> bool {
+        std::shared_ptr<StreamData> stream_data = clip.stream_map.getStreamDataByInputStreamIndex(packet->stream_index);
+        if (!stream_data) {
+            return true;
+        }
+
+        if (!clip.stream_map.hasBasePts()) {
+            clip.stream_map.setAllBasePts(stream_data, packet->pts);
+        }
+
+        if (packet->stream_index == m_stream_map.getVideoInputStreamIndex()) {
+            clip.latest_video_pts = packet->pts;
+            clip.latest_video_duration_pts = packet->duration;
+
+            // need to read packet->pts before remuxing since remuxing modifies them
+            if (convertVideoTsToSec(packet->pts) > clip.clip_range.end_time) {
+                clip.is_done = true;
+            }
+        }
+
+        av_packet_ref(output_packet.get(), packet);
+        // automatically unreference packet at end of function (writing normally takes it already)
+        AVPacketUnref packet_unref(output_packet.get());
+
+        return clip.stream_map.remuxPacket(output_packet.get(), clip.output_format_context.get());
+    };
+
+    auto finish_clip = [this, &results](ClipOutput &clip) -> bool {
+        //https://ffmpeg.org/doxygen/trunk/group__lavf__encoding.html#ga7f14007e7dc8f481f054b21614dfec13
+        av_write_trailer(clip.output_format_context.get());
+
+        ExtractClipResult &result = results[clip.result_index];
+        if (!closeOutputIo(clip.output_format_context.get(), result.output_data)) {
+            return false;
+        }
+        clip.output_format_context = nullptr;
+
+        auto video_stream_data = clip.stream_map.getVideoStreamData();
+
+        clip.stream_map.logStats();
+
+        result.count_video_packets = video_stream_data->count_packets;
+        result.count_key_frames = video_stream_data->count_key_frames;
+        result.video_start_time = convertVideoTsToSec(video_stream_data->base_pts);
+        result.video_duration = convertVideoTsToSec(clip.latest_video_pts - clip.latest_video_duration_pts - video_stream_data->base_pts);
+        return true;
+    };
+
+    bool is_eof = false;
+    if (!safeSeek(convertVideoSecToTs(first_start_time), is_eof)) {
+        return false;
+    }
+
+    // the first clip is already sought to
+    size_t sought_clip_index = pending_clips.front()->result_index;
+
+    while (!pending_clips.empty() || !active_clips.empty()) {
+        yieldPoint();
+
+        if (active_clips.empty() && pending_clips.front()->result_index != sought_clip_index) {
+            // nothing is being written, so if the next clip is far enough ahead it's cheaper to seek
+            // (which rewinds a bit and reads forward to it) than to read everything in between
+            sought_clip_index = pending_clips.front()->result_index;
+            double next_start_time = pending_clips.front()->clip_range.start_time;
+            if (m_latest_video_pts >= 0 && next_start_time - convertVideoTsToSec(m_latest_video_pts) > MIN_CLIP_GAP_TO_SEEK_SEC) {
+                if (!safeSeek(convertVideoSecToTs(next_start_time), is_eof)) {
+                    return false;
+                }
+                gop_packet_queue.clear();
+            }
+        }
+
+        int ret = readFrame(packet.get());
+        if (ret == AVERROR_EOF) {
+            break;
+        }
+        if (ret < 0) {
+            char buf[100];
+            av_strerror(ret, buf, sizeof(buf));
+            log(LOG_ERROR, "Error reading frame %i %s\n", ret, buf);
+            return false;
+        }
+
+        // automatically unreference packet at end of loop
+        AVPacketUnref packet_unref(packet.get());
+
+        std::shared_ptr<StreamData> stream_data = m_stream_map.getStreamDataByInputStreamIndex(packet->stream_index);
+        if (!stream_data) {
+            // not a stream we care about
+            continue;
+        }
+
+        bool is_video = packet->stream_index == m_stream_map.getVideoInputStreamIndex();
+        if (is_video && packet->flags == AV_PKT_FLAG_KEY) {
+            gop_packet_queue.clear();
+        }
+        if (!gop_packet_queue.add(packet.get())) {
+            return false;
+        }
+
+        for (auto &clip: active_clips) {
+            if (!write_to_clip(*clip, packet.get())) {
+                return false;
+            }
+        }
+
+        // start every clip that begins in this gop; they get the gop so far, which includes this packet
+        while (is_video && !pending_clips.empty() && packet->pts + packet->duration >= convertVideoSecToTs(pending_clips.front()->clip_range.start_time)) {
+            auto clip = std::move(pending_clips.front());
+            pending_clips.pop_front();
+
+            clip->stream_map.init(m_av_format_context);
+            if (!openRemuxOutput(clip->stream_map, clip->clip_range.dest_uri, output_options, clip->output_format_context)) {
+                return false;
+            }
+            for (auto &queued_packet: gop_packet_queue) {
+                if (!write_to_clip(*clip, queued_packet.get())) {
+                    return false;
+                }
+            }
+            active_clips.push_back(std::move(clip));
+        }
+
+        for (auto it = active_clips.begin(); it != active_clips.end();) {
+            if (!(*it)->is_done) {
+                ++it;
+                continue;
+            }
+            if (!finish_clip(**it)) {
+                return false;
+            }
+            it = active_clips.erase(it);
+        }
+
+        if (is_video) {
+            int step = (int)(1 + convertVideoTsToSec(packet->pts) - first_start_time);
+            if (step > prev_step && step < total) {
+                progress_func(step, total);
+                prev_step = step;
+            }
+        }
+    }
+
+    // end of input finishes whatever is still running, the same as a single clip running off the end
+    for (auto &clip: active_clips) {
+        if (!finish_clip(*clip)) {
+            return false;
+        }
+    }
+    if (!pending_clips.empty()) {
+        log(LOG_ERROR, "Clip starting at %f is past the end of the input\n", pending_clips.front()->clip_range.start_time);
+        return false;
+    }
+
+    progress_func(total, total);
+
+    return true;
 }
 
 bool VideoReader::getClipVolumeData(double start_time, double end_time, GetVolumeDataResult &result, ProgressFunc progress_func) {
+    recoverFromStop();
+
     if (end_time < start_time) {
         log(LOG_ERROR, "Invalid end time %f before start time %f\n", end_time, start_time);
         return false;
@@ -714,6 +1334,8 @@ bool VideoReader::getClipVolumeData(double start_time, double end_time, GetVolum
 
     bool is_done = false;
     while (!is_done) {
+        yieldPoint();
+
         ret = readFrame(packet.get());
         if (ret == AVERROR_EOF) {
             break;
@@ -828,10 +1450,71 @@ bool VideoReader::getVolumeData(GetVolumeDataResult &result, ProgressFunc progre
     return getClipVolumeData(start_time, end_time, result, progress_func);
 }
 
+bool VideoReader::isStopped() {
+    if (!m_operation_control.isStopped()) {
+        return false;
+    }
+    if (!m_is_stopped) {
+        m_is_stopped = true;
+        if (m_operation_control.isCancelled()) {
+            log(LOG_INFO, "Action cancelled\n");
+        } else {
+            log(LOG_INFO, "Action deadline passed\n");
+        }
+    }
+    return true;
+}
+
+// a stopped action can leave packets queued, frames in the decoders, the input in the middle of
+// a packet and its io context flagged with libav's exit error, so the reader goes back to the
+// state it was in right after init
+void VideoReader::recoverFromStop() {
+    if (!m_is_stopped || !m_av_format_context) {
+        return;
+    }
+    m_is_stopped = false;
+
+    m_pending_packet_queue.clear();
+    if (m_video_av_codec_context) {
+        avcodec_flush_buffers(m_video_av_codec_context.get());
+    }
+    if (m_audio_av_codec_context) {
+        avcodec_flush_buffers(m_audio_av_codec_context.get());
+    }
+
+    AVIOContext *pb = m_av_format_context->pb;
+    if (pb) {
+        pb->error = 0;
+        pb->eof_reached = 0;
+    }
+
+    int64_t start_time = m_av_format_context->start_time;
+    if (start_time == AV_NOPTS_VALUE) {
+        start_time = 0;
+    }
+    int ret = av_seek_frame(m_av_format_context.get(), -1, start_time, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) {
+        char buf[100];
+        av_strerror(ret, buf, sizeof(buf));
+        log(LOG_ERROR, "Error seeking back to the start after a stopped action %i %s\n", ret, buf);
+    }
+
+    m_latest_video_pts = -1;
+    m_latest_video_duration_pts = 0;
+}
+
 int VideoReader::readFrame(AVPacket *packet) {
+    if (isStopped()) {
+        return AVERROR_EXIT;
+    }
+
     int ret;
     if (m_pending_packet_queue.isEmpty()) {
         ret = av_read_frame(m_av_format_context.get(), packet);
+        if (ret == AVERROR_EXIT) {
+            // the interrupt callback stopped it
+            m_is_stopped = true;
+        }
         if (ret < 0) {
             return ret;
         }
@@ -916,11 +1599,18 @@ bool VideoReader::safeSeek(int64_t pts, bool &is_eof) {
     }
 
     while (!is_done) {
+        if (isStopped()) {
+            return false;
+        }
+
         int ret = av_read_frame(m_av_format_context.get(), packet.get());
         if (ret == AVERROR_EOF) {
             is_eof = true;
             return false;
         }
+        if (ret == AVERROR_EXIT) {
+            m_is_stopped = true;
+        }
         if (ret < 0) {
             char buf[100];
             av_strerror(ret, buf, sizeof(buf));
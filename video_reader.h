@@ -7,13 +7,17 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 extern "C" {
 #include <libavformat/avformat.h>
 }
 
 #include "custom_io_group.h"
+#include "custom_output_io.h"
 #include "image_interface.h"
+#include "operation_control.h"
+#include "probe_snapshot.h"
 
 #include "private/stream_map.h"
 #include "private/packet_queue.h"
@@ -43,12 +47,57 @@ struct GetMetadataResult {
     double frame_rate;
 };
 
+// avformat_find_stream_info stops reading the input at whichever of these it gets to first
+struct ProbeTier {
+    int64_t probe_size;
+    // in seconds
+    double analyze_duration;
+};
+
+struct ProbeStats {
+    // tiers probed, 0 when a probe snapshot was used instead
+    int count_tiers = 0;
+    // by the demuxer from its input over all the tiers (for hls, that's just the playlist)
+    int64_t bytes_read = 0;
+    // in seconds, opening the input included
+    double time = 0;
+    bool is_probe_snapshot_used = false;
+    // whether the video and audio streams have what's needed to decode them
+    bool is_complete = false;
+};
+
 struct ExtractClipResult {
     double video_start_time;
     double video_duration;
 
     int count_video_packets;
     int count_key_frames;
+
+    // the whole output file, only set when the custom io group handled it in memory
+    std::shared_ptr<OutputChunk> output_data;
+};
+
+struct ClipRange {
+    double start_time;
+    double end_time;
+    std::string dest_uri;
+};
+
+struct OutputOptions {
+    // write a fragmented mp4 (empty moov up front, then a moof+mdat fragment starting at each key
+    // frame) instead of a faststart mp4, so nothing has to be rewritten at the end and each
+    // fragment is usable as soon as it is written
+    bool is_fragmented = false;
+    // in seconds; fragments are at least this long (still starting on key frames), 0 means a
+    // fragment for every key frame
+    double fragment_duration = 0;
+
+    // these apply when dest_uri ends in .m3u8, which writes an hls playlist with its segments
+    // (split on key frames) next to it
+    // target segment length in seconds; when reencoding, key frames are forced at this interval
+    double hls_segment_duration = 6;
+    // mpegts segments instead of fmp4
+    bool is_hls_mpegts = false;
 };
 
 struct GetVolumeDataResult {
@@ -62,7 +111,9 @@ public:
     VideoReader();
     ~VideoReader();
 
-    bool init(CustomIoGroup *custom_io_group, const std::string &uri);
+    // with a probe snapshot from an earlier init of the same input, the streams are taken from
+    // that instead of being probed, unless it doesn't match the input any more
+    bool init(CustomIoGroup *custom_io_group, const std::string &uri, const ProbeSnapshot *probe_snapshot = nullptr);
     void destroy();
 
     bool verifyHasVideoStream();
@@ -75,21 +126,42 @@ public:
     int64_t getStartTimePts() { return m_av_format_context->start_time; }
     double getStartTime() { return ((double)m_av_format_context->start_time) / AV_TIME_BASE; }
 
+    // what init found out about the streams, to give to a later init of the same input
+    const ProbeSnapshot & getProbeSnapshot() { return m_probe_snapshot; }
+    // whether init used the probe snapshot it was given
+    bool isProbeSnapshotUsed() { return m_probe_stats.is_probe_snapshot_used; }
+
+    // init probes the input with each of these in turn, until the video and audio codec
+    // parameters are complete
+    void setProbeTiers(const std::vector<ProbeTier> &probe_tiers) { m_probe_tiers = probe_tiers; }
+    static std::vector<ProbeTier> getDefaultProbeTiers();
+    const ProbeStats & getProbeStats() { return m_probe_stats; }
+
+    // to stop the running action from another thread, or give the next one a deadline
+    OperationControl & getOperationControl() { return m_operation_control; }
+
+    // a rough count of the bytes held for the input between actions: queued packets and the
+    // decoders' frames, not counting what the custom io group holds
+    int64_t getMemoryUsage();
+
     int64_t getLatestVideoPts() { return m_latest_video_pts; }
     int64_t getLatestVideoDurationPts() { return m_latest_video_duration_pts; }
 
     // high level actions
     bool getImageAtTimestamp(double timestamp, GetImageResult &get_image_result);
     bool getMetadata(GetMetadataResult &get_metadata_result);
-    bool extractClipReencode(const std::string &dest_uri, double start_time, double end_time, ExtractClipResult &result, ProgressFunc progress_func);
-    bool extractClipRemux(const std::string &dest_uri, double start_time, double end_time, ExtractClipResult &result, ProgressFunc progress_func);
-    bool remux(const std::string &dest_uri, ExtractClipResult &result, ProgressFunc progress_func);
+    bool extractClipReencode(const std::string &dest_uri, double start_time, double end_time, ExtractClipResult &result, ProgressFunc progress_func, const OutputOptions &output_options = OutputOptions());
+    bool extractClipRemux(const std::string &dest_uri, double start_time, double end_time, ExtractClipResult &result, ProgressFunc progress_func, const OutputOptions &output_options = OutputOptions());
+    bool remux(const std::string &dest_uri, ExtractClipResult &result, ProgressFunc progress_func, const OutputOptions &output_options = OutputOptions());
+    // remuxes every clip in one forward read of the input; results are in the same order as clip_ranges
+    bool extractClipsRemux(const std::vector<ClipRange> &clip_ranges, std::vector<ExtractClipResult> &results, ProgressFunc progress_func, const OutputOptions &output_options = OutputOptions());
     bool getClipVolumeData(double start_time, double end_time, GetVolumeDataResult &result, ProgressFunc progress_func);
     bool getVolumeData(GetVolumeDataResult &result, ProgressFunc progress_func);
 
     // low level actions
 
-    // returns result from av_read_frame but tracks latest video pts and duration
+    // returns result from av_read_frame but tracks latest video pts and duration; AVERROR_EXIT
+    // once the action has been stopped
     int readFrame(AVPacket *packet);
 
     // seeks to the last key frame before or including pts; may leave m_pending_packet_queue
@@ -97,10 +169,16 @@ public:
     bool safeSeek(int64_t pts, bool &is_eof);
 
 private:
+    CustomIoGroup *m_custom_io_group = nullptr;
+
     std::shared_ptr<AVFormatContext> m_av_format_context;
 
     StreamMap m_stream_map;
 
+    ProbeSnapshot m_probe_snapshot;
+    std::vector<ProbeTier> m_probe_tiers;
+    ProbeStats m_probe_stats;
+
     std::shared_ptr<AVCodecContext> m_video_av_codec_context;
     std::shared_ptr<AVCodecContext> m_audio_av_codec_context;
 
@@ -111,16 +189,33 @@ private:
     // always ends in key frame video packet
     PacketQueue m_pending_packet_queue;
 
+    OperationControl m_operation_control;
+    // an action was stopped part way through, which recoverFromStop() cleans up after
+    bool m_is_stopped = false;
+
     double convertVideoTsToSec(int64_t ts) { return ts * av_q2d(m_stream_map.getVideoAvStream()->time_base); }
     int64_t convertVideoSecToTs(double sec) { return sec / av_q2d(m_stream_map.getVideoAvStream()->time_base); }
 
     double convertAudioTsToSec(int64_t ts) { return ts * av_q2d(m_stream_map.getAudioAvStream()->time_base); }
     int64_t convertAudioSecToTs(double sec) { return sec / av_q2d(m_stream_map.getAudioAvStream()->time_base); }
 
+    // into m_av_format_context, through m_custom_io_group if there is one
+    bool openInput(const std::string &uri);
+    // whether the streams picked for decoding have all their codec parameters
+    bool isProbeComplete();
+
     bool initVideoCodecContext();
     bool initAudioCodecContext();
 
     bool readAndGetImage(int64_t pts, GetImageResult &get_image_result);
+
+    // checks m_operation_control, noting when the action has been stopped
+    bool isStopped();
+    // called at the start of each high level action
+    void recoverFromStop();
+
+    // creates the output streams in stream_map and writes the header
+    bool openRemuxOutput(StreamMap &stream_map, const std::string &dest_uri, const OutputOptions &output_options, std::unique_ptr<AVFormatContext, AVFormatContextOutputCloser> &output_format_context);
 };
 
 }